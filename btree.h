@@ -2,14 +2,23 @@
 #define BTREE_H
 
 #include "btree_internal_node.h"
+#include "btree_iterator.h"
 #include "btree_leaf_node.h"
+#include "btree_node_allocator.h"
+#include "btree_stats.h"
 #include "btree_types.h"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <queue>
+#include <type_traits>
 #include <ranges>
+#include <span>
+#include <thread>
+#include <utility>
 #include <vector>
 
 /*
@@ -28,76 +37,392 @@
  *  traversing the tree? Maybe a stack that keeps track of all the pointers/nodes I've traversed.
  */
 
-// BTree, can't think of anything other than the root node that would need to be here.
-template <typename KeyType, std::size_t N> class BTree {
+// BTree, can't think of anything other than the root node that would need to be here. Well, and where the nodes come
+// from: NodeAllocator is instantiated for each node type, see btree_node_allocator.h. InternalLayout picks how internal
+// nodes are searched, see btree_internal_layout.h. Stats gets told about splits, merges and so on and times each
+// operation, NoBTreeStats ignores all of it, BTreeStats keeps counters and histograms, see btree_stats.h.
+//
+// N is the number of children of an internal node, LeafN - 1 the number of entries of a leaf. They're the same by
+// default, SizedBTree below picks both from a node size in bytes instead.
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator = HeapNodeAllocator,
+          typename InternalLayout = SortedInternalLayout, std::size_t LeafN = N, typename Stats = NoBTreeStats>
+class BTree {
+  static_assert(N >= 3 && LeafN >= 3, "nodes have to hold at least 2 keys");
+
+  using InternalNode = BTreeInternalNode<KeyType, N, InternalLayout>;
+  using LeafNode = BTreeLeafNode<KeyType, N, LeafN>;
+
   BTreeNode<KeyType, N>* root;
+  // The last leaf in key order, or null when it isn't known. Inserts of a key above everything in the tree (ids,
+  // timestamps) go straight here instead of descending from the root. Kept up to date by splits of it, and whenever it's
+  // freed it's forgotten until the next descent that ends in the last leaf picks it up again.
+  LeafNode* rightmost_leaf = nullptr;
+  // Leaves with fewer entries than this get merged or borrow from a sibling, see set_leaf_merge_threshold.
+  std::size_t min_leaf_keys = LeafN / 2;
+  NodeAllocator<LeafNode> leaf_allocator;
+  NodeAllocator<InternalNode> internal_allocator;
+  // Written to from const methods too (find counts its descent), it's bookkeeping rather than tree state.
+  [[no_unique_address]] mutable Stats op_stats;
 
 public:
+  using iterator = BTreeIterator<KeyType, N, InternalLayout, LeafN>;
+  using const_iterator = iterator;
+
   BTree() : root(nullptr) {}
 
   ~BTree();
-  [[nodiscard]] FindResult<KeyType, N> find(const KeyType& key) const;
+  [[nodiscard]] FindResult<KeyType, N, LeafN> find(const KeyType& key) const;
+
+  // Same as calling find for every key, results[i] for keys[i], results has to be at least as long as keys.
+  // Keys are looked up a group at a time, moving the whole group down one level per step and prefetching every child
+  // before any of them is searched, so the cache misses of the group overlap instead of queueing up. When keys is
+  // sorted, each group also walks the part of the path all of its keys share only once.
+  void find_batch(std::span<const KeyType> keys, std::span<FindResult<KeyType, N, LeafN>> results) const;
   [[nodiscard]] InsertResult insert(const KeyType& key, PageData* data);
   [[nodiscard]] DeletionResult delete_key(const KeyType& key);
+
+  // Writes to existing keys. They all go down the tree once, and when the key is already there they only touch its
+  // PageData* in the leaf, so no split, merge or allocation, unlike delete_key followed by insert.
+  //
+  // fn(current) returns the PageData* to store, current is nullptr if the key is new.
+  template <typename Fn> UpsertResult upsert(const KeyType& key, Fn&& fn);
+  // Inserted or Assigned.
+  UpsertResult insert_or_assign(const KeyType& key, PageData* data);
+  // Like insert, but make() is only called if the key is new. Inserted or KeyExists.
+  template <typename Make> UpsertResult try_emplace(const KeyType& key, Make&& make);
+  // fn(current) returns the new PageData* of an existing key. Never inserts, Assigned or KeyNotFound.
+  template <typename Fn> UpsertResult update(const KeyType& key, Fn&& fn);
+
+  // Deletes every key in [lower_bound, upper_bound), returns how many there were. Subtrees that lie entirely inside the
+  // range are freed whole without looking at their keys one by one, only the two leaves at its ends get trimmed, and
+  // what's left underfull along those two paths is merged/redistributed once on the way back up.
+  std::size_t delete_range(const KeyType& lower_bound, const KeyType& upper_bound);
+
+  // One slice of an incremental compaction pass, that can be interleaved with any other operation. Goes along the leaf
+  // chain from where cursor left off for about max_leaves leaves, and repacks each run of them that shares a parent
+  // into as few leaves as options.fill_factor allows. The leaves that are left over get freed, and the parent is fixed
+  // up and merged/redistributed like after a delete if it's now underfull. Leaves under different parents are never
+  // packed together, and a run is never split between slices: a slice stops before a run that would take it past
+  // max_leaves, but always does at least one, so it can go over by up to N leaves. Returns true once the pass has gone
+  // past the last leaf, start a new one with a fresh cursor.
+  bool compact(CompactionCursor<KeyType>& cursor, std::size_t max_leaves, const CompactionOptions& options = {});
+
   std::vector<KeyType> find_keys_in_range(const KeyType& lower_bound, const KeyType& upper_bound) const;
   void print() const;
 
+  // Lazy, allocation free iteration over (key, PageData*) in key order, see btree_iterator.h. Bidirectional, so
+  // std::views::reverse works on all of these.
+  iterator begin() const { return iterator::first(root); }
+  iterator end() const { return iterator::past_end(root); }
+  iterator lower_bound(const KeyType& key) const { return iterator::lower_bound(root, key); }
+  iterator upper_bound(const KeyType& key) const { return iterator::upper_bound(root, key); }
+
+  // Entries between lower and upper, each end included or not as asked. Defaults to [lower, upper).
+  std::ranges::subrange<iterator> range(const KeyType& lower, const KeyType& upper,
+                                        RangeBound lower_bound_kind = RangeBound::Inclusive,
+                                        RangeBound upper_bound_kind = RangeBound::Exclusive) const;
+
+  // Builds the tree bottom-up from (key, PageData*) pairs that are strictly increasing by key, in a single pass. The
+  // tree has to be empty. fill_factor is the fraction of each node that gets packed, it's clamped so that no node ends
+  // up below its underflow threshold.
+  template <std::input_iterator It, std::sentinel_for<It> S>
+  [[nodiscard]] BulkLoadResult bulk_load(It first, S last, double fill_factor = 1.0);
+  template <std::ranges::input_range R> [[nodiscard]] BulkLoadResult bulk_load(R&& entries, double fill_factor = 1.0);
+  // bulk_load on up to threads threads, for builds that are too big for one. entries doesn't have to be sorted, it gets
+  // sorted by key in place first (chunks sorted in parallel, then merged pairwise in parallel), and only Duplicate or
+  // NotEmpty can fail it. Nodes are allocated by the calling thread, allocators aren't thread safe, the workers then
+  // each fill a contiguous run of leaves, and of each internal level after that. The tree comes out the same as
+  // bulk_load would build it from the sorted entries.
+  [[nodiscard]] BulkLoadResult parallel_bulk_load(std::span<std::pair<KeyType, PageData*>> entries, unsigned threads,
+                                                  double fill_factor = 1.0);
+
+  // fold(acc, key, PageData*) over every entry in [lower_bound, upper_bound), on up to threads threads. The range is cut
+  // at separator keys of the highest levels that give a few pieces per thread, the threads take pieces as they go,
+  // each piece is folded starting from init, and the results are put together with combine(a, b) in key order. So init
+  // has to be an identity of combine, e.g. 0 for a sum. No writes to the tree while this runs.
+  template <typename T, typename Fold, typename Combine>
+  T parallel_aggregate(const KeyType& lower_bound, const KeyType& upper_bound, unsigned threads, T init, Fold&& fold,
+                       Combine&& combine) const;
+
+  // How empty a leaf can get before a delete merges it into a sibling or borrows from one, as a fraction of its capacity.
+  // The default 0.5 is the textbook B+ tree. With it, deletes and inserts around a half full leaf keep merging it and
+  // splitting the result again. Lower values leave leaves alone until they're that sparse, at the price of more of them.
+  // 0 frees a leaf only once it's empty. Below 0.5 deletes also merge only if the result is at most 3/4 full, and
+  // otherwise even out the two leaves, so the next few inserts or deletes on either don't need another fix.
+  //
+  // Only leaves are affected, internal nodes are always kept half full, and nothing is rebalanced when this changes.
+  // Leaves that are already below the new threshold get fixed on their next delete.
+  void set_leaf_merge_threshold(double fill);
+
+  // Walks the whole tree and checks key order, separator bounds, equal leaf depth and the right_sibling chain.
+  [[nodiscard]] bool validate() const;
+
+  // Whatever Stats recorded, e.g. stats().snapshot().to_json() with BTreeStats. Non-const for stats().reset().
+  const Stats& stats() const { return op_stats; }
+  Stats& stats() { return op_stats; }
+
 private:
-  BTreeLeafNode<KeyType, N>* find_leaf_for_key(const KeyType& key, std::vector<BTreeNode<KeyType, N>*>& path) const;
+  // Records the internal nodes passed into path, unless it's null.
+  LeafNode* find_leaf_for_key(const KeyType& key, NodePath<KeyType, N>* path = nullptr) const;
+  static FindResult<KeyType, N, LeafN> find_in_leaf(LeafNode* leaf, const KeyType& key);
+  static void prefetch_node(const BTreeNode<KeyType, N>* node, bool is_leaf);
+  void find_batch_interleaved(std::span<const KeyType> keys, std::span<FindResult<KeyType, N, LeafN>> results,
+                              bool sorted) const;
   void insert_key_in_parent(BTreeNode<KeyType, N>* node, const KeyType& key, BTreeNode<KeyType, N>* new_node,
-                            std::vector<BTreeNode<KeyType, N>*>& path);
-  void delete_tree(BTreeNode<KeyType, N>* node);
+                            NodePath<KeyType, N>& path);
+  // rightmost_leaf if key is larger than every key in the tree, null otherwise (or if there's no rightmost_leaf yet).
+  LeafNode* append_leaf(const KeyType& key) const {
+    if (rightmost_leaf == nullptr || rightmost_leaf->numKeys == 0 ||
+        !(rightmost_leaf->keys[rightmost_leaf->numKeys - 1] < key)) {
+      return nullptr;
+    }
+    return rightmost_leaf;
+  }
+  // Puts key at the end of append_leaf(key). The path down to it is only needed for a split, and then it's just the
+  // last child of every level, so it's walked without looking at any keys.
+  void append(LeafNode* leaf, const KeyType& key, PageData* data);
+  // key isn't in leaf and leaf is full.
+  void split_leaf_and_insert(LeafNode* leaf, const KeyType& key, PageData* data, NodePath<KeyType, N>& path);
+  // The one descent behind upsert, try_emplace and update. on_existing(PageData*&) deals with a key that's there,
+  // make() gives the PageData* for one that isn't, unless Insert is false.
+  template <bool Insert, typename Make, typename OnExisting>
+  UpsertResult upsert_entry(const KeyType& key, Make&& make, OnExisting&& on_existing);
+  // Frees node and everything under it, returns how many entries that was.
+  std::size_t delete_tree(BTreeNode<KeyType, N>* node);
+  LeafNode* new_leaf() {
+    op_stats.node_allocated();
+    return leaf_allocator.create();
+  }
+  InternalNode* new_internal() {
+    op_stats.node_allocated();
+    return internal_allocator.create();
+  }
+  void free_node(BTreeNode<KeyType, N>* node);
 
   // Deletion helper methods
   SiblingInfo<KeyType, N> get_sibling(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* parent) const;
   bool can_merge(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* sibling) const;
   void merge_nodes(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* sibling, const KeyType& separator,
-                   bool sibling_is_left, BTreeNode<KeyType, N>* parent, std::vector<BTreeNode<KeyType, N>*>& path);
+                   bool sibling_is_left, BTreeNode<KeyType, N>* parent, NodePath<KeyType, N>& path);
   void redistribute(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* sibling, const KeyType& separator,
                     std::size_t separator_index, bool sibling_is_left, BTreeNode<KeyType, N>* parent);
-  void handle_underflow(BTreeNode<KeyType, N>* node, std::vector<BTreeNode<KeyType, N>*>& path);
+  void handle_underflow(BTreeNode<KeyType, N>* node, NodePath<KeyType, N>& path);
+  bool is_underflow(const BTreeNode<KeyType, N>* node) const;
+  // Most entries a leaf may have after a merge, see set_leaf_merge_threshold.
+  std::size_t leaf_merge_limit() const {
+    return min_leaf_keys == LeafN / 2 ? LeafN - 1 : std::max(2 * min_leaf_keys, (LeafN - 1) * 3 / 4);
+  }
+  // Moves everything of right into left and takes separator and right out of their parent. Leaves the parent as is,
+  // even if that makes it underflow.
+  void merge_into_left(BTreeNode<KeyType, N>* left, BTreeNode<KeyType, N>* right, const KeyType& separator,
+                       InternalNode* parent);
+
+  // Compaction helpers.
+  LeafNode* new_sequential_leaf() {
+    if constexpr (requires { leaf_allocator.create_sequential(); }) {
+      op_stats.node_allocated();
+      return leaf_allocator.create_sequential();
+    } else {
+      return new_leaf();
+    }
+  }
+  // The leaf before path.back()'s first child, path being the internal nodes down to it. Null for the first leaf.
+  static LeafNode* leaf_before(const NodePath<KeyType, N>& path);
+
+  // Range deletion helpers. A null bound means the range goes past that end of node's subtree.
+  std::size_t delete_range_in(BTreeNode<KeyType, N>* node, const KeyType* lower_bound, const KeyType* upper_bound);
+  // Fixes every underflowing child of parent, and then whatever underflows inside those. Children that only have a
+  // single child themselves can't be fixed at their level, so after a child is fixed its own children get a look too.
+  void rebalance_children(InternalNode* parent);
+
+  // Bulk load helpers
+  static std::size_t packed_count(double fill_factor, std::size_t capacity, std::size_t minimum);
+  // How bulk loading cuts count items into nodes: per each, except that a last node below minimum takes everything of
+  // the one before it if that fits in capacity, or half of their total otherwise.
+  struct PackedLayout {
+    std::size_t count;
+    std::size_t nodes;
+    std::size_t per;
+    std::size_t second_last;
+    std::size_t last;
+
+    std::size_t start(std::size_t i) const { return i + 1 < nodes ? i * per : count - last; }
+    std::size_t size(std::size_t i) const { return i + 1 == nodes ? last : i + 2 == nodes ? second_last : per; }
+  };
+  static PackedLayout packed_layout(std::size_t count, std::size_t per, std::size_t minimum, std::size_t capacity);
+  void build_internal_levels(std::vector<std::pair<KeyType, BTreeNode<KeyType, N>*>>& level, double fill_factor,
+                             unsigned threads = 1);
+  // fn(begin, end) on up to threads contiguous chunks of [0, count), the calling thread doing the first.
+  template <typename Fn> static void for_each_chunk(std::size_t count, unsigned threads, Fn&& fn);
+  static void parallel_sort(std::span<std::pair<KeyType, PageData*>> entries, unsigned threads);
+
+  bool validate_node(const BTreeNode<KeyType, N>* node, const KeyType* lower, const KeyType* upper, std::size_t depth,
+                     std::size_t& leaf_depth, const LeafNode*& prev_leaf) const;
 };
 
-template <typename KeyType, std::size_t N> BTree<KeyType, N>::~BTree() { delete_tree(root); }
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::~BTree() {
+  // With a pool that can drop all of its memory at once, there's no need to visit every node, as long as the nodes
+  // don't own anything themselves.
+  if constexpr (NodeAllocator<LeafNode>::BULK_RELEASE &&
+                NodeAllocator<InternalNode>::BULK_RELEASE && std::is_trivially_destructible_v<KeyType>) {
+    leaf_allocator.release_all();
+    internal_allocator.release_all();
+  } else {
+    delete_tree(root);
+  }
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::free_node(BTreeNode<KeyType, N>* node) {
+  op_stats.node_freed();
+  if (node == rightmost_leaf) {
+    rightmost_leaf = nullptr;
+  }
+  if (node->isLeaf()) {
+    leaf_allocator.destroy(static_cast<LeafNode*>(node));
+  } else {
+    internal_allocator.destroy(static_cast<InternalNode*>(node));
+  }
+}
 
-template <typename KeyType, std::size_t N> void BTree<KeyType, N>::delete_tree(BTreeNode<KeyType, N>* node) {
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+std::size_t BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::delete_tree(BTreeNode<KeyType, N>* node) {
   if (node == nullptr) {
-    return;
+    return 0;
   }
 
+  std::size_t entries = node->isLeaf() ? node->numKeys : 0;
   if (!node->isLeaf()) {
-    auto* internalNode = static_cast<BTreeInternalNode<KeyType, N>*>(node);
+    auto* internalNode = static_cast<InternalNode*>(node);
     for (std::size_t i = 0; i <= internalNode->numKeys; ++i) {
-      delete_tree(internalNode->children[i]);
+      entries += delete_tree(internalNode->children[i]);
     }
   }
 
-  delete node;
-};
+  free_node(node);
+  return entries;
+}
 
 // TODO: To keep track of parents of the nodes I'll likely need to keep the pointers in a stack when finding and return
 // them, right?
 // Find and returns the pointer to the leaf node containing given key. Returns null pointer if key is not found.
-template <typename KeyType, std::size_t N> FindResult<KeyType, N> BTree<KeyType, N>::find(const KeyType& key) const {
-  std::vector<BTreeNode<KeyType, N>*> path;
-  BTreeLeafNode<KeyType, N>* leaf_node = find_leaf_for_key(key, path);
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+FindResult<KeyType, N, LeafN> BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::find(const KeyType& key) const {
+  [[maybe_unused]] auto timer = op_stats.time(BTreeOp::Find);
+  // Nothing to do on the way back up, so no path.
+  LeafNode* leaf_node = find_leaf_for_key(key);
 
   if (leaf_node == nullptr) {
     return {nullptr, 0};
   }
 
-  auto it = std::ranges::lower_bound(leaf_node->keys, leaf_node->keys + leaf_node->numKeys, key);
+  return find_in_leaf(leaf_node, key);
+}
 
-  if (it != leaf_node->keys + leaf_node->numKeys && *it == key) {
-    std::size_t idx = std::distance(leaf_node->keys, it);
-    return {leaf_node, idx};
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+FindResult<KeyType, N, LeafN> BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::find_in_leaf(LeafNode* leaf,
+                                                                                     const KeyType& key) {
+  std::size_t idx = node_lower_bound<LeafN - 1>(leaf->keys, leaf->numKeys, key);
+
+  if (idx != leaf->numKeys && leaf->keys[idx] == key) {
+    return {leaf, idx};
   }
   return {nullptr, 0};
 }
 
-template <typename KeyType, std::size_t N>
-BTreeLeafNode<KeyType, N>* BTree<KeyType, N>::find_leaf_for_key(const KeyType& key,
-                                                                std::vector<BTreeNode<KeyType, N>*>& path) const {
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::find_batch(
+    std::span<const KeyType> keys, std::span<FindResult<KeyType, N, LeafN>> results) const {
+  if (root == nullptr) {
+    std::ranges::fill(results.first(keys.size()), FindResult<KeyType, N, LeafN>{nullptr, 0});
+    return;
+  }
+  find_batch_interleaved(keys, results, std::ranges::is_sorted(keys));
+}
+
+// Only the keys are searched, so that's the part of the node worth pulling in. Binary search over a wide node touches
+// just a handful of its lines, so past a few lines we leave the rest to the search itself.
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::prefetch_node(const BTreeNode<KeyType, N>* node, bool is_leaf) {
+  constexpr std::size_t CACHE_LINE = 64;
+  constexpr std::size_t MAX_LINES = 4;
+  const auto* keys = is_leaf ? static_cast<const LeafNode*>(node)->keys
+                             : static_cast<const InternalNode*>(node)->keys;
+  const auto* bytes = reinterpret_cast<const char*>(node);
+  std::size_t end = reinterpret_cast<const char*>(keys + (is_leaf ? LeafN - 1 : N - 1)) - bytes;
+  for (std::size_t offset = 0; offset < std::min(end, MAX_LINES * CACHE_LINE); offset += CACHE_LINE) {
+    __builtin_prefetch(bytes + offset);
+  }
+  if (!is_leaf) {
+    static_cast<const InternalNode*>(node)->search_index.prefetch();
+  }
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::find_batch_interleaved(
+    std::span<const KeyType> keys, std::span<FindResult<KeyType, N, LeafN>> results, bool sorted) const {
+  // Enough lookups in flight to cover a memory access, few enough that their nodes stay in L1 until we get back to them.
+  constexpr std::size_t GROUP_SIZE = 16;
+
+  // Every leaf is at the same depth, so the whole group reaches the leaves on the same step.
+  std::size_t height = 0;
+  for (const BTreeNode<KeyType, N>* node = root; !node->isLeaf();) {
+    node = static_cast<const InternalNode*>(node)->children[0];
+    height++;
+  }
+
+  BTreeNode<KeyType, N>* nodes[GROUP_SIZE];
+  for (std::size_t begin = 0; begin < keys.size(); begin += GROUP_SIZE) {
+    std::size_t group = std::min(GROUP_SIZE, keys.size() - begin);
+
+    // In a sorted group everything between the first and the last key shares their path down to where those two part
+    // ways, so only that one walk is needed for the shared part. For a dense batch that's often all the way to the leaf.
+    BTreeNode<KeyType, N>* start = root;
+    std::size_t level = 0;
+    if (sorted) {
+      const KeyType& first = keys[begin];
+      const KeyType& last = keys[begin + group - 1];
+      while (level < height) {
+        auto* internal = static_cast<InternalNode*>(start);
+        std::size_t child = internal->child_index(first);
+        if (child != internal->child_index(last)) {
+          break;
+        }
+        start = internal->children[child];
+        level++;
+      }
+    }
+    std::fill_n(nodes, group, start);
+
+    while (level < height) {
+      level++;
+      for (std::size_t i = 0; i < group; ++i) {
+        auto* internal = static_cast<InternalNode*>(nodes[i]);
+        nodes[i] = internal->children[internal->child_index(keys[begin + i])];
+        prefetch_node(nodes[i], level == height);
+      }
+    }
+
+    for (std::size_t i = 0; i < group; ++i) {
+      results[begin + i] = find_in_leaf(static_cast<LeafNode*>(nodes[i]), keys[begin + i]);
+    }
+  }
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+typename BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::LeafNode*
+BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::find_leaf_for_key(const KeyType& key,
+                                                                           NodePath<KeyType, N>* path) const {
   // We'll we got not tree, so no leaf where we can insert the key.
   if (root == nullptr) {
     return nullptr;
@@ -105,8 +430,12 @@ BTreeLeafNode<KeyType, N>* BTree<KeyType, N>::find_leaf_for_key(const KeyType& k
 
   // Loop over the nodes until you find a leaf node.
   BTreeNode<KeyType, N>* cur = root;
+  std::size_t visited = 1;
   while (!cur->isLeaf()) {
-    path.push_back(cur);
+    visited++;
+    if (path != nullptr) {
+      path->push_back(cur);
+    }
     // Get the first key index that is greater than the key we're looking for, since there are going to be no duplicates
     // we don't need to worry about equals param.
     // The one we find will be the pointer we follow. For instance consider a capacity of 5 pointers, 4 keys. With a
@@ -121,41 +450,92 @@ BTreeLeafNode<KeyType, N>* BTree<KeyType, N>::find_leaf_for_key(const KeyType& k
     //
     // If the first element itself is greater than the key then we know it should be the first pointer and that's what
     // upper_bound will return so thats once again correct.
-    auto* internalNode = static_cast<BTreeInternalNode<KeyType, N>*>(cur);
-    auto it = std::ranges::upper_bound(internalNode->keys, internalNode->keys + internalNode->numKeys, key);
-    std::size_t next_pointer_idx = std::distance(internalNode->keys, it);
+    auto* internalNode = static_cast<InternalNode*>(cur);
+    std::size_t next_pointer_idx = internalNode->child_index(key);
     cur = internalNode->children[next_pointer_idx];
+    if (!cur->isLeaf()) {
+      static_cast<InternalNode*>(cur)->search_index.prefetch();
+    }
   }
 
   // return what we found.
-  return static_cast<BTreeLeafNode<KeyType, N>*>(cur);
+  op_stats.descended(visited);
+  return static_cast<LeafNode*>(cur);
 }
 
-template <typename KeyType, std::size_t N> InsertResult BTree<KeyType, N>::insert(const KeyType& key, PageData* data) {
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+InsertResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::insert(const KeyType& key, PageData* data) {
+  [[maybe_unused]] auto timer = op_stats.time(BTreeOp::Insert);
   // If we've got no tree, we need to make one.
   if (root == nullptr) {
-    root = new BTreeLeafNode<KeyType, N>();
+    root = new_leaf();
+    op_stats.root_changed();
   }
 
-  std::vector<BTreeNode<KeyType, N>*> path;
-  BTreeLeafNode<KeyType, N>* leaf = find_leaf_for_key(key, path);
+  if (LeafNode* last = append_leaf(key)) {
+    append(last, key, data);
+    return InsertResult::Success;
+  }
+
+  NodePath<KeyType, N> path;
+  LeafNode* leaf = find_leaf_for_key(key, &path);
+  if (leaf->right_sibling == nullptr) {
+    rightmost_leaf = leaf;
+  }
   InsertResult result = leaf->insert_key(key, data);
   if (result != InsertResult::Full) {
     return result;
   }
 
+  split_leaf_and_insert(leaf, key, data, path);
+  return InsertResult::Success;
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::append(LeafNode* leaf, const KeyType& key,
+                                                                            PageData* data) {
+  op_stats.appended();
+  if (leaf->insert_key(key, data) != InsertResult::Full) {
+    return;
+  }
+
+  NodePath<KeyType, N> path;
+  for (BTreeNode<KeyType, N>* cur = root; !cur->isLeaf();) {
+    path.push_back(cur);
+    auto* internal = static_cast<InternalNode*>(cur);
+    cur = internal->children[internal->numKeys];
+  }
+  split_leaf_and_insert(leaf, key, data, path);
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::split_leaf_and_insert(LeafNode* leaf, const KeyType& key,
+                                                                                    PageData* data,
+                                                                                    NodePath<KeyType, N>& path) {
   // Split the node
   // Handle the sibling pointers.
-  BTreeLeafNode<KeyType, N>* right_node = new BTreeLeafNode<KeyType, N>();
+  LeafNode* right_node = new_leaf();
+  op_stats.split(true);
   right_node->right_sibling = leaf->right_sibling;
   leaf->right_sibling = right_node;
 
-  // Since N is the maximum number of pointers a node can accommodate, and N-1 is the upper limit for keys, and we want
-  // to move ceil((n-1)/2) which can be dumbed down to N / 2 for integer division.
-  size_t split_idx = N / 2;
+  // Since LeafN - 1 is the upper limit for keys, and we want to move ceil((LeafN-1)/2) which can be dumbed down to
+  // LeafN / 2 for integer division.
+  size_t split_idx = LeafN / 2;
+  // Except at the right edge of the tree with a key past everything in it, that's an append and more of them are likely
+  // to follow. A half split would leave every leaf behind the appends half empty for good, so keep 90% on the left and
+  // only start the new last leaf with the rest. The 10% is for keys that arrive slightly out of order.
+  if (right_node->right_sibling == nullptr) {
+    rightmost_leaf = right_node;
+    if (leaf->keys[leaf->numKeys - 1] < key) {
+      split_idx = std::max(split_idx, (LeafN - 1) * 9 / 10);
+    }
+  }
 
-  // Move keys from split_idx to N-2 (end of current keys) to right_node.
-  // Move keys from split_idx to N-2 (end of current keys) to right_node.
+  // Move keys from split_idx to the end of the leaf's keys (numKeys - 1) to right_node.
   std::ranges::copy(leaf->keys + split_idx, leaf->keys + leaf->numKeys, right_node->keys);
   std::ranges::copy(leaf->dataPointers + split_idx, leaf->dataPointers + leaf->numKeys, right_node->dataPointers);
 
@@ -174,27 +554,109 @@ template <typename KeyType, std::size_t N> InsertResult BTree<KeyType, N>::inser
 
   // Now we've got to propagate the split to the parent.
   insert_key_in_parent(leaf, right_node->keys[0], right_node, path);
+}
 
-  return InsertResult::Success;
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+template <bool Insert, typename Make, typename OnExisting>
+UpsertResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::upsert_entry(const KeyType& key, Make&& make,
+                                                                                   OnExisting&& on_existing) {
+  [[maybe_unused]] auto timer = op_stats.time(BTreeOp::Insert);
+  if (root == nullptr) {
+    if constexpr (!Insert) {
+      return UpsertResult::KeyNotFound;
+    }
+    root = new_leaf();
+    op_stats.root_changed();
+  }
+
+  if constexpr (Insert) {
+    if (LeafNode* last = append_leaf(key)) {
+      append(last, key, make());
+      return UpsertResult::Inserted;
+    }
+  }
+
+  // The path is only needed if the key turns out to be new and its leaf is full.
+  NodePath<KeyType, N> path;
+  LeafNode* leaf = find_leaf_for_key(key, Insert ? &path : nullptr);
+  if (leaf->right_sibling == nullptr) {
+    rightmost_leaf = leaf;
+  }
+  std::size_t idx = node_lower_bound<LeafN - 1>(leaf->keys, leaf->numKeys, key);
+  if (idx != leaf->numKeys && leaf->keys[idx] == key) {
+    return on_existing(leaf->dataPointers[idx]);
+  }
+
+  if constexpr (!Insert) {
+    return UpsertResult::KeyNotFound;
+  } else {
+    PageData* data = make();
+    if (leaf->insert_key(key, data) == InsertResult::Full) {
+      split_leaf_and_insert(leaf, key, data, path);
+    }
+    return UpsertResult::Inserted;
+  }
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+template <typename Fn>
+UpsertResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::upsert(const KeyType& key, Fn&& fn) {
+  return upsert_entry<true>(
+      key, [&] { return fn(static_cast<PageData*>(nullptr)); },
+      [&](PageData*& current) {
+        current = fn(current);
+        return UpsertResult::Assigned;
+      });
 }
 
-template <typename KeyType, std::size_t N>
-void BTree<KeyType, N>::insert_key_in_parent(BTreeNode<KeyType, N>* node, const KeyType& key,
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+UpsertResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::insert_or_assign(const KeyType& key,
+                                                                                       PageData* data) {
+  return upsert(key, [data](PageData*) { return data; });
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+template <typename Make>
+UpsertResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::try_emplace(const KeyType& key, Make&& make) {
+  return upsert_entry<true>(key, make, [](PageData*&) { return UpsertResult::KeyExists; });
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+template <typename Fn>
+UpsertResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::update(const KeyType& key, Fn&& fn) {
+  return upsert_entry<false>(
+      key, [] { return static_cast<PageData*>(nullptr); },
+      [&](PageData*& current) {
+        current = fn(current);
+        return UpsertResult::Assigned;
+      });
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::insert_key_in_parent(BTreeNode<KeyType, N>* node, const KeyType& key,
                                              BTreeNode<KeyType, N>* new_node,
-                                             std::vector<BTreeNode<KeyType, N>*>& path) {
+                                             NodePath<KeyType, N>& path) {
   if (path.empty()) {
-    BTreeInternalNode<KeyType, N>* new_root = new BTreeInternalNode<KeyType, N>();
+    InternalNode* new_root = new_internal();
     new_root->keys[0] = key;
     new_root->children[0] = node;
     new_root->children[1] = new_node;
     new_root->numKeys = 1;
+    new_root->keys_changed();
     root = new_root;
+    op_stats.root_changed();
     return;
   }
 
   BTreeNode<KeyType, N>* parent_node = path.back();
   path.pop_back();
-  auto* parent = static_cast<BTreeInternalNode<KeyType, N>*>(parent_node);
+  auto* parent = static_cast<InternalNode*>(parent_node);
 
   if (!parent->isFull()) {
     parent->insert_key(key, new_node);
@@ -207,7 +669,8 @@ void BTree<KeyType, N>::insert_key_in_parent(BTreeNode<KeyType, N>* node, const
   KeyType temp_keys[N];
   BTreeNode<KeyType, N>* temp_children[N + 1];
 
-  InsertPosition pos = find_index_greater_than_or_equal(std::span<const KeyType>(parent->keys, parent->numKeys), key);
+  InsertPosition pos =
+      find_index_greater_than_or_equal<N - 1>(std::span<const KeyType>(parent->keys, parent->numKeys), key);
 
   // Copy up to pos
   std::ranges::copy(parent->keys, parent->keys + pos.index, temp_keys);
@@ -227,7 +690,8 @@ void BTree<KeyType, N>::insert_key_in_parent(BTreeNode<KeyType, N>* node, const
   size_t split_idx = N / 2;
   KeyType promoted_key = temp_keys[split_idx];
 
-  BTreeInternalNode<KeyType, N>* sibling = new BTreeInternalNode<KeyType, N>();
+  InternalNode* sibling = new_internal();
+  op_stats.split(false);
 
   // Restore parent (Left node)
   parent->numKeys = split_idx;
@@ -240,17 +704,22 @@ void BTree<KeyType, N>::insert_key_in_parent(BTreeNode<KeyType, N>* node, const
   std::ranges::copy(temp_children + split_idx + 1, temp_children + N + 1, sibling->children);
   sibling->numKeys = sibling_key_count;
 
+  parent->keys_changed();
+  sibling->keys_changed();
   insert_key_in_parent(parent, promoted_key, sibling, path);
 }
 
 // Main deletion method - delete a key from the B+ tree
-template <typename KeyType, std::size_t N> DeletionResult BTree<KeyType, N>::delete_key(const KeyType& key) {
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+DeletionResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::delete_key(const KeyType& key) {
+  [[maybe_unused]] auto timer = op_stats.time(BTreeOp::Delete);
   if (root == nullptr) {
     return DeletionResult::KeyNotFound;
   }
 
-  std::vector<BTreeNode<KeyType, N>*> path;
-  BTreeLeafNode<KeyType, N>* leaf = find_leaf_for_key(key, path);
+  NodePath<KeyType, N> path;
+  LeafNode* leaf = find_leaf_for_key(key, &path);
 
   if (leaf == nullptr) {
     return DeletionResult::KeyNotFound;
@@ -263,13 +732,14 @@ template <typename KeyType, std::size_t N> DeletionResult BTree<KeyType, N>::del
 
   // Special case: root is a leaf and is now empty
   if (root == leaf && leaf->numKeys == 0) {
-    delete root;
+    free_node(root);
     root = nullptr;
+    op_stats.root_changed();
     return DeletionResult::Success;
   }
 
   // Check if the leaf node underflowed (only if it's not the root)
-  if (root != leaf && leaf->isUnderflow()) {
+  if (root != leaf && is_underflow(leaf)) {
     handle_underflow(leaf, path);
   }
 
@@ -277,10 +747,11 @@ template <typename KeyType, std::size_t N> DeletionResult BTree<KeyType, N>::del
 }
 
 // Get sibling information for a node
-template <typename KeyType, std::size_t N>
-SiblingInfo<KeyType, N> BTree<KeyType, N>::get_sibling(BTreeNode<KeyType, N>* node,
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+SiblingInfo<KeyType, N> BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::get_sibling(BTreeNode<KeyType, N>* node,
                                                        BTreeNode<KeyType, N>* parent) const {
-  auto* internal_parent = static_cast<BTreeInternalNode<KeyType, N>*>(parent);
+  auto* internal_parent = static_cast<InternalNode*>(parent);
 
   // Find the index of node in parent's children
   std::size_t node_index = 0;
@@ -316,30 +787,30 @@ SiblingInfo<KeyType, N> BTree<KeyType, N>::get_sibling(BTreeNode<KeyType, N>* no
 }
 
 // Check if two nodes can be merged
-template <typename KeyType, std::size_t N>
-bool BTree<KeyType, N>::can_merge(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* sibling) const {
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+bool BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::can_merge(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* sibling) const {
   if (node->isLeaf()) {
     // For leaf nodes, check if combined keys fit
-    return node->numKeys + sibling->numKeys <= (N - 1);
+    return std::size_t{node->numKeys} + sibling->numKeys <= leaf_merge_limit();
   } else {
     // For internal nodes, need space for separator key from parent
-    return node->numKeys + sibling->numKeys + 1 <= (N - 1);
+    return std::size_t{node->numKeys} + sibling->numKeys + 1 <= (N - 1);
   }
 }
 
 // Merge two nodes into one
-template <typename KeyType, std::size_t N>
-void BTree<KeyType, N>::merge_nodes(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* sibling,
-                                    const KeyType& separator, bool sibling_is_left, BTreeNode<KeyType, N>* parent,
-                                    std::vector<BTreeNode<KeyType, N>*>& path) {
-  // Normalize: always merge right node into left node
-  BTreeNode<KeyType, N>* left_node = sibling_is_left ? sibling : node;
-  BTreeNode<KeyType, N>* right_node = sibling_is_left ? node : sibling;
-
-  if (left_node->isLeaf()) {
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::merge_into_left(BTreeNode<KeyType, N>* left,
+                                                                              BTreeNode<KeyType, N>* right,
+                                                                              const KeyType& separator,
+                                                                              InternalNode* parent) {
+  op_stats.merge(left->isLeaf());
+  if (left->isLeaf()) {
     // Merge leaf nodes
-    auto* left_leaf = static_cast<BTreeLeafNode<KeyType, N>*>(left_node);
-    auto* right_leaf = static_cast<BTreeLeafNode<KeyType, N>*>(right_node);
+    auto* left_leaf = static_cast<LeafNode*>(left);
+    auto* right_leaf = static_cast<LeafNode*>(right);
 
     // Copy all entries from right to left
     std::ranges::copy(right_leaf->keys, right_leaf->keys + right_leaf->numKeys, left_leaf->keys + left_leaf->numKeys);
@@ -351,11 +822,11 @@ void BTree<KeyType, N>::merge_nodes(BTreeNode<KeyType, N>* node, BTreeNode<KeyTy
     // Update sibling pointer: left now points to right's right sibling
     left_leaf->right_sibling = right_leaf->right_sibling;
 
-    delete right_node;
+    free_node(right);
   } else {
     // Merge internal nodes
-    auto* left_internal = static_cast<BTreeInternalNode<KeyType, N>*>(left_node);
-    auto* right_internal = static_cast<BTreeInternalNode<KeyType, N>*>(right_node);
+    auto* left_internal = static_cast<InternalNode*>(left);
+    auto* right_internal = static_cast<InternalNode*>(right);
 
     // Pull down separator key from parent
     left_internal->keys[left_internal->numKeys] = separator;
@@ -368,18 +839,32 @@ void BTree<KeyType, N>::merge_nodes(BTreeNode<KeyType, N>* node, BTreeNode<KeyTy
                       left_internal->children + left_internal->numKeys);
 
     left_internal->numKeys += right_internal->numKeys;
+    left_internal->keys_changed();
 
-    delete right_node;
+    free_node(right);
   }
 
   // Delete the separator and pointer from parent
-  auto* internal_parent = static_cast<BTreeInternalNode<KeyType, N>*>(parent);
-  internal_parent->delete_entry(separator, right_node);
+  parent->delete_entry(separator, right);
+}
+
+// Merge node with its sibling, then deal with the parent losing an entry
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::merge_nodes(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* sibling,
+                                    const KeyType& separator, bool sibling_is_left, BTreeNode<KeyType, N>* parent,
+                                    NodePath<KeyType, N>& path) {
+  // Normalize: always merge right node into left node
+  BTreeNode<KeyType, N>* left_node = sibling_is_left ? sibling : node;
+  BTreeNode<KeyType, N>* right_node = sibling_is_left ? node : sibling;
+  auto* internal_parent = static_cast<InternalNode*>(parent);
+  merge_into_left(left_node, right_node, separator, internal_parent);
 
   // Special case: if parent is root and now empty, make left_node the new root
   if (parent == root && internal_parent->numKeys == 0) {
     root = left_node;
-    delete parent;
+    op_stats.root_changed();
+    free_node(parent);
   } else if (parent != root && internal_parent->isUnderflow()) {
     // Parent might now underflow, handle recursively
     handle_underflow(parent, path);
@@ -387,36 +872,45 @@ void BTree<KeyType, N>::merge_nodes(BTreeNode<KeyType, N>* node, BTreeNode<KeyTy
 }
 
 // Redistribute entries between node and sibling
-template <typename KeyType, std::size_t N>
-void BTree<KeyType, N>::redistribute(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* sibling,
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::redistribute(BTreeNode<KeyType, N>* node, BTreeNode<KeyType, N>* sibling,
                                      const KeyType& separator, std::size_t separator_index, bool sibling_is_left,
                                      BTreeNode<KeyType, N>* parent) {
-  auto* internal_parent = static_cast<BTreeInternalNode<KeyType, N>*>(parent);
+  op_stats.redistribute();
+  auto* internal_parent = static_cast<InternalNode*>(parent);
+  // Leaves take one entry from the sibling, unless deletes are relaxed, then they split what the two have evenly. The
+  // sibling is always the fuller one here, otherwise the two would have been merged.
+  std::size_t moved = 1;
+  if (node->isLeaf() && min_leaf_keys < LeafN / 2) {
+    moved = std::max<std::size_t>((sibling->numKeys - node->numKeys) / 2, 1);
+  }
 
   if (sibling_is_left) {
     // Borrow from left sibling
     if (node->isLeaf()) {
-      auto* leaf = static_cast<BTreeLeafNode<KeyType, N>*>(node);
-      auto* sibling_leaf = static_cast<BTreeLeafNode<KeyType, N>*>(sibling);
+      auto* leaf = static_cast<LeafNode*>(node);
+      auto* sibling_leaf = static_cast<LeafNode*>(sibling);
 
-      std::size_t borrow_idx = sibling_leaf->numKeys - 1;
+      std::size_t borrow_idx = sibling_leaf->numKeys - moved;
 
       // Shift node's entries right to make room
-      std::ranges::move_backward(leaf->keys, leaf->keys + leaf->numKeys, leaf->keys + leaf->numKeys + 1);
+      std::ranges::move_backward(leaf->keys, leaf->keys + leaf->numKeys, leaf->keys + leaf->numKeys + moved);
       std::ranges::move_backward(leaf->dataPointers, leaf->dataPointers + leaf->numKeys,
-                                 leaf->dataPointers + leaf->numKeys + 1);
+                                 leaf->dataPointers + leaf->numKeys + moved);
 
-      // Move last entry from sibling to first position in node
-      leaf->keys[0] = sibling_leaf->keys[borrow_idx];
-      leaf->dataPointers[0] = sibling_leaf->dataPointers[borrow_idx];
-      leaf->numKeys++;
-      sibling_leaf->numKeys--;
+      // Move the last entries from sibling to the front of node
+      std::ranges::copy(sibling_leaf->keys + borrow_idx, sibling_leaf->keys + sibling_leaf->numKeys, leaf->keys);
+      std::ranges::copy(sibling_leaf->dataPointers + borrow_idx, sibling_leaf->dataPointers + sibling_leaf->numKeys,
+                        leaf->dataPointers);
+      leaf->numKeys += moved;
+      sibling_leaf->numKeys -= moved;
 
       // Update separator in parent to node's new first key
       internal_parent->keys[separator_index] = leaf->keys[0];
     } else {
-      auto* internal = static_cast<BTreeInternalNode<KeyType, N>*>(node);
-      auto* sibling_internal = static_cast<BTreeInternalNode<KeyType, N>*>(sibling);
+      auto* internal = static_cast<InternalNode*>(node);
+      auto* sibling_internal = static_cast<InternalNode*>(sibling);
 
       std::size_t borrow_key_idx = sibling_internal->numKeys - 1;
 
@@ -438,25 +932,26 @@ void BTree<KeyType, N>::redistribute(BTreeNode<KeyType, N>* node, BTreeNode<KeyT
   } else {
     // Borrow from right sibling
     if (node->isLeaf()) {
-      auto* leaf = static_cast<BTreeLeafNode<KeyType, N>*>(node);
-      auto* sibling_leaf = static_cast<BTreeLeafNode<KeyType, N>*>(sibling);
+      auto* leaf = static_cast<LeafNode*>(node);
+      auto* sibling_leaf = static_cast<LeafNode*>(sibling);
 
-      // Move first entry from sibling to last position in node
-      leaf->keys[leaf->numKeys] = sibling_leaf->keys[0];
-      leaf->dataPointers[leaf->numKeys] = sibling_leaf->dataPointers[0];
-      leaf->numKeys++;
+      // Move the first entries from sibling to the end of node
+      std::ranges::copy(sibling_leaf->keys, sibling_leaf->keys + moved, leaf->keys + leaf->numKeys);
+      std::ranges::copy(sibling_leaf->dataPointers, sibling_leaf->dataPointers + moved,
+                        leaf->dataPointers + leaf->numKeys);
+      leaf->numKeys += moved;
 
       // Shift sibling's entries left
-      std::ranges::copy(sibling_leaf->keys + 1, sibling_leaf->keys + sibling_leaf->numKeys, sibling_leaf->keys);
-      std::ranges::copy(sibling_leaf->dataPointers + 1, sibling_leaf->dataPointers + sibling_leaf->numKeys,
+      std::ranges::copy(sibling_leaf->keys + moved, sibling_leaf->keys + sibling_leaf->numKeys, sibling_leaf->keys);
+      std::ranges::copy(sibling_leaf->dataPointers + moved, sibling_leaf->dataPointers + sibling_leaf->numKeys,
                         sibling_leaf->dataPointers);
-      sibling_leaf->numKeys--;
+      sibling_leaf->numKeys -= moved;
 
       // Update separator in parent to sibling's new first key
       internal_parent->keys[separator_index] = sibling_leaf->keys[0];
     } else {
-      auto* internal = static_cast<BTreeInternalNode<KeyType, N>*>(node);
-      auto* sibling_internal = static_cast<BTreeInternalNode<KeyType, N>*>(sibling);
+      auto* internal = static_cast<InternalNode*>(node);
+      auto* sibling_internal = static_cast<InternalNode*>(sibling);
 
       // Bring down separator from parent as last key in node
       internal->keys[internal->numKeys] = separator;
@@ -474,11 +969,18 @@ void BTree<KeyType, N>::redistribute(BTreeNode<KeyType, N>* node, BTreeNode<KeyT
       sibling_internal->numKeys--;
     }
   }
+
+  internal_parent->keys_changed();
+  if (!node->isLeaf()) {
+    static_cast<InternalNode*>(node)->keys_changed();
+    static_cast<InternalNode*>(sibling)->keys_changed();
+  }
 }
 
 // Handle underflow by redistributing or merging
-template <typename KeyType, std::size_t N>
-void BTree<KeyType, N>::handle_underflow(BTreeNode<KeyType, N>* node, std::vector<BTreeNode<KeyType, N>*>& path) {
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::handle_underflow(BTreeNode<KeyType, N>* node, NodePath<KeyType, N>& path) {
   BTreeNode<KeyType, N>* parent = path.back();
   path.pop_back();
 
@@ -495,7 +997,304 @@ void BTree<KeyType, N>::handle_underflow(BTreeNode<KeyType, N>* node, std::vecto
   }
 }
 
-template <typename KeyType, std::size_t N> void BTree<KeyType, N>::print() const {
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+bool BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::is_underflow(const BTreeNode<KeyType, N>* node) const {
+  return node->isLeaf() ? node->numKeys < min_leaf_keys : static_cast<const InternalNode*>(node)->isUnderflow();
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::set_leaf_merge_threshold(double fill) {
+  // Rounded up, so that 0.5 comes out as LeafN / 2 like isUnderflow, and anything at or below 0 as 1, i.e. empty.
+  auto keys = static_cast<std::size_t>(std::ceil(std::max(fill, 0.0) * static_cast<double>(LeafN - 1)));
+  min_leaf_keys = std::clamp<std::size_t>(keys, 1, LeafN / 2);
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+bool BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::compact(CompactionCursor<KeyType>& cursor,
+                                                                             std::size_t max_leaves,
+                                                                             const CompactionOptions& options) {
+  const std::size_t fill = packed_count(options.fill_factor, LeafN - 1, LeafN / 2);
+  std::vector<std::pair<KeyType, PageData*>> entries;
+  bool first_run = true;
+
+  while (!cursor.done && max_leaves > 0) {
+    // A root leaf has nothing to be packed with.
+    if (root == nullptr || root->isLeaf()) {
+      cursor.done = true;
+      break;
+    }
+
+    NodePath<KeyType, N> path;
+    LeafNode* leaf;
+    if (cursor.started) {
+      leaf = find_leaf_for_key(cursor.next_key, &path);
+    } else {
+      BTreeNode<KeyType, N>* cur = root;
+      while (!cur->isLeaf()) {
+        path.push_back(cur);
+        cur = static_cast<InternalNode*>(cur)->children[0];
+      }
+      leaf = static_cast<LeafNode*>(cur);
+      cursor.started = true;
+    }
+
+    // This run: from leaf to the end of its parent. Cut short, a run can be too few leaves to pack into fewer, so one
+    // that doesn't fit what's left of the budget waits for the next slice. The first run of a slice is done whole even
+    // if it's longer than max_leaves, or a small budget would never get anywhere.
+    auto* parent = static_cast<InternalNode*>(path.back());
+    std::size_t first = 0;
+    while (parent->children[first] != leaf) {
+      first++;
+    }
+    std::size_t count = parent->numKeys + 1 - first;
+    if (count > max_leaves && !first_run) {
+      break;
+    }
+    first_run = false;
+    max_leaves -= std::min(count, max_leaves);
+    cursor.leaves_visited += count;
+
+    LeafNode* group[N];
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+      group[i] = static_cast<LeafNode*>(parent->children[first + i]);
+      total += group[i]->numKeys;
+    }
+    LeafNode* after = group[count - 1]->right_sibling;
+    if (after == nullptr) {
+      cursor.done = true;
+    } else {
+      cursor.next_key = after->keys[0];
+    }
+
+    std::size_t packed = std::max<std::size_t>((total + fill - 1) / fill, 1);
+    if (packed >= count && !options.relocate) {
+      continue;
+    }
+    packed = std::min(packed, count);
+
+    entries.clear();
+    for (std::size_t i = 0; i < count; ++i) {
+      for (std::size_t j = 0; j < group[i]->numKeys; ++j) {
+        entries.emplace_back(std::move(group[i]->keys[j]), group[i]->dataPointers[j]);
+      }
+    }
+
+    // Spread the entries evenly over the packed leaves, which are the first ones of the run, or new ones when
+    // relocating. Either way the rest of the run gets freed.
+    LeafNode* targets[N] = {};
+    for (std::size_t i = 0; i < packed; ++i) {
+      targets[i] = options.relocate ? new_sequential_leaf() : group[i];
+    }
+    if (options.relocate) {
+      LeafNode* before = first > 0 ? static_cast<LeafNode*>(parent->children[first - 1]) : leaf_before(path);
+      if (before != nullptr) {
+        before->right_sibling = targets[0];
+      }
+    }
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < packed; ++i) {
+      std::size_t size = total / packed + (i < total % packed ? 1 : 0);
+      for (std::size_t j = 0; j < size; ++j, ++next) {
+        targets[i]->keys[j] = std::move(entries[next].first);
+        targets[i]->dataPointers[j] = entries[next].second;
+      }
+      targets[i]->numKeys = size;
+      targets[i]->right_sibling = i + 1 < packed ? targets[i + 1] : after;
+    }
+    for (std::size_t i = options.relocate ? 0 : packed; i < count; ++i) {
+      free_node(group[i]);
+    }
+    cursor.leaves_freed += count - packed;
+    if (options.relocate && after == nullptr) {
+      rightmost_leaf = targets[packed - 1];
+    }
+
+    // The run's children and the separators between them in parent, the ones around it still hold.
+    std::size_t removed = count - packed;
+    std::ranges::copy(parent->keys + first + count - 1, parent->keys + parent->numKeys, parent->keys + first + packed - 1);
+    std::ranges::copy(parent->children + first + count, parent->children + parent->numKeys + 1,
+                      parent->children + first + packed);
+    for (std::size_t i = 0; i < packed; ++i) {
+      parent->children[first + i] = targets[i];
+      if (i > 0) {
+        parent->keys[first + i - 1] = targets[i]->keys[0];
+      }
+    }
+    parent->numKeys -= removed;
+    parent->keys_changed();
+
+    // parent can be down to a single child, further than a delete ever takes a node below its minimum, so it's fixed the
+    // way delete_range does it, by whichever ancestor it's still short for.
+    BTreeNode<KeyType, N>* node = parent;
+    path.pop_back();
+    while (!path.empty() && is_underflow(node)) {
+      node = path.back();
+      path.pop_back();
+      rebalance_children(static_cast<InternalNode*>(node));
+    }
+    while (!root->isLeaf() && root->numKeys == 0) {
+      BTreeNode<KeyType, N>* old_root = root;
+      root = static_cast<InternalNode*>(root)->children[0];
+      op_stats.root_changed();
+      free_node(old_root);
+    }
+  }
+  return cursor.done;
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+typename BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::LeafNode*
+BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::leaf_before(const NodePath<KeyType, N>& path) {
+  // Up until some ancestor isn't its parent's first child, then down the last children of the one before it.
+  for (std::size_t level = path.size() - 1; level > 0; --level) {
+    auto* parent = static_cast<InternalNode*>(path[level - 1]);
+    std::size_t idx = 0;
+    while (parent->children[idx] != path[level]) {
+      idx++;
+    }
+    if (idx > 0) {
+      BTreeNode<KeyType, N>* cur = parent->children[idx - 1];
+      while (!cur->isLeaf()) {
+        auto* internal = static_cast<InternalNode*>(cur);
+        cur = internal->children[internal->numKeys];
+      }
+      return static_cast<LeafNode*>(cur);
+    }
+  }
+  return nullptr;
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+std::size_t BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::delete_range(const KeyType& lower_bound,
+                                                                                  const KeyType& upper_bound) {
+  if (root == nullptr || !(lower_bound < upper_bound)) {
+    return 0;
+  }
+
+  // Every leaf between the two end leaves goes away, so they end up next to each other. Doing this first means the
+  // merges below see a right_sibling chain that's already correct.
+  LeafNode* first_leaf = find_leaf_for_key(lower_bound);
+  LeafNode* last_leaf = find_leaf_for_key(upper_bound);
+  if (first_leaf != last_leaf) {
+    first_leaf->right_sibling = last_leaf;
+  }
+
+  std::size_t removed = delete_range_in(root, &lower_bound, &upper_bound);
+
+  // The root is allowed to underflow, but not to be an internal node with a single child or an empty leaf.
+  while (!root->isLeaf() && root->numKeys == 0) {
+    BTreeNode<KeyType, N>* old_root = root;
+    root = static_cast<InternalNode*>(root)->children[0];
+    op_stats.root_changed();
+    free_node(old_root);
+  }
+  if (root->numKeys == 0) {
+    free_node(root);
+    root = nullptr;
+    op_stats.root_changed();
+  }
+  return removed;
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+std::size_t BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::delete_range_in(BTreeNode<KeyType, N>* node,
+                                                                                     const KeyType* lower_bound,
+                                                                                     const KeyType* upper_bound) {
+  if (node->isLeaf()) {
+    auto* leaf = static_cast<LeafNode*>(node);
+    std::size_t start = lower_bound ? node_lower_bound<LeafN - 1>(leaf->keys, leaf->numKeys, *lower_bound) : 0;
+    std::size_t end =
+        upper_bound ? node_lower_bound<LeafN - 1>(leaf->keys, leaf->numKeys, *upper_bound) : std::size_t{leaf->numKeys};
+    std::ranges::move(leaf->keys + end, leaf->keys + leaf->numKeys, leaf->keys + start);
+    std::ranges::copy(leaf->dataPointers + end, leaf->dataPointers + leaf->numKeys, leaf->dataPointers + start);
+    leaf->numKeys -= end - start;
+    return end - start;
+  }
+
+  auto* internal = static_cast<InternalNode*>(node);
+  std::size_t first = lower_bound ? internal->child_index(*lower_bound) : 0;
+  std::size_t last = upper_bound ? internal->child_index(*upper_bound) : internal->numKeys;
+  std::size_t removed = 0;
+  if (first == last) {
+    removed = delete_range_in(internal->children[first], lower_bound, upper_bound);
+  } else {
+    // Children strictly between the ones holding the bounds, or up to the end on a side without a bound, are entirely
+    // in the range. They go with the key in front of each of them (behind, for the first child).
+    std::size_t covered_begin = lower_bound ? first + 1 : 0;
+    std::size_t covered_end = upper_bound ? last : internal->numKeys + 1;
+    if (covered_begin < covered_end) {
+      for (std::size_t i = covered_begin; i < covered_end; ++i) {
+        removed += delete_tree(internal->children[i]);
+      }
+      std::size_t covered = covered_end - covered_begin;
+      std::size_t keys_begin = covered_begin > 0 ? covered_begin - 1 : 0;
+      std::ranges::move(internal->keys + keys_begin + covered, internal->keys + internal->numKeys,
+                        internal->keys + keys_begin);
+      std::ranges::copy(internal->children + covered_end, internal->children + internal->numKeys + 1,
+                        internal->children + covered_begin);
+      internal->numKeys -= covered;
+      internal->keys_changed();
+    }
+    if (lower_bound) {
+      removed += delete_range_in(internal->children[first], lower_bound, nullptr);
+    }
+    if (upper_bound) {
+      removed += delete_range_in(internal->children[covered_begin], nullptr, upper_bound);
+    }
+  }
+
+  rebalance_children(internal);
+  return removed;
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::rebalance_children(InternalNode* parent) {
+  for (std::size_t i = 0; i <= parent->numKeys; ++i) {
+    if (!is_underflow(parent->children[i])) {
+      continue;
+    }
+
+    // Two underflowing nodes always fit into one (also under leaf_merge_limit for leaves), and if the pair
+    // doesn't fit the sibling has enough to lend until node is back to its minimum. Fixing the children of the result
+    // can merge some of them and leave it short again, so this goes around until it holds, or parent is down to a
+    // single child and its own parent has to step in.
+    do {
+      while (parent->numKeys > 0 && is_underflow(parent->children[i])) {
+        std::size_t separator_index = i > 0 ? i - 1 : 0;
+        bool sibling_is_left = i > 0;
+        BTreeNode<KeyType, N>* node = parent->children[i];
+        BTreeNode<KeyType, N>* sibling = parent->children[sibling_is_left ? i - 1 : i + 1];
+        if (can_merge(node, sibling)) {
+          KeyType separator = parent->keys[separator_index];
+          merge_into_left(parent->children[separator_index], parent->children[separator_index + 1], separator,
+                          parent);
+          i = separator_index;
+        } else {
+          while (is_underflow(node)) {
+            KeyType separator = parent->keys[separator_index];
+            redistribute(node, sibling, separator, separator_index, sibling_is_left, parent);
+          }
+        }
+      }
+
+      if (!parent->children[i]->isLeaf()) {
+        rebalance_children(static_cast<InternalNode*>(parent->children[i]));
+      }
+    } while (parent->numKeys > 0 && is_underflow(parent->children[i]));
+  }
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::print() const {
   if (root == nullptr) {
     std::cout << "Empty Tree" << std::endl;
     return;
@@ -515,14 +1314,14 @@ template <typename KeyType, std::size_t N> void BTree<KeyType, N>::print() const
 
       std::cout << "[";
       if (node->isLeaf()) {
-        auto* leaf = static_cast<BTreeLeafNode<KeyType, N>*>(node);
+        auto* leaf = static_cast<LeafNode*>(node);
         for (size_t j = 0; j < leaf->numKeys; ++j) {
-          std::cout << leaf->keys[j] << (j < leaf->numKeys - 1 ? " " : "");
+          std::cout << leaf->keys[j] << (j + 1 < leaf->numKeys ? " " : "");
         }
       } else {
-        auto* internal = static_cast<BTreeInternalNode<KeyType, N>*>(node);
+        auto* internal = static_cast<InternalNode*>(node);
         for (size_t j = 0; j < internal->numKeys; ++j) {
-          std::cout << internal->keys[j] << (j < internal->numKeys - 1 ? " " : "");
+          std::cout << internal->keys[j] << (j + 1 < internal->numKeys ? " " : "");
         }
         for (size_t j = 0; j <= internal->numKeys; ++j) {
           if (internal->children[j]) q.push(internal->children[j]);
@@ -535,40 +1334,473 @@ template <typename KeyType, std::size_t N> void BTree<KeyType, N>::print() const
   }
 }
 
-// Find keys in range: [lower_bound, upper_bound)
-template <typename KeyType, std::size_t N>
-std::vector<KeyType> BTree<KeyType, N>::find_keys_in_range(const KeyType& lower_bound,
-                                                           const KeyType& upper_bound) const {
-  std::vector<KeyType> result;
-  std::vector<BTreeNode<KeyType, N>*> path;
-  // Find the leaf_node that is supposed to house the lower_bound.
-  BTreeLeafNode<KeyType, N>* leaf_node = find_leaf_for_key(lower_bound, path);
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+std::size_t BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::packed_count(double fill_factor, std::size_t capacity, std::size_t minimum) {
+  auto count = static_cast<std::size_t>(fill_factor * static_cast<double>(capacity));
+  return std::clamp(count, std::max<std::size_t>(minimum, 1), capacity);
+}
 
-  if (leaf_node == nullptr) {
-    return result;
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+template <std::ranges::input_range R>
+BulkLoadResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::bulk_load(R&& entries, double fill_factor) {
+  return bulk_load(std::ranges::begin(entries), std::ranges::end(entries), fill_factor);
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+template <std::input_iterator It, std::sentinel_for<It> S>
+BulkLoadResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::bulk_load(It first, S last, double fill_factor) {
+  if (root != nullptr) {
+    return BulkLoadResult::NotEmpty;
   }
 
-  auto it = std::ranges::lower_bound(leaf_node->keys, leaf_node->keys + leaf_node->numKeys, lower_bound);
-  std::size_t idx = std::distance(leaf_node->keys, it);
+  // A leaf is considered underflowing below LeafN / 2 keys, so we never pack fewer than that.
+  const std::size_t leaf_fill = packed_count(fill_factor, LeafN - 1, LeafN / 2);
 
-  while (leaf_node != nullptr) {
-    // If we reached the end of the current node, move to the next sibling
-    if (idx >= leaf_node->numKeys) {
-      leaf_node = leaf_node->right_sibling;
-      idx = 0;
-      continue;
+  // Smallest key in each node's subtree along with the node, for the level we're currently building.
+  std::vector<std::pair<KeyType, BTreeNode<KeyType, N>*>> level;
+  LeafNode* leaf = nullptr;
+
+  for (; first != last; ++first) {
+    const auto& [key, page] = *first;
+
+    if (leaf != nullptr && !(leaf->keys[leaf->numKeys - 1] < key)) {
+      BulkLoadResult error =
+          leaf->keys[leaf->numKeys - 1] == key ? BulkLoadResult::Duplicate : BulkLoadResult::Unsorted;
+      for (auto& entry : level) {
+        free_node(entry.second);
+      }
+      return error;
     }
 
-    // If the current key is out of range, we are done
-    if (leaf_node->keys[idx] >= upper_bound) {
-      break;
+    if (leaf == nullptr || leaf->numKeys == leaf_fill) {
+      auto* next = new_leaf();
+      if (leaf != nullptr) {
+        leaf->right_sibling = next;
+      }
+      leaf = next;
+      level.emplace_back(key, leaf);
+    }
+
+    leaf->keys[leaf->numKeys] = key;
+    leaf->dataPointers[leaf->numKeys] = page;
+    leaf->numKeys++;
+  }
+
+  if (level.empty()) {
+    return BulkLoadResult::Success;
+  }
+
+  // The last leaf gets whatever was left over, which can be below the minimum. Either fold it into its left neighbour or
+  // split the two evenly, same as a merge/redistribute would have done.
+  if (level.size() > 1 && leaf->isUnderflow()) {
+    auto* left = static_cast<LeafNode*>(level[level.size() - 2].second);
+    std::size_t total = left->numKeys + leaf->numKeys;
+
+    if (total <= LeafN - 1) {
+      std::ranges::copy(leaf->keys, leaf->keys + leaf->numKeys, left->keys + left->numKeys);
+      std::ranges::copy(leaf->dataPointers, leaf->dataPointers + leaf->numKeys, left->dataPointers + left->numKeys);
+      left->numKeys = total;
+      left->right_sibling = nullptr;
+      free_node(leaf);
+      level.pop_back();
+    } else {
+      std::size_t moved = total / 2 - leaf->numKeys;
+      std::ranges::move_backward(leaf->keys, leaf->keys + leaf->numKeys, leaf->keys + leaf->numKeys + moved);
+      std::ranges::move_backward(leaf->dataPointers, leaf->dataPointers + leaf->numKeys,
+                                 leaf->dataPointers + leaf->numKeys + moved);
+      std::ranges::copy(left->keys + left->numKeys - moved, left->keys + left->numKeys, leaf->keys);
+      std::ranges::copy(left->dataPointers + left->numKeys - moved, left->dataPointers + left->numKeys,
+                        leaf->dataPointers);
+      left->numKeys -= moved;
+      leaf->numKeys += moved;
+      level.back().first = leaf->keys[0];
+    }
+  }
+
+  rightmost_leaf = static_cast<LeafNode*>(level.back().second);
+  build_internal_levels(level, fill_factor);
+  root = level.front().second;
+  op_stats.root_changed();
+  return BulkLoadResult::Success;
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+BulkLoadResult BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::parallel_bulk_load(
+    std::span<std::pair<KeyType, PageData*>> entries, unsigned threads, double fill_factor) {
+  if (root != nullptr) {
+    return BulkLoadResult::NotEmpty;
+  }
+
+  // Strictly increasing already? Every chunk checks its own entries against the one before each.
+  auto check = [&](bool& unsorted, bool& duplicate) {
+    std::atomic<bool> found_unsorted{false};
+    std::atomic<bool> found_duplicate{false};
+    for_each_chunk(entries.size(), threads, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = std::max<std::size_t>(begin, 1); i < end; ++i) {
+        if (entries[i].first < entries[i - 1].first) {
+          found_unsorted = true;
+          break;
+        } else if (entries[i].first == entries[i - 1].first) {
+          found_duplicate = true;
+        }
+      }
+    });
+    unsorted = found_unsorted;
+    duplicate = found_duplicate;
+  };
+  bool unsorted = false;
+  bool duplicate = false;
+  check(unsorted, duplicate);
+  if (unsorted) {
+    parallel_sort(entries, threads);
+    check(unsorted, duplicate);
+  }
+  if (duplicate) {
+    return BulkLoadResult::Duplicate;
+  }
+  if (entries.empty()) {
+    return BulkLoadResult::Success;
+  }
+
+  const std::size_t leaf_fill = packed_count(fill_factor, LeafN - 1, LeafN / 2);
+  PackedLayout layout = packed_layout(entries.size(), leaf_fill, LeafN / 2, LeafN - 1);
+
+  std::vector<std::pair<KeyType, BTreeNode<KeyType, N>*>> level(layout.nodes);
+  for (auto& entry : level) {
+    entry.second = new_leaf();
+  }
+  for_each_chunk(layout.nodes, threads, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      auto* leaf = static_cast<LeafNode*>(level[i].second);
+      std::size_t start = layout.start(i);
+      for (std::size_t j = 0; j < layout.size(i); ++j) {
+        leaf->keys[j] = entries[start + j].first;
+        leaf->dataPointers[j] = entries[start + j].second;
+      }
+      leaf->numKeys = layout.size(i);
+      leaf->right_sibling = i + 1 < layout.nodes ? static_cast<LeafNode*>(level[i + 1].second) : nullptr;
+      level[i].first = leaf->keys[0];
+    }
+  });
+
+  rightmost_leaf = static_cast<LeafNode*>(level.back().second);
+  build_internal_levels(level, fill_factor, threads);
+  root = level.front().second;
+  op_stats.root_changed();
+  return BulkLoadResult::Success;
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+template <typename T, typename Fold, typename Combine>
+T BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::parallel_aggregate(const KeyType& lower_bound,
+                                                                                     const KeyType& upper_bound,
+                                                                                     unsigned threads, T init,
+                                                                                     Fold&& fold,
+                                                                                     Combine&& combine) const {
+  if (root == nullptr || !(lower_bound < upper_bound)) {
+    return init;
+  }
+
+  // Level by level down from the root, every separator inside the range is a place to cut it, until there are about 4
+  // pieces per thread or the next level is the leaves.
+  const std::size_t wanted = 4 * static_cast<std::size_t>(std::max(threads, 1u));
+  std::vector<KeyType> cuts;
+  std::vector<const BTreeNode<KeyType, N>*> frontier{root};
+  while (cuts.size() + 1 < wanted && !frontier.empty() && !frontier.front()->isLeaf()) {
+    std::vector<const BTreeNode<KeyType, N>*> next;
+    for (const auto* node : frontier) {
+      auto* internal = static_cast<const InternalNode*>(node);
+      for (std::size_t i = 0; i <= internal->numKeys; ++i) {
+        // Child i holds [keys[i - 1], keys[i]).
+        if ((i > 0 && !(internal->keys[i - 1] < upper_bound)) ||
+            (i < internal->numKeys && !(lower_bound < internal->keys[i]))) {
+          continue;
+        }
+        if (i > 0 && lower_bound < internal->keys[i - 1]) {
+          cuts.push_back(internal->keys[i - 1]);
+        }
+        next.push_back(internal->children[i]);
+      }
+    }
+    frontier = std::move(next);
+  }
+  std::ranges::sort(cuts);
+
+  std::size_t pieces = cuts.size() + 1;
+  std::vector<T> results(pieces, init);
+  std::atomic<std::size_t> next_piece{0};
+  for_each_chunk(std::min<std::size_t>(threads, pieces), threads, [&](std::size_t, std::size_t) {
+    for (std::size_t piece; (piece = next_piece.fetch_add(1, std::memory_order_relaxed)) < pieces;) {
+      const KeyType& lower = piece == 0 ? lower_bound : cuts[piece - 1];
+      const KeyType& upper = piece == pieces - 1 ? upper_bound : cuts[piece];
+      T acc = init;
+      for (auto entry : range(lower, upper)) {
+        acc = fold(std::move(acc), entry.key, entry.data);
+      }
+      results[piece] = std::move(acc);
+    }
+  });
+
+  T total = std::move(results[0]);
+  for (std::size_t piece = 1; piece < pieces; ++piece) {
+    total = combine(std::move(total), std::move(results[piece]));
+  }
+  return total;
+}
+
+// Stacks internal nodes on top of `level` until a single node, the root, is left.
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::build_internal_levels(
+    std::vector<std::pair<KeyType, BTreeNode<KeyType, N>*>>& level, double fill_factor, unsigned threads) {
+  // Internal nodes underflow below ceil(N/2) pointers.
+  const std::size_t min_children = (N + 1) / 2;
+  const std::size_t fanout = packed_count(fill_factor, N, min_children);
+
+  while (level.size() > 1) {
+    // Work out how many children each parent gets up front, since unlike the leaves we know the count here.
+    PackedLayout layout = packed_layout(level.size(), fanout, min_children, N);
+
+    std::vector<std::pair<KeyType, BTreeNode<KeyType, N>*>> parents(layout.nodes);
+    for (auto& parent : parents) {
+      parent.second = new_internal();
+    }
+
+    for_each_chunk(layout.nodes, threads, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        std::size_t start = layout.start(i);
+        auto* node = static_cast<InternalNode*>(parents[i].second);
+        node->children[0] = level[start].second;
+        for (std::size_t j = 1; j < layout.size(i); ++j) {
+          node->keys[j - 1] = level[start + j].first;
+          node->children[j] = level[start + j].second;
+        }
+        node->numKeys = layout.size(i) - 1;
+        node->keys_changed();
+        parents[i].first = level[start].first;
+      }
+    });
+
+    level = std::move(parents);
+  }
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+typename BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::PackedLayout
+BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::packed_layout(std::size_t count, std::size_t per,
+                                                                              std::size_t minimum,
+                                                                              std::size_t capacity) {
+  PackedLayout layout{count, (count + per - 1) / per, per, per, 0};
+  layout.last = count - (layout.nodes - 1) * per;
+  if (layout.nodes > 1 && layout.last < minimum) {
+    std::size_t total = per + layout.last;
+    if (total <= capacity) {
+      layout.nodes--;
+      layout.last = total;
+    } else {
+      layout.last = total / 2;
+      layout.second_last = total - layout.last;
     }
+  }
+  return layout;
+}
 
-    result.push_back(leaf_node->keys[idx]);
-    idx++;
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+template <typename Fn>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::for_each_chunk(std::size_t count, unsigned threads,
+                                                                                    Fn&& fn) {
+  std::size_t chunks = std::clamp<std::size_t>(threads, 1, std::max<std::size_t>(count, 1));
+  std::vector<std::thread> workers;
+  workers.reserve(chunks - 1);
+  for (std::size_t chunk = 1; chunk < chunks; ++chunk) {
+    workers.emplace_back([&fn, count, chunks, chunk] { fn(count * chunk / chunks, count * (chunk + 1) / chunks); });
+  }
+  fn(0, count / chunks);
+  for (auto& worker : workers) {
+    worker.join();
   }
+}
 
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+void BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::parallel_sort(
+    std::span<std::pair<KeyType, PageData*>> entries, unsigned threads) {
+  auto by_key = [](const auto& a, const auto& b) { return a.first < b.first; };
+  std::size_t chunks = std::clamp<std::size_t>(threads, 1, std::max<std::size_t>(entries.size(), 1));
+  auto bound = [&](std::size_t chunk) { return entries.begin() + entries.size() * std::min(chunk, chunks) / chunks; };
+
+  for_each_chunk(chunks, threads, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t chunk = begin; chunk < end; ++chunk) {
+      std::sort(bound(chunk), bound(chunk + 1), by_key);
+    }
+  });
+  // Then pairs of sorted runs get merged, each pass halving the number of runs and the threads that have work.
+  for (std::size_t width = 1; width < chunks; width *= 2) {
+    std::size_t merges = (chunks + 2 * width - 1) / (2 * width);
+    for_each_chunk(merges, threads, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t merge = begin; merge < end; ++merge) {
+        std::size_t left = merge * 2 * width;
+        std::inplace_merge(bound(left), bound(left + width), bound(left + 2 * width), by_key);
+      }
+    });
+  }
+}
+
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+bool BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::validate() const {
+  if (root == nullptr) {
+    return true;
+  }
+
+  std::size_t leaf_depth = 0;
+  const LeafNode* prev_leaf = nullptr;
+  if (!validate_node(root, nullptr, nullptr, 0, leaf_depth, prev_leaf)) {
+    return false;
+  }
+
+  // The rightmost leaf has to terminate the sibling chain, and be the one appends go to if there's one cached.
+  return prev_leaf->right_sibling == nullptr && (rightmost_leaf == nullptr || rightmost_leaf == prev_leaf);
+}
+
+// Checks that every key in node lies in [lower, upper), recursing into children with the narrowed bounds. Leaves are
+// visited left to right, so prev_leaf must always link to the next leaf we find.
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+bool BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::validate_node(const BTreeNode<KeyType, N>* node, const KeyType* lower, const KeyType* upper,
+                                      std::size_t depth, std::size_t& leaf_depth,
+                                      const LeafNode*& prev_leaf) const {
+  if (node == nullptr || node->numKeys > (node->isLeaf() ? LeafN - 1 : N - 1)) {
+    return false;
+  }
+  if (node != root && node->numKeys == 0 && node->isLeaf()) {
+    return false;
+  }
+
+  const KeyType* keys = node->isLeaf() ? static_cast<const LeafNode*>(node)->keys
+                                       : static_cast<const InternalNode*>(node)->keys;
+  for (std::size_t i = 0; i < node->numKeys; ++i) {
+    if (i > 0 && !(keys[i - 1] < keys[i])) return false;
+    if (lower != nullptr && keys[i] < *lower) return false;
+    if (upper != nullptr && !(keys[i] < *upper)) return false;
+  }
+
+  if (node->isLeaf()) {
+    if (leaf_depth == 0) {
+      leaf_depth = depth + 1;
+    } else if (leaf_depth != depth + 1) {
+      return false;
+    }
+
+    auto* leaf = static_cast<const LeafNode*>(node);
+    if (prev_leaf != nullptr && prev_leaf->right_sibling != leaf) {
+      return false;
+    }
+    prev_leaf = leaf;
+    return true;
+  }
+
+  auto* internal = static_cast<const InternalNode*>(node);
+  if (internal->numKeys == 0) {
+    return false;
+  }
+  for (std::size_t i = 0; i <= internal->numKeys; ++i) {
+    const KeyType* child_lower = i == 0 ? lower : &internal->keys[i - 1];
+    const KeyType* child_upper = i == internal->numKeys ? upper : &internal->keys[i];
+    if (!validate_node(internal->children[i], child_lower, child_upper, depth + 1, leaf_depth, prev_leaf)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Find keys in range: [lower_bound, upper_bound)
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+std::vector<KeyType>
+BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::find_keys_in_range(const KeyType& lower_bound,
+                                                                            const KeyType& upper_bound) const {
+  [[maybe_unused]] auto timer = op_stats.time(BTreeOp::Range);
+  std::vector<KeyType> result;
+  for (const auto& [key, data] : range(lower_bound, upper_bound)) {
+    result.push_back(key);
+  }
   return result;
 }
 
+template <typename KeyType, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+std::ranges::subrange<typename BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::iterator>
+BTree<KeyType, N, NodeAllocator, InternalLayout, LeafN, Stats>::range(const KeyType& lower, const KeyType& upper,
+                                                        RangeBound lower_bound_kind,
+                                                        RangeBound upper_bound_kind) const {
+  iterator first = lower_bound_kind == RangeBound::Inclusive ? lower_bound(lower) : upper_bound(lower);
+  // An empty range (e.g. upper < lower) could otherwise end up with last before first.
+  if (first == end() || upper < (*first).key || (upper_bound_kind == RangeBound::Exclusive && !((*first).key < upper))) {
+    return {first, first};
+  }
+  iterator last = upper_bound_kind == RangeBound::Exclusive ? lower_bound(upper) : upper_bound(upper);
+  return {first, last};
+}
+
+// Node sizes in bytes rather than pointer counts: the largest N and LeafN whose nodes still fit in NodeBytes, e.g. a
+// 4KB page or a handful of cache lines. Leaves (keys and PageData*, one sibling link) and internal nodes (keys and one
+// more child, plus whatever the layout's search index takes) come out at different counts, worked out from the node
+// types themselves rather than a formula so padding and the index are accounted for.
+template <typename KeyType, std::size_t NodeBytes, typename InternalLayout = SortedInternalLayout> class NodeFanout {
+  // Binary searches for the largest M in [Lo, Hi] that fits, node size only ever grows with M.
+  template <std::size_t Lo, std::size_t Hi> static constexpr std::size_t largest_internal() {
+    if constexpr (Lo == Hi) {
+      return Lo;
+    } else if constexpr (constexpr std::size_t mid = (Lo + Hi + 1) / 2;
+                         sizeof(BTreeInternalNode<KeyType, mid, InternalLayout>) <= NodeBytes) {
+      return largest_internal<mid, Hi>();
+    } else {
+      return largest_internal<Lo, mid - 1>();
+    }
+  }
+  template <std::size_t N, std::size_t Lo, std::size_t Hi> static constexpr std::size_t largest_leaf() {
+    if constexpr (Lo == Hi) {
+      return Lo;
+    } else if constexpr (constexpr std::size_t mid = (Lo + Hi + 1) / 2;
+                         sizeof(BTreeLeafNode<KeyType, N, mid>) <= NodeBytes) {
+      return largest_leaf<N, mid, Hi>();
+    } else {
+      return largest_leaf<N, Lo, mid - 1>();
+    }
+  }
+  static constexpr std::size_t UPPER = NodeBytes / sizeof(KeyType) + 1;
+
+public:
+  // Children per internal node.
+  static constexpr std::size_t INTERNAL = largest_internal<3, UPPER>();
+
+private:
+  // Leaves share the internal nodes' header, whose key count type (picked by INTERNAL) can be narrower than what the
+  // leaves would need on their own, e.g. with an Eytzinger index that takes up a third of an internal node.
+  static constexpr std::size_t LEAF_UPPER =
+      std::min<std::size_t>(UPPER, std::numeric_limits<NodeCountType<INTERNAL>>::max() + 1);
+
+public:
+  // Entries per leaf, plus one.
+  static constexpr std::size_t LEAF = largest_leaf<INTERNAL, 3, LEAF_UPPER>();
+
+  static_assert(sizeof(BTreeInternalNode<KeyType, INTERNAL, InternalLayout>) <= NodeBytes &&
+                    sizeof(BTreeLeafNode<KeyType, INTERNAL, LEAF>) <= NodeBytes,
+                "NodeBytes is too small for nodes with 2 keys");
+};
+
+template <typename KeyType, std::size_t NodeBytes = PageData::PAGE_SIZE,
+          template <typename> class NodeAllocator = HeapNodeAllocator, typename InternalLayout = SortedInternalLayout,
+          typename Stats = NoBTreeStats>
+using SizedBTree = BTree<KeyType, NodeFanout<KeyType, NodeBytes, InternalLayout>::INTERNAL, NodeAllocator,
+                         InternalLayout, NodeFanout<KeyType, NodeBytes, InternalLayout>::LEAF, Stats>;
+
 #endif
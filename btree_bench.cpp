@@ -0,0 +1,1691 @@
+// Throughput benchmarks for the BTree. Build with optimizations, e.g.
+//   g++ -std=c++20 -O2 -DNDEBUG -march=native btree_bench.cpp -o btree_bench
+// (-march=native, or at least -mavx2/-msse4.2, enables the SIMD node search)
+// and run with an optional key count and section name: ./btree_bench 10000000 find
+//
+// The "suite" (insert/find/range/delete over key orders, sizes 1K up to the count, N and key types) and "ycsb"
+// (workloads A-F) sections only run when asked for, and print one JSON object per line from fixed seeds, e.g.
+//   ./btree_bench 10000000 suite > before.jsonl
+// then the same after a change, and compare ops_per_sec/p99_ns line by line.
+#include "btree.h"
+#include "btree_concurrent.h"
+#include "btree_disk.h"
+#include "btree_multimap.h"
+#include "btree_snapshot.h"
+#include "btree_string.h"
+#include "btree_wal.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <ranges>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Fn> double time_seconds(Fn&& fn) {
+  auto start = Clock::now();
+  fn();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(const std::string& name, std::size_t ops, double seconds) {
+  std::cout << std::left << std::setw(48) << name << std::right << std::setw(12) << ops << " ops" << std::fixed
+            << std::setprecision(3) << std::setw(10) << seconds << " s" << std::setprecision(0) << std::setw(14)
+            << (seconds > 0 ? ops / seconds : 0) << " ops/s" << std::endl;
+}
+
+// Hardware cache miss counter for the calling thread, through perf_event_open. Not available in most VMs and containers,
+// in which case available() is false and the miss column is left out.
+class CacheMissCounter {
+public:
+  CacheMissCounter() {
+#if defined(__linux__)
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+  }
+  CacheMissCounter(const CacheMissCounter&) = delete;
+  CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+  ~CacheMissCounter() {
+#if defined(__linux__)
+    if (fd >= 0) close(fd);
+#endif
+  }
+
+  bool available() const { return fd >= 0; }
+
+  void start() {
+#if defined(__linux__)
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  std::uint64_t stop() {
+    std::uint64_t count = 0;
+#if defined(__linux__)
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+    }
+#endif
+    return count;
+  }
+
+private:
+  int fd = -1;
+};
+
+// Keeps the optimizer from throwing away lookups whose results we don't otherwise use.
+template <typename T> void do_not_optimize(const T& value) { asm volatile("" : : "r,m"(value) : "memory"); }
+
+template <std::size_t N> void bench_bulk_load(std::size_t count) {
+  std::vector<std::pair<std::uint64_t, PageData*>> entries;
+  entries.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    entries.emplace_back(i, nullptr);
+  }
+
+  std::string order = "<N=" + std::to_string(N) + ">";
+  {
+    BTree<std::uint64_t, N> tree;
+    double seconds = time_seconds([&] {
+      for (const auto& [key, page] : entries) {
+        do_not_optimize(tree.insert(key, page));
+      }
+    });
+    report("insert sorted " + order, count, seconds);
+  }
+  for (double fill : {0.7, 1.0}) {
+    BTree<std::uint64_t, N> tree;
+    double seconds = time_seconds([&] { do_not_optimize(tree.bulk_load(entries, fill)); });
+    report("bulk_load fill=" + std::to_string(fill).substr(0, 3) + " " + order, count, seconds);
+  }
+}
+
+// Random inserts, then alternating insert/delete so merges and splits keep freeing and allocating nodes, then teardown.
+template <std::size_t N, template <typename> class NodeAllocator>
+void bench_node_churn(std::size_t count, const std::string& allocator_name) {
+  std::mt19937_64 rng(7);
+  std::vector<std::uint64_t> keys(count);
+  for (auto& key : keys) {
+    key = rng();
+  }
+
+  std::string suffix = " " + allocator_name + " <N=" + std::to_string(N) + ">";
+  auto* tree = new BTree<std::uint64_t, N, NodeAllocator>();
+
+  double seconds = time_seconds([&] {
+    for (auto key : keys) {
+      do_not_optimize(tree->insert(key, nullptr));
+    }
+  });
+  report("insert random" + suffix, count, seconds);
+
+  seconds = time_seconds([&] {
+    for (std::size_t i = 0; i < count; ++i) {
+      do_not_optimize(tree->delete_key(keys[i]));
+      keys[i] = rng();
+      do_not_optimize(tree->insert(keys[i], nullptr));
+    }
+  });
+  report("delete+insert churn" + suffix, 2 * count, seconds);
+
+  seconds = time_seconds([&] { delete tree; });
+  report("teardown" + suffix, count, seconds);
+}
+
+// Point lookups of keys that are present, in random order, on a bulk loaded tree.
+template <typename KeyType, std::size_t N> void bench_find(std::size_t count, const std::string& key_name) {
+  std::vector<std::pair<KeyType, PageData*>> entries;
+  entries.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    entries.emplace_back(static_cast<KeyType>(i * 2), nullptr);
+  }
+  BTree<KeyType, N> tree;
+  do_not_optimize(tree.bulk_load(entries, 0.7));
+
+  std::mt19937_64 rng(11);
+  std::vector<KeyType> lookups(count);
+  for (auto& key : lookups) {
+    key = entries[rng() % count].first;
+  }
+
+  double seconds = time_seconds([&] {
+    for (const auto& key : lookups) {
+      do_not_optimize(tree.find(key).leaf_node);
+    }
+  });
+  report("find " + key_name + " <N=" + std::to_string(N) + ">", count, seconds);
+}
+
+// Overwriting the PageData* of existing keys, in random order: delete_key + insert against the single descent writes.
+// The tree is bulk loaded half full, so the deletes keep hitting underflow and the inserts that follow split again.
+template <std::size_t N> void bench_updates(std::size_t count) {
+  std::vector<std::pair<std::uint64_t, PageData*>> entries;
+  entries.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    entries.emplace_back(i * 2, nullptr);
+  }
+  std::mt19937_64 rng(18);
+  std::vector<std::uint64_t> keys(count);
+  for (auto& key : keys) {
+    key = entries[rng() % count].first;
+  }
+  auto value_of = [](std::uint64_t key) { return reinterpret_cast<PageData*>(key * 8 + 8); };
+  std::string order = " <N=" + std::to_string(N) + ">";
+
+  {
+    BTree<std::uint64_t, N> tree;
+    do_not_optimize(tree.bulk_load(entries, 0.5));
+    double seconds = time_seconds([&] {
+      for (auto key : keys) {
+        do_not_optimize(tree.delete_key(key));
+        do_not_optimize(tree.insert(key, value_of(key)));
+      }
+    });
+    report("delete + insert" + order, count, seconds);
+  }
+  {
+    BTree<std::uint64_t, N> tree;
+    do_not_optimize(tree.bulk_load(entries, 0.5));
+    double seconds = time_seconds([&] {
+      for (auto key : keys) {
+        do_not_optimize(tree.insert_or_assign(key, value_of(key)));
+      }
+    });
+    report("insert_or_assign" + order, count, seconds);
+  }
+  {
+    BTree<std::uint64_t, N> tree;
+    do_not_optimize(tree.bulk_load(entries, 0.5));
+    double seconds = time_seconds([&] {
+      for (auto key : keys) {
+        do_not_optimize(tree.update(key, [&](PageData*) { return value_of(key); }));
+      }
+    });
+    report("update" + order, count, seconds);
+  }
+}
+
+// Deleting a contiguous 1%, 10% and 50% of a bulk loaded tree, from the middle: delete_key once per key against one
+// delete_range. Run with 10000000 keys to match a large retention sweep.
+template <std::size_t N> void bench_delete_range(std::size_t count) {
+  std::vector<std::pair<std::uint64_t, PageData*>> entries;
+  entries.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    entries.emplace_back(i, nullptr);
+  }
+  std::string order = " <N=" + std::to_string(N) + ">";
+
+  for (std::size_t percent : {1, 10, 50}) {
+    std::uint64_t lower = count / 4;
+    std::uint64_t upper = lower + count * percent / 100;
+    std::string name = std::to_string(percent) + "%" + order;
+    {
+      BTree<std::uint64_t, N> tree;
+      do_not_optimize(tree.bulk_load(entries, 0.7));
+      double seconds = time_seconds([&] {
+        for (std::uint64_t key = lower; key < upper; ++key) {
+          do_not_optimize(tree.delete_key(key));
+        }
+      });
+      report("delete_key loop, " + name, upper - lower, seconds);
+    }
+    {
+      BTree<std::uint64_t, N> tree;
+      do_not_optimize(tree.bulk_load(entries, 0.7));
+      double seconds = time_seconds([&] { do_not_optimize(tree.delete_range(lower, upper)); });
+      report("delete_range, " + name, upper - lower, seconds);
+    }
+  }
+}
+
+// Random inserts, finds and deletes with and without BTreeStats, for what the counters and clock reads cost, followed
+// by the text dump of what was recorded.
+template <std::size_t N, typename Stats>
+void bench_stats_point(const std::vector<std::uint64_t>& keys, const std::string& name,
+                       BTreeStatsSnapshot* recorded = nullptr) {
+  BTree<std::uint64_t, N, HeapNodeAllocator, SortedInternalLayout, N, Stats> tree;
+  double seconds = time_seconds([&] {
+    for (auto key : keys) {
+      do_not_optimize(tree.insert(key, nullptr));
+    }
+  });
+  report("insert, " + name, keys.size(), seconds);
+  seconds = time_seconds([&] {
+    for (auto key : keys) {
+      do_not_optimize(tree.find(key).leaf_node);
+    }
+  });
+  report("find, " + name, keys.size(), seconds);
+  seconds = time_seconds([&] {
+    for (auto key : keys) {
+      do_not_optimize(tree.delete_key(key));
+    }
+  });
+  report("delete, " + name, keys.size(), seconds);
+  if constexpr (requires { tree.stats().snapshot(); }) {
+    if (recorded != nullptr) {
+      *recorded = tree.stats().snapshot();
+    }
+  }
+}
+
+template <std::size_t N> void bench_stats(std::size_t count) {
+  std::mt19937_64 rng(20);
+  std::vector<std::uint64_t> keys(count);
+  for (auto& key : keys) {
+    key = rng();
+  }
+  std::string order = " <N=" + std::to_string(N) + ">";
+  bench_stats_point<N, NoBTreeStats>(keys, "no stats" + order);
+  BTreeStatsSnapshot recorded;
+  bench_stats_point<N, BTreeStats>(keys, "BTreeStats" + order, &recorded);
+  std::cout << recorded.to_text();
+}
+
+struct NodeSizeResult {
+  std::size_t node_bytes;
+  double insert_rate;
+  double find_rate;
+  double scan_rate;
+};
+
+// Random inserts, random finds of present keys, and a full scan, on a tree whose nodes are NodeBytes.
+template <typename KeyType, std::size_t NodeBytes>
+NodeSizeResult bench_node_size_point(const std::vector<KeyType>& keys, const std::vector<KeyType>& lookups,
+                                     const std::string& key_name) {
+  using Fanout = NodeFanout<KeyType, NodeBytes>;
+  std::string name = key_name + " " + std::to_string(NodeBytes) + "B <N=" + std::to_string(Fanout::INTERNAL) +
+                     ", LeafN=" + std::to_string(Fanout::LEAF) + ">";
+  auto tree = std::make_unique<SizedBTree<KeyType, NodeBytes>>();
+  double insert_seconds = time_seconds([&] {
+    for (const auto& key : keys) {
+      do_not_optimize(tree->insert(key, nullptr));
+    }
+  });
+  report("insert " + name, keys.size(), insert_seconds);
+  double find_seconds = time_seconds([&] {
+    for (const auto& key : lookups) {
+      do_not_optimize(tree->find(key).leaf_node);
+    }
+  });
+  report("find " + name, lookups.size(), find_seconds);
+  std::size_t scanned = 0;
+  double scan_seconds = time_seconds([&] {
+    for (auto entry : *tree) {
+      do_not_optimize(entry.data);
+      scanned++;
+    }
+  });
+  report("scan " + name, scanned, scan_seconds);
+  return {NodeBytes, keys.size() / insert_seconds, lookups.size() / find_seconds, scanned / scan_seconds};
+}
+
+// Sweeps node sizes from a few cache lines up to several pages for one key type, and names the fastest size for each
+// operation on this machine.
+template <typename KeyType> void bench_node_sizes(std::size_t count, const std::string& key_name) {
+  std::mt19937_64 rng(29);
+  std::vector<KeyType> keys(count);
+  for (auto& key : keys) {
+    key = static_cast<KeyType>(rng() >> (64 - 8 * std::min<std::size_t>(sizeof(KeyType), 8) + 1));
+  }
+  std::vector<KeyType> lookups(std::min<std::size_t>(count, 2000000));
+  for (auto& key : lookups) {
+    key = keys[rng() % keys.size()];
+  }
+
+  std::vector<NodeSizeResult> results = {
+      bench_node_size_point<KeyType, 256>(keys, lookups, key_name),
+      bench_node_size_point<KeyType, 512>(keys, lookups, key_name),
+      bench_node_size_point<KeyType, 1024>(keys, lookups, key_name),
+      bench_node_size_point<KeyType, 2048>(keys, lookups, key_name),
+      bench_node_size_point<KeyType, 4096>(keys, lookups, key_name),
+      bench_node_size_point<KeyType, 8192>(keys, lookups, key_name),
+      bench_node_size_point<KeyType, 16384>(keys, lookups, key_name),
+  };
+  auto best = [&](double NodeSizeResult::*rate) {
+    return std::ranges::max(results, {}, rate).node_bytes;
+  };
+  std::cout << "best node size for " << key_name << ": insert " << best(&NodeSizeResult::insert_rate) << "B, find "
+            << best(&NodeSizeResult::find_rate) << "B, scan " << best(&NodeSizeResult::scan_rate) << "B" << std::endl;
+}
+
+// Searches within a single node of N - 1 keys, per strategy. The node stays in L1, so this is purely the cost of the
+// search itself.
+template <typename KeyType, std::size_t N, KeySearch Strategy>
+void bench_key_search_strategy(const std::vector<KeyType>& keys, const std::vector<KeyType>& queries,
+                               const std::string& name) {
+  double seconds = time_seconds([&] {
+    for (const auto& query : queries) {
+      do_not_optimize(key_rank<Strategy, true>(keys.data(), keys.size(), query));
+    }
+  });
+  report(name, queries.size(), seconds);
+}
+
+template <typename KeyType, std::size_t N> void bench_key_search(std::size_t count, const std::string& key_name) {
+  std::vector<KeyType> keys(N - 1);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    keys[i] = static_cast<KeyType>(i * 3);
+  }
+  std::mt19937_64 rng(3);
+  std::vector<KeyType> queries(count);
+  for (auto& query : queries) {
+    query = static_cast<KeyType>(rng() % (N * 3));
+  }
+
+  std::string suffix = " " + key_name + " <N=" + std::to_string(N) + ">";
+  bench_key_search_strategy<KeyType, N, KeySearch::Generic>(keys, queries, "search generic" + suffix);
+  bench_key_search_strategy<KeyType, N, KeySearch::BranchlessBinary>(keys, queries, "search branchless" + suffix);
+  bench_key_search_strategy<KeyType, N, KeySearch::Linear>(keys, queries, "search linear" + suffix);
+}
+
+template <typename KeyType> void bench_key_search_sizes(std::size_t count, const std::string& key_name) {
+  bench_key_search<KeyType, 9>(count, key_name);
+  bench_key_search<KeyType, 16>(count, key_name);
+  bench_key_search<KeyType, 64>(count, key_name);
+  bench_key_search<KeyType, 128>(count, key_name);
+  bench_key_search<KeyType, 256>(count, key_name);
+}
+
+// Random point lookups against a large bulk loaded tree, where nearly every internal node visit misses the cache, so
+// the internal node layout decides how many of those misses are serialized.
+template <typename KeyType, std::size_t N, typename InternalLayout>
+void bench_internal_layout(std::size_t count, const std::string& layout_name) {
+  std::vector<std::pair<KeyType, PageData*>> entries;
+  entries.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    entries.emplace_back(static_cast<KeyType>(i * 2), nullptr);
+  }
+  BTree<KeyType, N, SlabNodeAllocator, InternalLayout> tree;
+  do_not_optimize(tree.bulk_load(entries, 0.9));
+
+  std::mt19937_64 rng(5);
+  std::vector<KeyType> lookups(count);
+  for (auto& key : lookups) {
+    key = static_cast<KeyType>(rng() % (count * 2));
+  }
+
+  CacheMissCounter misses;
+  misses.start();
+  double seconds = time_seconds([&] {
+    for (const auto& key : lookups) {
+      do_not_optimize(tree.find(key).leaf_node);
+    }
+  });
+  std::uint64_t miss_count = misses.stop();
+
+  std::string name = "find " + layout_name + " <N=" + std::to_string(N) + ">";
+  if (misses.available()) {
+    name += " " + std::to_string(miss_count / count) + " misses/op";
+  }
+  report(name, count, seconds);
+}
+
+// Random lookups in batches of 1024 on a large tree, one find at a time against find_batch, then the same batches
+// sorted first (sort time not included), then sorted batches of neighbouring keys.
+template <typename KeyType, std::size_t N, typename InternalLayout>
+void bench_find_batch(std::size_t count, const std::string& layout_name) {
+  constexpr std::size_t BATCH = 1024;
+  std::vector<std::pair<KeyType, PageData*>> entries;
+  entries.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    entries.emplace_back(static_cast<KeyType>(i * 2), nullptr);
+  }
+  BTree<KeyType, N, SlabNodeAllocator, InternalLayout> tree;
+  do_not_optimize(tree.bulk_load(entries, 0.7));
+
+  std::mt19937_64 rng(19);
+  std::vector<KeyType> lookups(count / BATCH * BATCH);
+  for (auto& key : lookups) {
+    key = static_cast<KeyType>(rng() % (count * 2));
+  }
+  std::vector<FindResult<KeyType, N>> results(BATCH);
+
+  std::string suffix = " layout=" + layout_name + " <N=" + std::to_string(N) + ">";
+  double seconds = time_seconds([&] {
+    for (std::size_t begin = 0; begin < lookups.size(); begin += BATCH) {
+      for (std::size_t i = 0; i < BATCH; ++i) {
+        results[i] = tree.find(lookups[begin + i]);
+      }
+      do_not_optimize(results.data());
+    }
+  });
+  report("find loop" + suffix, lookups.size(), seconds);
+
+  auto run_batches = [&] {
+    return time_seconds([&] {
+      for (std::size_t begin = 0; begin < lookups.size(); begin += BATCH) {
+        tree.find_batch(std::span<const KeyType>(lookups).subspan(begin, BATCH), results);
+        do_not_optimize(results.data());
+      }
+    });
+  };
+  report("find_batch unsorted" + suffix, lookups.size(), run_batches());
+
+  for (std::size_t begin = 0; begin < lookups.size(); begin += BATCH) {
+    std::sort(lookups.begin() + begin, lookups.begin() + begin + BATCH);
+  }
+  report("find_batch sorted" + suffix, lookups.size(), run_batches());
+
+  for (std::size_t begin = 0; begin < lookups.size(); begin += BATCH) {
+    std::size_t first = rng() % (count - BATCH);
+    for (std::size_t i = 0; i < BATCH; ++i) {
+      lookups[begin + i] = static_cast<KeyType>((first + i) * 2);
+    }
+  }
+  report("find_batch sorted dense" + suffix, lookups.size(), run_batches());
+}
+
+// Wide range scans that sum up the pages: materializing the keys with find_keys_in_range and looking each one up again,
+// against iterating the range directly.
+template <std::size_t N> void bench_range_scan(std::size_t count) {
+  std::vector<std::pair<std::uint64_t, PageData*>> entries;
+  entries.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    entries.emplace_back(i, reinterpret_cast<PageData*>((i + 1) * 8));
+  }
+  BTree<std::uint64_t, N> tree;
+  do_not_optimize(tree.bulk_load(entries, 0.7));
+
+  std::mt19937_64 rng(13);
+  std::size_t width = std::max<std::size_t>(count / 100, 1);
+  std::vector<std::uint64_t> starts(100);
+  for (auto& start : starts) {
+    start = rng() % (count - width + 1);
+  }
+
+  std::string suffix = " width=" + std::to_string(width) + " <N=" + std::to_string(N) + ">";
+  double seconds = time_seconds([&] {
+    for (auto start : starts) {
+      std::uintptr_t sum = 0;
+      for (auto key : tree.find_keys_in_range(start, start + width)) {
+        auto found = tree.find(key);
+        sum += reinterpret_cast<std::uintptr_t>(found.leaf_node->dataPointers[found.idx]);
+      }
+      do_not_optimize(sum);
+    }
+  });
+  report("scan find_keys_in_range+find" + suffix, starts.size() * width, seconds);
+
+  seconds = time_seconds([&] {
+    for (auto start : starts) {
+      std::uintptr_t sum = 0;
+      for (const auto& [key, data] : tree.range(start, start + width)) {
+        sum += reinterpret_cast<std::uintptr_t>(data);
+      }
+      do_not_optimize(sum);
+    }
+  });
+  report("scan range" + suffix, starts.size() * width, seconds);
+
+  seconds = time_seconds([&] {
+    for (auto start : starts) {
+      std::uintptr_t sum = 0;
+      for (const auto& [key, data] : tree.range(start, start + width) | std::views::reverse) {
+        sum += reinterpret_cast<std::uintptr_t>(data);
+      }
+      do_not_optimize(sum);
+    }
+  });
+  report("scan range reversed" + suffix, starts.size() * width, seconds);
+}
+
+// Asks the kernel to drop the file from the page cache, so the next open starts cold. Only clean pages go, so sync first.
+void drop_page_cache(const std::string& path) {
+#if defined(__linux__)
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#endif
+}
+
+// What a restart costs: rebuilding the in-memory tree through insert, against opening the index file left behind and
+// answering the first query from it.
+void bench_disk(std::size_t count) {
+  const std::string path = (std::filesystem::temp_directory_path() / "btree_bench_disk.idx").string();
+  std::filesystem::remove(path);
+
+  std::mt19937_64 rng(31);
+  std::vector<std::uint64_t> keys(count);
+  for (auto& key : keys) {
+    key = rng();
+  }
+
+  {
+    BTree<std::uint64_t, 64> tree;
+    double seconds = time_seconds([&] {
+      for (auto key : keys) {
+        do_not_optimize(tree.insert(key, nullptr));
+      }
+    });
+    report("memory rebuild via insert <N=64>", count, seconds);
+  }
+
+  {
+    DiskBTree<std::uint64_t> tree;
+    double seconds = time_seconds([&] {
+      do_not_optimize(tree.open(path));
+      for (auto key : keys) {
+        do_not_optimize(tree.insert(key, NO_PAGE));
+      }
+      do_not_optimize(tree.sync());
+    });
+    report("disk build via insert <N=" + std::to_string(disk_fanout<std::uint64_t>()) + ">", count, seconds);
+  }
+  std::cout << "index file " << std::filesystem::file_size(path) / PageFile::PAGE_SIZE << " pages" << std::endl;
+
+  drop_page_cache(path);
+  DiskBTree<std::uint64_t> tree;
+  double seconds = time_seconds([&] {
+    do_not_optimize(tree.open(path));
+    do_not_optimize(tree.find(keys[count / 2]).found);
+  });
+  report("disk cold open + first find", 1, seconds);
+
+  std::size_t lookups = std::min<std::size_t>(count, 100000);
+  seconds = time_seconds([&] {
+    for (std::size_t i = 0; i < lookups; ++i) {
+      do_not_optimize(tree.find(keys[rng() % count]).found);
+    }
+  });
+  report("disk find (page cache warming up)", lookups, seconds);
+  tree.close();
+  std::filesystem::remove(path);
+}
+
+// Lookups against a tree much bigger than the pool, with the keys looked up spanning 2x and 10x as many pages as the
+// pool has frames. 80% of the lookups go to a fifth of that span, so there's something for the policy to keep.
+template <typename Policy>
+void bench_buffer_pool_policy(const std::string& path, std::size_t count, std::size_t frames,
+                              std::size_t pages_per_frame_span, const std::string& policy_name) {
+  std::uint64_t pages = std::filesystem::file_size(path) / PageFile::PAGE_SIZE;
+  // Keys went in sequentially, so a span of keys maps onto a proportional run of leaves.
+  std::size_t span = std::min<std::size_t>(count, count * frames * pages_per_frame_span / pages);
+  std::size_t hot = std::max<std::size_t>(span / 5, 1);
+
+  DiskBTree<std::uint64_t, disk_fanout<std::uint64_t>(), Policy> tree(frames);
+  do_not_optimize(tree.open(path));
+  std::mt19937_64 rng(43);
+  auto next_key = [&] { return rng() % 5 < 4 ? rng() % hot : rng() % span; };
+  // Warm up first so we're measuring the steady state, not filling the pool.
+  for (std::size_t i = 0; i < frames * 8; ++i) {
+    do_not_optimize(tree.find(next_key()).found);
+  }
+  tree.reset_buffer_pool_stats();
+
+  std::size_t lookups = std::min<std::size_t>(count, 500000);
+  double seconds = time_seconds([&] {
+    for (std::size_t i = 0; i < lookups; ++i) {
+      do_not_optimize(tree.find(next_key()).found);
+    }
+  });
+  const BufferPoolStats& stats = tree.buffer_pool_stats();
+  report("pool find " + policy_name + " working set " + std::to_string(pages_per_frame_span) + "x pool", lookups,
+         seconds);
+  std::cout << "  hit rate " << std::fixed << std::setprecision(1)
+            << 100.0 * stats.hits / std::max<std::uint64_t>(stats.hits + stats.misses, 1) << "%, "
+            << stats.evictions << " evictions" << std::endl;
+}
+
+void bench_buffer_pool(std::size_t count) {
+  const std::string path = (std::filesystem::temp_directory_path() / "btree_bench_pool.idx").string();
+  std::filesystem::remove(path);
+  {
+    DiskBTree<std::uint64_t> tree;
+    do_not_optimize(tree.open(path));
+    for (std::size_t i = 0; i < count; ++i) {
+      do_not_optimize(tree.insert(i, NO_PAGE));
+    }
+    do_not_optimize(tree.sync());
+  }
+
+  // Small enough that 10x the pool is still within the tree.
+  std::uint64_t pages = std::filesystem::file_size(path) / PageFile::PAGE_SIZE;
+  std::size_t frames = std::clamp<std::size_t>(pages / 20, 8, 256);
+  std::cout << "index file " << pages << " pages, pool " << frames << " frames" << std::endl;
+  for (std::size_t span : {2, 10}) {
+    bench_buffer_pool_policy<LruEviction>(path, count, frames, span, "lru");
+    bench_buffer_pool_policy<ClockEviction>(path, count, frames, span, "clock");
+    bench_buffer_pool_policy<LruKEviction<2>>(path, count, frames, span, "lru-2");
+  }
+  std::filesystem::remove(path);
+}
+
+// Resident set size of the process, mapped file pages included.
+std::size_t resident_bytes() {
+#if defined(__linux__)
+  std::ifstream statm("/proc/self/statm");
+  std::size_t total_pages = 0;
+  std::size_t resident_pages = 0;
+  statm >> total_pages >> resident_pages;
+  return resident_pages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+
+// Startup of a lookup-only reader: mapping a snapshot and answering the first query from it, against rebuilding the
+// tree with bulk_load from entries that are already sorted in memory (so leaving out reading them from anywhere).
+void bench_snapshot(std::size_t count) {
+  const std::string path = (std::filesystem::temp_directory_path() / "btree_bench.snap").string();
+  std::mt19937_64 rng(47);
+  std::vector<std::uint64_t> keys(count);
+  for (auto& key : keys) {
+    key = rng();
+  }
+  std::ranges::sort(keys);
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  auto entries = keys | std::views::transform([](std::uint64_t key) { return std::pair(key, (PageData*)nullptr); });
+
+  {
+    BTree<std::uint64_t, 64> tree;
+    double seconds = time_seconds([&] { do_not_optimize(tree.bulk_load(entries)); });
+    report("rebuild via bulk_load <N=64>", keys.size(), seconds);
+    seconds = time_seconds([&] { do_not_optimize(BTreeSnapshot<std::uint64_t>::write(path, tree)); });
+    report("snapshot write", keys.size(), seconds);
+  }
+  std::cout << "snapshot file " << std::filesystem::file_size(path) / (1 << 20) << " MB" << std::endl;
+
+  drop_page_cache(path);
+  std::size_t rss_before = resident_bytes();
+  BTreeSnapshot<std::uint64_t> snapshot;
+  double seconds = time_seconds([&] {
+    do_not_optimize(snapshot.open(path));
+    do_not_optimize(snapshot.find(keys[keys.size() / 2]).found);
+  });
+  report("snapshot cold open + first find", 1, seconds);
+  std::cout << "  rss +" << (resident_bytes() - rss_before) / 1024 << " KB" << std::endl;
+
+  std::size_t lookups = std::min<std::size_t>(count, 1000000);
+  seconds = time_seconds([&] {
+    for (std::size_t i = 0; i < lookups; ++i) {
+      do_not_optimize(snapshot.find(keys[rng() % keys.size()]).found);
+    }
+  });
+  report("snapshot find (page cache warming up)", lookups, seconds);
+  std::cout << "  rss +" << (resident_bytes() - rss_before) / 1024 << " KB" << std::endl;
+  seconds = time_seconds([&] {
+    for (std::size_t i = 0; i < lookups; ++i) {
+      do_not_optimize(snapshot.find(keys[rng() % keys.size()]).found);
+    }
+  });
+  report("snapshot find (warm)", lookups, seconds);
+  snapshot.close();
+  std::filesystem::remove(path);
+}
+
+// Random inserts with the log off and on, at different group sizes and fsync intervals. fsync per operation is timed
+// on fewer operations, it's a few orders of magnitude slower.
+template <std::size_t N> void bench_wal(std::size_t count) {
+  const std::string path = (std::filesystem::temp_directory_path() / "btree_bench_wal").string();
+  std::mt19937_64 rng(67);
+  std::vector<std::uint64_t> keys(count);
+  for (auto& key : keys) {
+    key = rng();
+  }
+
+  std::string order = " <N=" + std::to_string(N) + ">";
+  {
+    BTree<std::uint64_t, N> tree;
+    double seconds = time_seconds([&] {
+      for (auto key : keys) {
+        do_not_optimize(tree.insert(key, nullptr));
+      }
+    });
+    report("insert, no log" + order, count, seconds);
+  }
+
+  struct Setting {
+    std::string name;
+    WalOptions options;
+    std::size_t ops;
+  };
+  const Setting settings[] = {
+      {"log, no fsync", {64, 0}, count},
+      {"log, fsync every op", {1, 1}, std::min<std::size_t>(count, 2000)},
+      {"log, fsync every 64 ops", {64, 1}, std::min<std::size_t>(count, 200000)},
+      {"log, fsync every 1024 ops", {1024, 1}, count},
+      {"log, fsync every 16 x 1024 ops", {1024, 16}, count},
+  };
+  for (const auto& setting : settings) {
+    std::filesystem::remove(path + ".wal");
+    std::filesystem::remove(path + ".snap");
+    DurableBTree<std::uint64_t, N> tree(setting.options);
+    do_not_optimize(tree.open(path));
+    double seconds = time_seconds([&] {
+      for (std::size_t i = 0; i < setting.ops; ++i) {
+        do_not_optimize(tree.insert(keys[i], nullptr));
+      }
+      do_not_optimize(tree.sync());
+    });
+    report("insert, " + setting.name + order, setting.ops, seconds);
+  }
+  std::filesystem::remove(path + ".wal");
+  std::filesystem::remove(path + ".snap");
+}
+
+// Bytes currently handed out by malloc, to see what a tree takes including every std::string's own buffer.
+std::size_t heap_bytes() {
+#if defined(__linux__)
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+// URL like keys (a handful of hosts, long shared paths) in BTree<std::string, N>, where every key is a std::string of
+// its own, against StringBTree with the key bytes inside the nodes. Memory is the heap growth from building the tree,
+// lookups are random hits.
+template <std::size_t N, std::size_t NodeBytes> void bench_string_keys(std::size_t count) {
+  std::mt19937_64 rng(71);
+  std::vector<std::string> keys(count);
+  for (auto& key : keys) {
+    std::uint64_t r = rng();
+    key = "https://www.example-host-" + std::to_string(r % 16) + ".com/articles/" + std::to_string(2000 + r / 16 % 25) +
+          "/" + std::to_string(r / 400 % 100000000) + "/index.html";
+  }
+  std::vector<std::size_t> queries(std::min<std::size_t>(count, 2000000));
+  for (auto& query : queries) {
+    query = rng() % count;
+  }
+  std::size_t key_bytes = 0;
+  for (const auto& key : keys) {
+    key_bytes += key.size();
+  }
+  std::cout << "average key " << key_bytes / std::max<std::size_t>(count, 1) << " bytes" << std::endl;
+
+  auto report_memory = [&](const std::string& name, std::size_t bytes, std::size_t stored) {
+    std::cout << std::left << std::setw(48) << name << std::right << std::setw(12) << stored << " keys"
+              << std::setprecision(1) << std::setw(10) << static_cast<double>(bytes) / std::max<std::size_t>(stored, 1)
+              << " bytes/key" << std::endl;
+  };
+
+  {
+    std::size_t before = heap_bytes();
+    auto tree = std::make_unique<BTree<std::string, N>>();
+    std::size_t stored = 0;
+    double seconds = time_seconds([&] {
+      for (const auto& key : keys) {
+        stored += tree->insert(key, nullptr) == InsertResult::Success;
+      }
+    });
+    std::string name = "std::string <N=" + std::to_string(N) + ">";
+    report("insert, " + name, count, seconds);
+    report_memory("memory, " + name, heap_bytes() - before, stored);
+    seconds = time_seconds([&] {
+      for (auto query : queries) {
+        do_not_optimize(tree->find(keys[query]).leaf_node);
+      }
+    });
+    report("find, " + name, queries.size(), seconds);
+  }
+
+  {
+    std::size_t before = heap_bytes();
+    auto tree = std::make_unique<StringBTree<NodeBytes>>();
+    std::size_t stored = 0;
+    double seconds = time_seconds([&] {
+      for (const auto& key : keys) {
+        stored += tree->insert(key, nullptr) == InsertResult::Success;
+      }
+    });
+    std::string name = "prefix compressed <" + std::to_string(NodeBytes) + " byte nodes>";
+    report("insert, " + name, count, seconds);
+    report_memory("memory, " + name, heap_bytes() - before, stored);
+    seconds = time_seconds([&] {
+      for (auto query : queries) {
+        do_not_optimize(tree->find(keys[query]).found);
+      }
+    });
+    report("find, " + name, queries.size(), seconds);
+  }
+}
+
+// Zipfian over [0, keys): key k comes up with probability proportional to 1 / (k + 1)^theta, theta in (0, 1). This is
+// the method from Gray et al., "Quickly Generating Billion-Record Synthetic Databases", same as YCSB's: constant memory
+// and one pow per draw, only the constructor walks all the keys once (a fraction of a second for 100M).
+class ZipfianGenerator {
+public:
+  ZipfianGenerator(std::size_t keys, double theta) : keys(keys), theta(theta) {
+    double zeta_2 = 1.0 + std::pow(0.5, theta);
+    for (std::size_t k = 0; k < keys; ++k) {
+      zeta_n += 1.0 / std::pow(static_cast<double>(k + 1), theta);
+    }
+    alpha = 1.0 / (1.0 - theta);
+    eta = (1.0 - std::pow(2.0 / static_cast<double>(keys), 1.0 - theta)) / (1.0 - zeta_2 / zeta_n);
+  }
+
+  template <typename Rng> std::size_t operator()(Rng& rng) {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    double uz = u * zeta_n;
+    if (uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + std::pow(0.5, theta)) {
+      return std::min<std::size_t>(1, keys - 1);
+    }
+    auto k = static_cast<std::size_t>(static_cast<double>(keys) * std::pow(eta * u - eta + 1.0, alpha));
+    return std::min(k, keys - 1);
+  }
+
+private:
+  std::size_t keys;
+  double theta;
+  double zeta_n = 0;
+  double alpha;
+  double eta;
+};
+
+// count (key, value) pairs with Zipfian keys, so a few keys hold most of the values. Lookups fetch all values of a
+// Zipfian key, deletes remove a random tenth of the pairs.
+template <std::size_t N, std::size_t InlineLimit>
+void bench_multimap_point(const std::vector<std::pair<std::uint64_t, PageData*>>& pairs,
+                          const std::vector<std::uint64_t>& lookups, const std::string& name) {
+  std::size_t before = heap_bytes();
+  auto multimap = std::make_unique<BTreeMultimap<std::uint64_t, N, InlineLimit>>();
+  double seconds = time_seconds([&] {
+    for (auto& [key, value] : pairs) {
+      do_not_optimize(multimap->insert(key, value));
+    }
+  });
+  std::size_t bytes = heap_bytes() - before;
+  report("insert, " + name, pairs.size(), seconds);
+  std::cout << std::left << std::setw(48) << ("memory, " + name) << std::right << std::setw(12) << multimap->size()
+            << " pairs" << std::setprecision(1) << std::setw(10)
+            << static_cast<double>(bytes) / std::max<std::size_t>(multimap->size(), 1) << " bytes/pair, "
+            << multimap->spilled_keys() << " spilled keys" << std::endl;
+
+  std::size_t values = 0;
+  seconds = time_seconds([&] {
+    for (auto key : lookups) {
+      multimap->find(key, [&](PageData* value) {
+        do_not_optimize(value);
+        values++;
+        return true;
+      });
+    }
+  });
+  report("find all, " + name, lookups.size(), seconds);
+  std::cout << "  " << values / std::max<std::size_t>(lookups.size(), 1) << " values per lookup on average"
+            << std::endl;
+
+  seconds = time_seconds([&] {
+    for (std::size_t i = 0; i < pairs.size(); i += 10) {
+      do_not_optimize(multimap->delete_key(pairs[i].first, pairs[i].second));
+    }
+  });
+  report("delete, " + name, (pairs.size() + 9) / 10, seconds);
+}
+
+// The same on a plain BTree over (key, value), i.e. every value of a hot key in the leaves.
+template <std::size_t N>
+void bench_multimap_inline(const std::vector<std::pair<std::uint64_t, PageData*>>& pairs,
+                           const std::vector<std::uint64_t>& lookups, const std::string& name) {
+  using Key = MultimapKey<std::uint64_t>;
+  std::size_t before = heap_bytes();
+  auto tree = std::make_unique<BTree<Key, N>>();
+  std::size_t stored = 0;
+  double seconds = time_seconds([&] {
+    for (auto& [key, value] : pairs) {
+      stored += tree->insert(Key{key, reinterpret_cast<std::uintptr_t>(value)}, value) == InsertResult::Success;
+    }
+  });
+  std::size_t bytes = heap_bytes() - before;
+  report("insert, " + name, pairs.size(), seconds);
+  std::cout << std::left << std::setw(48) << ("memory, " + name) << std::right << std::setw(12) << stored << " pairs"
+            << std::setprecision(1) << std::setw(10) << static_cast<double>(bytes) / std::max<std::size_t>(stored, 1)
+            << " bytes/pair" << std::endl;
+
+  seconds = time_seconds([&] {
+    for (auto key : lookups) {
+      for (auto it = tree->lower_bound(Key{key, 0}); it != tree->end() && (*it).key.key == key; ++it) {
+        do_not_optimize((*it).data);
+      }
+    }
+  });
+  report("find all, " + name, lookups.size(), seconds);
+
+  seconds = time_seconds([&] {
+    for (std::size_t i = 0; i < pairs.size(); i += 10) {
+      do_not_optimize(tree->delete_key(Key{pairs[i].first, reinterpret_cast<std::uintptr_t>(pairs[i].second)}));
+    }
+  });
+  report("delete, " + name, (pairs.size() + 9) / 10, seconds);
+}
+
+template <std::size_t N> void bench_multimap(std::size_t count) {
+  std::size_t keys = std::max<std::size_t>(count / 100, 1);
+  ZipfianGenerator zipf(keys, 0.99);
+  std::mt19937_64 rng(17);
+  std::vector<std::pair<std::uint64_t, PageData*>> pairs(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    pairs[i] = {zipf(rng), reinterpret_cast<PageData*>((i + 1) * 8)};
+  }
+  std::ranges::shuffle(pairs, rng);
+  std::vector<std::uint64_t> lookups(std::min<std::size_t>(count / 10, 200000));
+  for (auto& key : lookups) {
+    key = zipf(rng);
+  }
+  std::string order = " <N=" + std::to_string(N) + ">";
+  bench_multimap_point<N, 8>(pairs, lookups, "posting lists, inline 8" + order);
+  bench_multimap_point<N, 32>(pairs, lookups, "posting lists, inline 32" + order);
+  bench_multimap_inline<N>(pairs, lookups, "all inline" + order);
+}
+
+// Ascending keys, as ids and timestamps come in, against the same keys in random order and bulk loaded into full nodes.
+// Ascending inserts go to the cached last leaf without a descent and leave it 90% full when it splits. "Nearly
+// ascending" swaps 1% of neighbouring keys, which have to go to a leaf that's already been split off.
+template <std::size_t N> void bench_append(std::size_t count) {
+  std::vector<std::uint64_t> ascending(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    ascending[i] = i * 2;
+  }
+  std::mt19937_64 rng(22);
+  std::vector<std::uint64_t> nearly_ascending = ascending;
+  for (std::size_t i = 0; i + 1 < count; ++i) {
+    if (rng() % 100 == 0) {
+      std::swap(nearly_ascending[i], nearly_ascending[i + 1]);
+    }
+  }
+  std::vector<std::uint64_t> shuffled = ascending;
+  std::ranges::shuffle(shuffled, rng);
+  std::string order = " <N=" + std::to_string(N) + ">";
+
+  auto run = [&](const std::vector<std::uint64_t>& keys, const std::string& name) {
+    std::size_t before = heap_bytes();
+    auto tree = std::make_unique<BTree<std::uint64_t, N>>();
+    double seconds = time_seconds([&] {
+      for (auto key : keys) {
+        do_not_optimize(tree->insert(key, nullptr));
+      }
+    });
+    std::size_t bytes = heap_bytes() - before;
+    report("insert, " + name + order, keys.size(), seconds);
+    std::cout << std::left << std::setw(48) << ("memory, " + name + order) << std::right << std::setprecision(1)
+              << std::setw(10) << static_cast<double>(bytes) / std::max<std::size_t>(keys.size(), 1) << " bytes/key"
+              << std::endl;
+  };
+  run(ascending, "ascending");
+  run(nearly_ascending, "nearly ascending");
+  run(shuffled, "random order");
+
+  std::vector<std::pair<std::uint64_t, PageData*>> entries;
+  entries.reserve(count);
+  for (auto key : ascending) {
+    entries.emplace_back(key, nullptr);
+  }
+  std::size_t before = heap_bytes();
+  auto tree = std::make_unique<BTree<std::uint64_t, N>>();
+  do_not_optimize(tree->bulk_load(entries));
+  std::cout << std::left << std::setw(48) << ("memory, bulk_load full" + order) << std::right << std::setprecision(1)
+            << std::setw(10) << static_cast<double>(heap_bytes() - before) / std::max<std::size_t>(count, 1)
+            << " bytes/key" << std::endl;
+}
+
+// Alternating deletes and inserts at leaf merge thresholds 0.5 (eager, the default), 0.25 and 0 (only empty leaves go).
+// "at minimum" is bulk loaded half full, so with eager merging every delete is a fix and the next insert has a fair
+// chance of splitting what it made, then each deleted key goes right back in. "random" replaces a random present key
+// with a fresh random one. Structural changes are splits + merges + redistributions, latencies come from BTreeStats.
+template <std::size_t N> void bench_churn(std::size_t count) {
+  std::mt19937_64 rng(23);
+  std::vector<std::uint64_t> keys(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    keys[i] = i * 2;
+  }
+  std::vector<std::size_t> victims(count);
+  for (auto& victim : victims) {
+    victim = rng() % count;
+  }
+  std::vector<std::uint64_t> fresh(count);
+  for (auto& key : fresh) {
+    key = rng() | 1;
+  }
+  std::string order = " <N=" + std::to_string(N) + ">";
+
+  for (bool random : {false, true}) {
+    for (double threshold : {0.5, 0.25, 0.0}) {
+      using Tree = BTree<std::uint64_t, N, HeapNodeAllocator, SortedInternalLayout, N, BTreeStats>;
+      std::vector<std::uint64_t> present = keys;
+      std::size_t before = heap_bytes();
+      auto tree = std::make_unique<Tree>();
+      tree->set_leaf_merge_threshold(threshold);
+      if (random) {
+        std::ranges::shuffle(present, rng);
+        for (auto key : present) {
+          do_not_optimize(tree->insert(key, nullptr));
+        }
+      } else {
+        std::vector<std::pair<std::uint64_t, PageData*>> entries;
+        for (auto key : present) {
+          entries.emplace_back(key, nullptr);
+        }
+        do_not_optimize(tree->bulk_load(entries, 0.5));
+      }
+      tree->stats().reset();
+
+      double seconds = time_seconds([&] {
+        for (std::size_t i = 0; i < count; ++i) {
+          std::uint64_t& key = present[victims[i]];
+          do_not_optimize(tree->delete_key(key));
+          if (random) {
+            key = fresh[i];
+          }
+          do_not_optimize(tree->insert(key, nullptr));
+        }
+      });
+      BTreeStatsSnapshot stats = tree->stats().snapshot();
+      std::string name = std::string(random ? "random" : "at minimum") + ", threshold " +
+                         std::to_string(threshold).substr(0, 4) + order;
+      report("churn, " + name, 2 * count, seconds);
+      std::uint64_t changes = stats.leaf_splits + stats.internal_splits + stats.leaf_merges + stats.internal_merges +
+                              stats.redistributions;
+      const LatencyHistogram& deletes = stats.latency_of(BTreeOp::Delete);
+      const LatencyHistogram& inserts = stats.latency_of(BTreeOp::Insert);
+      std::cout << "  " << changes << " structural changes (" << stats.leaf_splits << " leaf splits, "
+                << stats.leaf_merges << " merges, " << stats.redistributions << " redistributions), delete p99/p99.9 "
+                << deletes.percentile(99) << "/" << deletes.percentile(99.9) << " ns, insert p99/p99.9 "
+                << inserts.percentile(99) << "/" << inserts.percentile(99.9) << " ns, " << std::setprecision(1)
+                << static_cast<double>(heap_bytes() - before) / static_cast<double>(std::max<std::size_t>(count, 1))
+                << " bytes/key" << std::endl;
+    }
+  }
+}
+
+// A tree thinned out to about half full by relaxed deletes, then compacted to 90% in slices of 64 leaves, and again with
+// relocation. Reports scan speed along the leaf chain after each step, how long the slices take, and the memory held
+// (heap growth, so slab trees keep the slabs they grew to).
+template <std::size_t N, template <typename> class NodeAllocator>
+void bench_compact(std::size_t count, const std::string& allocator_name) {
+  std::mt19937_64 rng(24);
+  std::vector<std::uint64_t> keys(count);
+  for (auto& key : keys) {
+    key = rng();
+  }
+  std::string name = " <N=" + std::to_string(N) + ", " + allocator_name + ">";
+
+  std::size_t before = heap_bytes();
+  auto tree = std::make_unique<BTree<std::uint64_t, N, NodeAllocator>>();
+  tree->set_leaf_merge_threshold(0.25);
+  for (auto key : keys) {
+    do_not_optimize(tree->insert(key, nullptr));
+  }
+  std::ranges::shuffle(keys, rng);
+  keys.resize(count * 45 / 100);
+  for (auto key : keys) {
+    do_not_optimize(tree->delete_key(key));
+  }
+  std::size_t entries = count - keys.size();
+
+  auto scan = [&](const std::string& step) {
+    std::uint64_t sum = 0;
+    double seconds = time_seconds([&] {
+      for (int round = 0; round < 5; ++round) {
+        for (auto entry : *tree) {
+          sum += entry.key;
+        }
+      }
+    });
+    do_not_optimize(sum);
+    report("scan, " + step + name, 5 * entries, seconds);
+    std::cout << "  " << std::setprecision(1)
+              << static_cast<double>(heap_bytes() - before) / static_cast<double>(std::max<std::size_t>(entries, 1))
+              << " bytes/key" << std::endl;
+  };
+  auto compact = [&](const std::string& step, const CompactionOptions& options) {
+    CompactionCursor<std::uint64_t> cursor;
+    double slowest = 0;
+    double seconds = time_seconds([&] {
+      bool done = false;
+      while (!done) {
+        double slice = time_seconds([&] { done = tree->compact(cursor, 64, options); });
+        slowest = std::max(slowest, slice);
+      }
+    });
+    report("compact, " + step + name, cursor.leaves_visited, seconds);
+    std::cout << "  " << cursor.leaves_freed << " of " << cursor.leaves_visited << " leaves freed, slowest 64 leaf slice "
+              << std::setprecision(1) << slowest * 1e6 << " us" << std::endl;
+  };
+
+  scan("half full");
+  compact("fill 0.9", {0.9, false});
+  scan("compacted");
+  compact("fill 0.9 + relocate", {0.9, true});
+  scan("relocated");
+}
+
+// parallel_bulk_load from shuffled entries and parallel_aggregate summing every key, at 1, 2, 4, ... 64 threads, against
+// std::sort + bulk_load on one. Past the core count the extra threads only add overhead, the core count is printed.
+template <std::size_t N> void bench_parallel(std::size_t count) {
+  std::mt19937_64 rng(25);
+  std::vector<std::pair<std::uint64_t, PageData*>> shuffled(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    shuffled[i] = {i * 2, nullptr};
+  }
+  std::ranges::shuffle(shuffled, rng);
+  std::string order = " <N=" + std::to_string(N) + ">";
+  std::cout << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+  {
+    auto entries = shuffled;
+    auto tree = std::make_unique<BTree<std::uint64_t, N>>();
+    double seconds = time_seconds([&] {
+      std::ranges::sort(entries, [](const auto& a, const auto& b) { return a.first < b.first; });
+      do_not_optimize(tree->bulk_load(entries));
+    });
+    report("sort + bulk_load, serial" + order, count, seconds);
+  }
+
+  for (unsigned threads = 1; threads <= 64; threads *= 2) {
+    std::string name = ", " + std::to_string(threads) + " threads" + order;
+    auto entries = shuffled;
+    auto tree = std::make_unique<BTree<std::uint64_t, N>>();
+    double seconds = time_seconds([&] { do_not_optimize(tree->parallel_bulk_load(entries, threads)); });
+    report("parallel_bulk_load" + name, count, seconds);
+
+    std::uint64_t sum = 0;
+    seconds = time_seconds([&] {
+      sum = tree->parallel_aggregate(
+          std::uint64_t{0}, std::uint64_t{2} * count, threads, std::uint64_t{0},
+          [](std::uint64_t acc, const std::uint64_t& key, PageData*) { return acc + key; },
+          [](std::uint64_t a, std::uint64_t b) { return a + b; });
+    });
+    do_not_optimize(sum);
+    report("parallel_aggregate sum" + name, count, seconds);
+  }
+}
+
+// 1, 2, 4, ... up to the core count.
+std::vector<unsigned> concurrent_thread_counts() {
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<unsigned> thread_counts;
+  for (unsigned threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+  return thread_counts;
+}
+
+// Mixed 90% find / 10% insert+delete on a shared tree, at 1, 2, 4, ... threads up to the core count. Each thread does
+// count / threads ops, so with perfect scaling the time halves with every doubling.
+template <std::size_t N> void bench_concurrent(std::size_t count) {
+  for (unsigned threads : concurrent_thread_counts()) {
+    ConcurrentBTree<std::uint64_t, N> tree;
+    for (std::size_t i = 0; i < count; ++i) {
+      do_not_optimize(tree.insert(i * 2, nullptr));
+    }
+
+    std::size_t per_thread = count / threads;
+    double seconds = time_seconds([&] {
+      std::vector<std::thread> workers;
+      for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+          std::mt19937_64 rng(t + 1);
+          for (std::size_t i = 0; i < per_thread; ++i) {
+            std::uint64_t key = rng() % (count * 2);
+            switch (rng() % 20) {
+            case 0:
+              do_not_optimize(tree.insert(key | 1, nullptr));
+              break;
+            case 1:
+              do_not_optimize(tree.delete_key(key | 1));
+              break;
+            default:
+              do_not_optimize(tree.find(key).found);
+            }
+          }
+        });
+      }
+      for (auto& worker : workers) {
+        worker.join();
+      }
+    });
+    report("concurrent 90/10 threads=" + std::to_string(threads) + " <N=" + std::to_string(N) + ">",
+           per_thread * threads, seconds);
+  }
+}
+
+// 10% range scans of ~100 keys against 90% point inserts/deletes, so scans keep crossing leaves that are being split,
+// merged and freed under them. Reports total ops and how many unlinked nodes were still waiting to be freed at the end.
+template <std::size_t N> void bench_concurrent_scans(std::size_t count) {
+  for (unsigned threads : concurrent_thread_counts()) {
+    ConcurrentBTree<std::uint64_t, N> tree;
+    for (std::size_t i = 0; i < count; ++i) {
+      do_not_optimize(tree.insert(i * 2, nullptr));
+    }
+
+    std::size_t per_thread = count / threads;
+    std::atomic<std::size_t> scanned{0};
+    double seconds = time_seconds([&] {
+      std::vector<std::thread> workers;
+      for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+          std::mt19937_64 rng(t + 1);
+          std::size_t local_scanned = 0;
+          for (std::size_t i = 0; i < per_thread; ++i) {
+            std::uint64_t key = rng() % (count * 2);
+            switch (rng() % 10) {
+            case 0:
+              local_scanned += tree.find_keys_in_range(key, key + 200).size();
+              break;
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+              do_not_optimize(tree.insert(key, nullptr));
+              break;
+            default:
+              do_not_optimize(tree.delete_key(key));
+            }
+          }
+          scanned += local_scanned;
+        });
+      }
+      for (auto& worker : workers) {
+        worker.join();
+      }
+    });
+    report("concurrent 10% scan/90% write threads=" + std::to_string(threads) + " <N=" + std::to_string(N) + "> " +
+               std::to_string(tree.pending_reclamation()) + " pending",
+           per_thread * threads, seconds);
+    do_not_optimize(scanned.load());
+  }
+}
+
+// Machine readable suite, sections "suite" and "ycsb". Every result is one JSON object per line, always in the same
+// order and from fixed seeds, so two runs (e.g. before and after a commit) can be diffed line by line. The first line
+// says what built it.
+
+// Every operation is counted towards throughput, every LATENCY_SAMPLE-th one is also timed on its own for the
+// percentiles, which keeps the clock reads out of the throughput numbers.
+inline constexpr std::size_t LATENCY_SAMPLE = 16;
+// Small trees are rebuilt (or their lookups repeated) until a phase did at least this many operations.
+inline constexpr std::size_t SUITE_MIN_OPS = 1'000'000;
+inline constexpr std::uint64_t SUITE_SEED = 21;
+
+struct Measured {
+  std::size_t ops = 0;
+  double seconds = 0;
+  LatencyHistogram latency;
+};
+
+template <typename Op> void measure(Measured& measured, std::size_t ops, Op&& op) {
+  auto start = Clock::now();
+  for (std::size_t i = 0; i < ops; ++i) {
+    if (i % LATENCY_SAMPLE == 0) {
+      auto op_start = Clock::now();
+      op(i);
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - op_start);
+      measured.latency.record(static_cast<std::uint64_t>(elapsed.count()));
+    } else {
+      op(i);
+    }
+  }
+  measured.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+  measured.ops += ops;
+}
+
+// Throughput and latency fields shared by every line.
+std::string measured_json(const Measured& measured) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(0) << "\"ops\":" << measured.ops << ",\"ops_per_sec\":"
+      << (measured.seconds > 0 ? measured.ops / measured.seconds : 0) << ",\"p50_ns\":"
+      << measured.latency.percentile(50) << ",\"p99_ns\":" << measured.latency.percentile(99)
+      << ",\"p999_ns\":" << measured.latency.percentile(99.9);
+  return out.str();
+}
+
+void print_suite_header(const std::string& section, std::size_t count) {
+  std::cout << "{\"suite\":\"" << section << "\",\"count\":" << count << ",\"seed\":" << SUITE_SEED
+            << ",\"compiler\":\"" << __VERSION__ << "\",\"ndebug\":"
+#if defined(NDEBUG)
+            << "true"
+#else
+            << "false"
+#endif
+            << ",\"latency_sample\":" << LATENCY_SAMPLE << "}" << std::endl;
+}
+
+// Spreads a number over 64 bits (splitmix64's finalizer), for keys in hashed order and for scattering Zipfian ranks.
+constexpr std::uint64_t mix64(std::uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// The tree holds the keys 0 .. size - 1. The distribution picks the order they're inserted, looked up and deleted in:
+// sequential and reverse walk the keys in order, random uses a fixed permutation, and zipfian inserts and deletes in
+// that permutation but looks up (and starts ranges at) Zipfian(0.99) ranks, scattered over the key space so the hot
+// keys don't all share a leaf.
+enum class KeyOrder { Sequential, Reverse, Random, Zipfian };
+
+const char* key_order_name(KeyOrder order) {
+  switch (order) {
+  case KeyOrder::Sequential:
+    return "sequential";
+  case KeyOrder::Reverse:
+    return "reverse";
+  case KeyOrder::Random:
+    return "random";
+  case KeyOrder::Zipfian:
+    return "zipfian";
+  }
+  return "unknown";
+}
+
+// insert, find, find_keys_in_range (100 keys each) and delete_key on one size, order, N and key type.
+template <typename KeyType, std::size_t N>
+void suite_point(std::size_t size, KeyOrder key_order, const std::string& key_name) {
+  std::vector<KeyType> order(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    order[i] = static_cast<KeyType>(key_order == KeyOrder::Reverse ? size - 1 - i : i);
+  }
+  std::mt19937_64 rng(SUITE_SEED);
+  if (key_order == KeyOrder::Random || key_order == KeyOrder::Zipfian) {
+    std::shuffle(order.begin(), order.end(), rng);
+  }
+  std::size_t lookups = std::max(size, SUITE_MIN_OPS);
+  std::vector<KeyType> zipfian_keys;
+  if (key_order == KeyOrder::Zipfian) {
+    ZipfianGenerator zipf(size, 0.99);
+    zipfian_keys.resize(std::min(lookups, SUITE_MIN_OPS));
+    for (auto& key : zipfian_keys) {
+      key = static_cast<KeyType>(mix64(zipf(rng)) % size);
+    }
+  }
+  auto lookup_key = [&](std::size_t i) {
+    return key_order == KeyOrder::Zipfian ? zipfian_keys[i % zipfian_keys.size()] : order[i % size];
+  };
+
+  std::size_t rounds = (SUITE_MIN_OPS + size - 1) / size;
+  Measured insert, find, range, erase;
+  double bytes_per_key = 0;
+  for (std::size_t round = 0; round < rounds; ++round) {
+    std::size_t before = heap_bytes();
+    auto tree = std::make_unique<BTree<KeyType, N>>();
+    measure(insert, size, [&](std::size_t i) { do_not_optimize(tree->insert(order[i], nullptr)); });
+    bytes_per_key = static_cast<double>(heap_bytes() - before) / static_cast<double>(size);
+    if (round + 1 == rounds) {
+      measure(find, lookups, [&](std::size_t i) { do_not_optimize(tree->find(lookup_key(i)).leaf_node); });
+      measure(range, lookups / 10, [&](std::size_t i) {
+        KeyType lower = lookup_key(i);
+        do_not_optimize(tree->find_keys_in_range(lower, static_cast<KeyType>(lower + 100)).size());
+      });
+    }
+    measure(erase, size, [&](std::size_t i) { do_not_optimize(tree->delete_key(order[i])); });
+  }
+
+  auto print = [&](const char* op, const Measured& measured) {
+    std::cout << "{\"bench\":\"api\",\"op\":\"" << op << "\",\"order\":\"" << key_order_name(key_order)
+              << "\",\"key\":\"" << key_name << "\",\"N\":" << N << ",\"size\":" << size << ","
+              << measured_json(measured) << ",\"bytes_per_key\":" << std::fixed << std::setprecision(1)
+              << bytes_per_key << "}" << std::endl;
+  };
+  print("insert", insert);
+  print("find", find);
+  print("range", range);
+  print("delete", erase);
+}
+
+template <typename KeyType> void suite_key_type(std::size_t size, const std::string& key_name) {
+  for (KeyOrder key_order : {KeyOrder::Sequential, KeyOrder::Reverse, KeyOrder::Random, KeyOrder::Zipfian}) {
+    suite_point<KeyType, 16>(size, key_order, key_name);
+    suite_point<KeyType, 64>(size, key_order, key_name);
+    suite_point<KeyType, 256>(size, key_order, key_name);
+  }
+}
+
+// Sizes 1K, 10K, ... up to count, so ./btree_bench 100000000 suite goes all the way to 100M keys.
+void bench_suite(std::size_t count) {
+  print_suite_header("suite", count);
+  for (std::size_t size = 1000; size <= count; size *= 10) {
+    // 32 bit keys only go up to 4G, which is plenty here.
+    suite_key_type<std::uint32_t>(size, "uint32");
+    suite_key_type<std::uint64_t>(size, "uint64");
+  }
+}
+
+// The YCSB core workloads on count records with hashed 64 bit keys (record i is mix64(i)), count operations each, on a
+// freshly loaded tree every time:
+//   A  50% read, 50% update                    zipfian
+//   B  95% read,  5% update                    zipfian
+//   C  100% read                               zipfian
+//   D  95% read,  5% insert                    latest (zipfian over how recently a record was inserted)
+//   E  95% scan of 1-100 entries, 5% insert    zipfian scan starts
+//   F  50% read, 50% read-modify-write         zipfian
+// Updates are insert_or_assign, read-modify-write is update(key, fn).
+struct YcsbWorkload {
+  const char* name;
+  double read;
+  double update;
+  double insert;
+  double scan;
+  double read_modify_write;
+  bool latest;
+};
+
+template <std::size_t N> void bench_ycsb_workload(std::size_t count, const YcsbWorkload& workload) {
+  auto page_of = [](std::uint64_t record) { return reinterpret_cast<PageData*>(record * 8 + 8); };
+  std::size_t before = heap_bytes();
+  auto tree = std::make_unique<BTree<std::uint64_t, N>>();
+  Measured load;
+  measure(load, count, [&](std::size_t i) { do_not_optimize(tree->insert(mix64(i), page_of(i))); });
+  double bytes_per_key = static_cast<double>(heap_bytes() - before) / static_cast<double>(count);
+
+  std::mt19937_64 rng(SUITE_SEED);
+  ZipfianGenerator zipf(count, 0.99);
+  std::uniform_real_distribution<double> pick(0.0, 1.0);
+  std::uint64_t records = count;
+  Measured run;
+  measure(run, count, [&](std::size_t) {
+    std::uint64_t rank = zipf(rng);
+    std::uint64_t record = workload.latest ? records - 1 - std::min<std::uint64_t>(rank, records - 1) : rank;
+    std::uint64_t key = mix64(record);
+    double p = pick(rng);
+    if ((p -= workload.read) < 0) {
+      do_not_optimize(tree->find(key).leaf_node);
+    } else if ((p -= workload.update) < 0) {
+      do_not_optimize(tree->insert_or_assign(key, page_of(record)));
+    } else if ((p -= workload.insert) < 0) {
+      do_not_optimize(tree->insert(mix64(records), page_of(records)));
+      records++;
+    } else if ((p -= workload.scan) < 0) {
+      std::size_t length = 1 + rng() % 100;
+      for (auto it = tree->lower_bound(key); it != tree->end() && length > 0; ++it, --length) {
+        do_not_optimize((*it).data);
+      }
+    } else {
+      do_not_optimize(tree->update(key, [&](PageData*) { return page_of(record + 1); }));
+    }
+  });
+
+  std::cout << "{\"bench\":\"ycsb\",\"workload\":\"" << workload.name << "\",\"N\":" << N << ",\"records\":" << count
+            << "," << measured_json(run) << ",\"load_ops_per_sec\":" << std::fixed << std::setprecision(0)
+            << (load.seconds > 0 ? load.ops / load.seconds : 0) << ",\"bytes_per_key\":" << std::setprecision(1)
+            << bytes_per_key << "}" << std::endl;
+}
+
+template <std::size_t N> void bench_ycsb(std::size_t count) {
+  static constexpr YcsbWorkload WORKLOADS[] = {
+      {"A", 0.5, 0.5, 0, 0, 0, false},  {"B", 0.95, 0.05, 0, 0, 0, false}, {"C", 1.0, 0, 0, 0, 0, false},
+      {"D", 0.95, 0, 0.05, 0, 0, true}, {"E", 0, 0, 0.05, 0.95, 0, false}, {"F", 0.5, 0, 0, 0, 0.5, false},
+  };
+  for (const auto& workload : WORKLOADS) {
+    bench_ycsb_workload<N>(count, workload);
+  }
+}
+
+int main(int argc, char** argv) {
+  std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  std::string section = argc > 2 ? argv[2] : "";
+  auto enabled = [&](const std::string& name) { return section.empty() || section == name; };
+
+  // Not part of the default run, these take a while and print JSON lines rather than the table.
+  if (section == "suite") {
+    bench_suite(count);
+  }
+  if (section == "ycsb") {
+    print_suite_header("ycsb", count);
+    bench_ycsb<16>(count);
+    bench_ycsb<64>(count);
+    bench_ycsb<256>(count);
+  }
+
+  if (enabled("bulk_load")) {
+    bench_bulk_load<16>(count);
+    bench_bulk_load<64>(count);
+    bench_bulk_load<256>(count);
+  }
+
+  if (enabled("allocator")) {
+    bench_node_churn<16, HeapNodeAllocator>(count, "heap");
+    bench_node_churn<16, SlabNodeAllocator>(count, "slab");
+    bench_node_churn<64, HeapNodeAllocator>(count, "heap");
+    bench_node_churn<64, SlabNodeAllocator>(count, "slab");
+  }
+
+  if (enabled("find")) {
+    bench_find<std::int32_t, 16>(count, "int32");
+    bench_find<std::int32_t, 64>(count, "int32");
+    bench_find<std::uint64_t, 16>(count, "uint64");
+    bench_find<std::uint64_t, 64>(count, "uint64");
+    bench_find<std::uint64_t, 256>(count, "uint64");
+  }
+
+  if (enabled("update")) {
+    bench_updates<16>(count);
+    bench_updates<64>(count);
+  }
+
+  if (enabled("delete_range")) {
+    bench_delete_range<16>(count);
+    bench_delete_range<64>(count);
+  }
+
+  if (enabled("stats")) {
+    bench_stats<64>(count);
+  }
+
+  if (enabled("append")) {
+    bench_append<16>(count);
+    bench_append<64>(count);
+  }
+
+  if (enabled("churn")) {
+    bench_churn<16>(count);
+    bench_churn<64>(count);
+  }
+
+  if (enabled("compact")) {
+    bench_compact<64, HeapNodeAllocator>(count, "heap");
+    bench_compact<64, SlabNodeAllocator>(count, "slab");
+  }
+
+  if (enabled("parallel")) {
+    bench_parallel<64>(count);
+  }
+
+  if (enabled("node_size")) {
+    bench_node_sizes<std::int32_t>(count, "int32");
+    bench_node_sizes<std::uint64_t>(count, "uint64");
+    bench_node_sizes<double>(count, "double");
+  }
+
+  if (enabled("layout")) {
+    bench_internal_layout<std::uint64_t, 64, SortedInternalLayout>(count, "sorted");
+    bench_internal_layout<std::uint64_t, 64, EytzingerInternalLayout>(count, "eytzinger");
+    bench_internal_layout<std::uint64_t, 256, SortedInternalLayout>(count, "sorted");
+    bench_internal_layout<std::uint64_t, 256, EytzingerInternalLayout>(count, "eytzinger");
+  }
+
+  if (enabled("search")) {
+    bench_key_search_sizes<std::int32_t>(count, "int32");
+    bench_key_search_sizes<std::int64_t>(count, "int64");
+    bench_key_search_sizes<std::uint64_t>(count, "uint64");
+    bench_key_search_sizes<float>(count, "float");
+    bench_key_search_sizes<double>(count, "double");
+  }
+
+  if (enabled("batch")) {
+    bench_find_batch<std::uint64_t, 16, SortedInternalLayout>(count, "sorted");
+    bench_find_batch<std::uint64_t, 64, SortedInternalLayout>(count, "sorted");
+    bench_find_batch<std::uint64_t, 64, EytzingerInternalLayout>(count, "eytzinger");
+  }
+
+  if (enabled("range")) {
+    bench_range_scan<16>(count);
+    bench_range_scan<64>(count);
+  }
+
+  if (enabled("disk")) {
+    bench_disk(count);
+  }
+
+  if (enabled("buffer_pool")) {
+    bench_buffer_pool(count);
+  }
+
+  if (enabled("snapshot")) {
+    bench_snapshot(count);
+  }
+
+  if (enabled("wal")) {
+    bench_wal<64>(count);
+  }
+
+  if (enabled("string")) {
+    bench_string_keys<64, 4096>(count);
+    bench_string_keys<16, 1024>(count);
+  }
+
+  if (enabled("multimap")) {
+    bench_multimap<64>(count);
+  }
+
+  if (enabled("concurrent")) {
+    bench_concurrent<16>(count);
+    bench_concurrent<64>(count);
+  }
+
+  if (enabled("concurrent_scan")) {
+    bench_concurrent_scans<16>(count);
+    bench_concurrent_scans<64>(count);
+  }
+  return 0;
+}
@@ -0,0 +1,367 @@
+#ifndef BTREE_BUFFER_POOL_H
+#define BTREE_BUFFER_POOL_H
+
+#include "btree_page_file.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Eviction policies for BufferPool. A policy tracks the frames that hold a page and has to provide:
+//   Policy(std::size_t frames)
+//   void accessed(std::size_t frame)   - the page in frame was just pinned, either a hit or freshly read in
+//   void removed(std::size_t frame)    - frame doesn't hold a page anymore (evicted or freed)
+//   std::size_t victim(Evictable&&)    - frame to evict, among those evictable(frame) says can go, or the frame count
+//                                        if there's none
+
+// Least recently used, kept as a doubly linked list through the frames.
+class LruEviction {
+public:
+  explicit LruEviction(std::size_t frames) : prev(frames, NONE), next(frames, NONE), listed(frames, false) {}
+
+  void accessed(std::size_t frame) {
+    if (listed[frame]) {
+      unlink(frame);
+    }
+    // Most recent at the head.
+    listed[frame] = true;
+    prev[frame] = NONE;
+    next[frame] = head;
+    if (head != NONE) {
+      prev[head] = frame;
+    }
+    head = frame;
+    if (tail == NONE) {
+      tail = frame;
+    }
+  }
+
+  void removed(std::size_t frame) {
+    if (listed[frame]) {
+      unlink(frame);
+      listed[frame] = false;
+    }
+  }
+
+  template <typename Evictable> std::size_t victim(Evictable&& evictable) const {
+    // Pinned frames are few (the path of the operations in flight), so this rarely walks far.
+    for (std::size_t frame = tail; frame != NONE; frame = prev[frame]) {
+      if (evictable(frame)) {
+        return frame;
+      }
+    }
+    return prev.size();
+  }
+
+private:
+  static constexpr std::size_t NONE = std::numeric_limits<std::size_t>::max();
+
+  std::vector<std::size_t> prev;
+  std::vector<std::size_t> next;
+  std::vector<bool> listed;
+  std::size_t head = NONE;
+  std::size_t tail = NONE;
+
+  void unlink(std::size_t frame) {
+    (prev[frame] != NONE ? next[prev[frame]] : head) = next[frame];
+    (next[frame] != NONE ? prev[next[frame]] : tail) = prev[frame];
+  }
+};
+
+// Second chance: a hand sweeps the frames, a frame accessed since the hand last passed gets its bit cleared and is
+// skipped once. Approximates LRU with a single bit per frame and no list to maintain on every hit.
+class ClockEviction {
+public:
+  explicit ClockEviction(std::size_t frames) : referenced(frames, false), occupied(frames, false) {}
+
+  void accessed(std::size_t frame) {
+    referenced[frame] = true;
+    occupied[frame] = true;
+  }
+
+  void removed(std::size_t frame) {
+    referenced[frame] = false;
+    occupied[frame] = false;
+  }
+
+  template <typename Evictable> std::size_t victim(Evictable&& evictable) {
+    // Two sweeps: the first may only clear bits.
+    for (std::size_t step = 0; step < 2 * occupied.size(); ++step) {
+      std::size_t frame = hand;
+      hand = (hand + 1) % occupied.size();
+      if (!occupied[frame] || !evictable(frame)) {
+        continue;
+      }
+      if (!referenced[frame]) {
+        return frame;
+      }
+      referenced[frame] = false;
+    }
+    return occupied.size();
+  }
+
+private:
+  std::vector<bool> referenced;
+  std::vector<bool> occupied;
+  std::size_t hand = 0;
+};
+
+// LRU-K (O'Neil et al.): evicts the page whose K-th most recent access is the oldest, pages seen fewer than K times
+// going first. A one-off scan touches every page once, so unlike plain LRU it can't push out pages that are used
+// over and over. Picking a victim looks at every frame.
+template <std::size_t K = 2> class LruKEviction {
+public:
+  explicit LruKEviction(std::size_t frames) : history(frames) {}
+
+  void accessed(std::size_t frame) {
+    auto& times = history[frame];
+    std::move_backward(times.begin(), times.end() - 1, times.end());
+    times[0] = ++clock;
+  }
+
+  void removed(std::size_t frame) { history[frame] = {}; }
+
+  template <typename Evictable> std::size_t victim(Evictable&& evictable) const {
+    std::size_t best = history.size();
+    for (std::size_t frame = 0; frame < history.size(); ++frame) {
+      if (history[frame][0] == 0 || !evictable(frame)) {
+        continue;
+      }
+      // 0 for fewer than K accesses, which is the oldest there is. Ties go to the least recently used.
+      if (best == history.size() || std::pair(history[frame][K - 1], history[frame][0]) <
+                                        std::pair(history[best][K - 1], history[best][0])) {
+        best = frame;
+      }
+    }
+    return best;
+  }
+
+private:
+  // Most recent first, 0 for never.
+  std::vector<std::array<std::uint64_t, K>> history;
+  std::uint64_t clock = 0;
+};
+
+struct BufferPoolStats {
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  std::uint64_t evictions = 0;
+  // Dirty pages written back to the file, on eviction or flush.
+  std::uint64_t write_backs = 0;
+};
+
+// Fixed number of page frames in front of a PageFile. A page is read into a frame on first use and stays there until
+// the policy picks it for eviction, written back first if it was changed.
+//
+// Pages are used through PageHandle, which pins the frame for as long as the handle lives: a pinned frame is never
+// evicted. Running out of unpinned frames is treated like an I/O error (the file's failed() flag), so the pool has to
+// have room for every page pinned at once.
+template <typename EvictionPolicy = LruEviction> class BufferPool {
+public:
+  class PageHandle {
+  public:
+    PageHandle() = default;
+    PageHandle(const PageHandle&) = delete;
+    PageHandle& operator=(const PageHandle&) = delete;
+    PageHandle(PageHandle&& other) noexcept { *this = std::move(other); }
+    PageHandle& operator=(PageHandle&& other) noexcept {
+      if (this != &other) {
+        release();
+        pool = std::exchange(other.pool, nullptr);
+        frame = other.frame;
+        page_id = other.page_id;
+      }
+      return *this;
+    }
+    ~PageHandle() { release(); }
+
+    explicit operator bool() const { return pool != nullptr; }
+    PageId id() const { return page_id; }
+    unsigned char* bytes() const { return pool->frame_bytes(frame); }
+
+    // The page has to be written back before its frame is reused.
+    void mark_dirty() { pool->frames[frame].dirty = true; }
+
+    void release() {
+      if (pool != nullptr) {
+        pool->frames[frame].pin_count--;
+        pool = nullptr;
+      }
+    }
+
+  private:
+    friend class BufferPool;
+    PageHandle(BufferPool* pool, std::size_t frame, PageId page_id) : pool(pool), frame(frame), page_id(page_id) {}
+
+    BufferPool* pool = nullptr;
+    std::size_t frame = 0;
+    PageId page_id = NO_PAGE;
+  };
+
+  // Allocates all the frames up front, throws std::bad_alloc if they don't fit.
+  BufferPool(PageFile& file, std::size_t frame_count)
+      : file(file), frames(std::max<std::size_t>(frame_count, 1)), policy(frames.size()),
+        memory(static_cast<unsigned char*>(
+            std::aligned_alloc(PageFile::PAGE_SIZE, frames.size() * PageFile::PAGE_SIZE))) {
+    if (memory == nullptr) {
+      throw std::bad_alloc();
+    }
+    page_table.reserve(frames.size());
+    for (std::size_t frame = frames.size(); frame > 0; --frame) {
+      free_frames.push_back(frame - 1);
+    }
+  }
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+  ~BufferPool() { std::free(memory); }
+
+  // Pins page id, reading it in if it isn't in a frame yet. Empty handle on failure.
+  PageHandle fetch(PageId id);
+  // Allocates a new page in the file and pins it, zeroed and already dirty.
+  PageHandle create();
+  // Drops the page from the pool without writing it back and hands it back to the file. Must not be pinned.
+  void free_page(PageId id);
+
+  // Writes back every dirty page. The file's own sync() makes it durable.
+  bool flush_all();
+  // Forgets every page without writing anything back, e.g. when the file underneath is reopened.
+  void discard_all();
+
+  const BufferPoolStats& stats() const { return counters; }
+  void reset_stats() { counters = {}; }
+  std::size_t frame_count() const { return frames.size(); }
+
+private:
+  struct Frame {
+    PageId page = NO_PAGE;
+    std::uint32_t pin_count = 0;
+    bool dirty = false;
+  };
+
+  PageFile& file;
+  std::vector<Frame> frames;
+  EvictionPolicy policy;
+  unsigned char* memory;
+  std::unordered_map<PageId, std::size_t> page_table;
+  std::vector<std::size_t> free_frames;
+  BufferPoolStats counters;
+
+  unsigned char* frame_bytes(std::size_t frame) const { return memory + frame * PageFile::PAGE_SIZE; }
+
+  // An empty frame, evicting a page if we have to. frames.size() if every frame is pinned.
+  std::size_t take_frame();
+  bool write_back(std::size_t frame);
+};
+
+template <typename EvictionPolicy>
+typename BufferPool<EvictionPolicy>::PageHandle BufferPool<EvictionPolicy>::fetch(PageId id) {
+  if (auto it = page_table.find(id); it != page_table.end()) {
+    counters.hits++;
+    frames[it->second].pin_count++;
+    policy.accessed(it->second);
+    return PageHandle(this, it->second, id);
+  }
+
+  counters.misses++;
+  std::size_t frame = take_frame();
+  if (frame == frames.size() || !file.read(id, frame_bytes(frame))) {
+    if (frame != frames.size()) {
+      free_frames.push_back(frame);
+    }
+    return {};
+  }
+  frames[frame] = {id, 1, false};
+  page_table.emplace(id, frame);
+  policy.accessed(frame);
+  return PageHandle(this, frame, id);
+}
+
+template <typename EvictionPolicy>
+typename BufferPool<EvictionPolicy>::PageHandle BufferPool<EvictionPolicy>::create() {
+  std::size_t frame = take_frame();
+  if (frame == frames.size()) {
+    return {};
+  }
+  PageId id = file.allocate();
+  if (id == NO_PAGE) {
+    free_frames.push_back(frame);
+    return {};
+  }
+  std::memset(frame_bytes(frame), 0, PageFile::PAGE_SIZE);
+  frames[frame] = {id, 1, true};
+  page_table.emplace(id, frame);
+  policy.accessed(frame);
+  return PageHandle(this, frame, id);
+}
+
+template <typename EvictionPolicy> void BufferPool<EvictionPolicy>::free_page(PageId id) {
+  if (auto it = page_table.find(id); it != page_table.end()) {
+    std::size_t frame = it->second;
+    page_table.erase(it);
+    frames[frame] = {};
+    policy.removed(frame);
+    free_frames.push_back(frame);
+  }
+  file.free(id);
+}
+
+template <typename EvictionPolicy> bool BufferPool<EvictionPolicy>::flush_all() {
+  for (std::size_t frame = 0; frame < frames.size(); ++frame) {
+    if (frames[frame].dirty && !write_back(frame)) {
+      return false;
+    }
+  }
+  return !file.failed();
+}
+
+template <typename EvictionPolicy> void BufferPool<EvictionPolicy>::discard_all() {
+  for (std::size_t frame = 0; frame < frames.size(); ++frame) {
+    if (frames[frame].page != NO_PAGE) {
+      policy.removed(frame);
+      free_frames.push_back(frame);
+    }
+    frames[frame] = {};
+  }
+  page_table.clear();
+}
+
+template <typename EvictionPolicy> std::size_t BufferPool<EvictionPolicy>::take_frame() {
+  if (!free_frames.empty()) {
+    std::size_t frame = free_frames.back();
+    free_frames.pop_back();
+    return frame;
+  }
+
+  std::size_t frame = policy.victim([this](std::size_t candidate) { return frames[candidate].pin_count == 0; });
+  if (frame == frames.size()) {
+    // Nothing to evict, every frame is pinned.
+    file.mark_failed();
+    return frame;
+  }
+  if (frames[frame].dirty && !write_back(frame)) {
+    return frames.size();
+  }
+  counters.evictions++;
+  page_table.erase(frames[frame].page);
+  frames[frame] = {};
+  policy.removed(frame);
+  return frame;
+}
+
+template <typename EvictionPolicy> bool BufferPool<EvictionPolicy>::write_back(std::size_t frame) {
+  if (!file.write(frames[frame].page, frame_bytes(frame))) {
+    return false;
+  }
+  frames[frame].dirty = false;
+  counters.write_backs++;
+  return true;
+}
+
+#endif
@@ -0,0 +1,677 @@
+#ifndef BTREE_CONCURRENT_H
+#define BTREE_CONCURRENT_H
+
+#include "btree_epoch.h"
+#include "btree_internal_node.h"
+#include "btree_leaf_node.h"
+#include "btree_optimistic_lock.h"
+#include "btree_types.h"
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// Thread safe BTree using optimistic lock coupling (Leis et al., "The ART of Practical Synchronization"). Every node
+// carries an OptimisticLock.
+//  - find/find_keys_in_range never write shared memory: they walk down reading version numbers and restart whenever a
+//    node they passed through has changed under them.
+//  - insert walks down the same way and only locks what it's about to modify. Full internal nodes are split on the way
+//    down, so a leaf split only ever has to lock the leaf and its parent.
+//  - delete_key locks just the leaf when the key can be removed without an underflow. Otherwise it retries
+//    pessimistically, write locking top-down and letting go of everything above the last node that can't underflow,
+//    then merges/redistributes with the parent and sibling held.
+//
+// Optimistic readers may look at a node while it's being written, so keys have to be trivially copyable; anything they
+// read is thrown away unless the version validates. A reader may also still be on a node that was just unlinked, so
+// every operation pins an epoch (btree_epoch.h) and unlinked nodes are only freed once nobody pinned before the unlink
+// is left.
+template <typename KeyType, std::size_t N> class ConcurrentBTree {
+  static_assert(std::is_trivially_copyable_v<KeyType>, "optimistic readers need trivially copyable keys");
+  static_assert(N >= 4, "splitting full internal nodes on the way down needs at least 4 pointers");
+
+  using Node = BTreeNode<KeyType, N>;
+
+  struct LeafNode : BTreeLeafNode<KeyType, N> {
+    mutable OptimisticLock lock;
+  };
+  struct InternalNode : BTreeInternalNode<KeyType, N> {
+    mutable OptimisticLock lock;
+  };
+
+  std::atomic<Node*> root;
+  mutable EpochManager epochs;
+
+public:
+  ConcurrentBTree() : root(new LeafNode()) {}
+  ConcurrentBTree(const ConcurrentBTree&) = delete;
+  ConcurrentBTree& operator=(const ConcurrentBTree&) = delete;
+  ~ConcurrentBTree();
+
+  [[nodiscard]] LookupResult find(const KeyType& key) const;
+  [[nodiscard]] InsertResult insert(const KeyType& key, PageData* data);
+  [[nodiscard]] DeletionResult delete_key(const KeyType& key);
+  std::vector<KeyType> find_keys_in_range(const KeyType& lower_bound, const KeyType& upper_bound) const;
+
+  // Same checks as BTree::validate. Only meaningful while no other thread is using the tree.
+  [[nodiscard]] bool validate() const;
+
+  // Unlinked nodes still waiting for readers to move on.
+  std::size_t pending_reclamation() const { return epochs.pending(); }
+
+private:
+  static OptimisticLock& lock_of(Node* node) {
+    return node->isLeaf() ? static_cast<LeafNode*>(node)->lock : static_cast<InternalNode*>(node)->lock;
+  }
+
+  bool try_find(const KeyType& key, LookupResult& result) const;
+  bool try_insert(const KeyType& key, PageData* data, InsertResult& result);
+  bool try_delete_optimistic(const KeyType& key, std::optional<DeletionResult>& result);
+  DeletionResult delete_pessimistic(const KeyType& key);
+
+  // Walks down to the leaf that would hold key. Returns nullptr if it has to restart, otherwise the leaf along with the
+  // version it was read at.
+  LeafNode* find_leaf_optimistic(const KeyType& key, std::uint64_t& leaf_version) const;
+
+  void split_internal(InternalNode* node, InternalNode* parent);
+  void split_leaf(LeafNode* leaf, InternalNode* parent, const KeyType& key, PageData* data);
+  void make_root(Node* left, const KeyType& separator, Node* right);
+
+  static bool safe_for_delete(Node* node);
+  void rebalance(std::vector<Node*>& locked);
+  void retire(Node* node);
+  void delete_tree(Node* node);
+
+  bool validate_node(Node* node, const KeyType* lower, const KeyType* upper, std::size_t depth,
+                     std::size_t& leaf_depth, LeafNode*& prev_leaf) const;
+};
+
+template <typename KeyType, std::size_t N> ConcurrentBTree<KeyType, N>::~ConcurrentBTree() {
+  delete_tree(root.load());
+}
+
+template <typename KeyType, std::size_t N> void ConcurrentBTree<KeyType, N>::delete_tree(Node* node) {
+  if (node->isLeaf()) {
+    delete static_cast<LeafNode*>(node);
+    return;
+  }
+  auto* internal = static_cast<InternalNode*>(node);
+  for (std::size_t i = 0; i <= internal->numKeys; ++i) {
+    delete_tree(internal->children[i]);
+  }
+  delete internal;
+}
+
+template <typename KeyType, std::size_t N> void ConcurrentBTree<KeyType, N>::retire(Node* node) {
+  if (node->isLeaf()) {
+    epochs.retire(static_cast<LeafNode*>(node));
+  } else {
+    epochs.retire(static_cast<InternalNode*>(node));
+  }
+}
+
+template <typename KeyType, std::size_t N>
+typename ConcurrentBTree<KeyType, N>::LeafNode*
+ConcurrentBTree<KeyType, N>::find_leaf_optimistic(const KeyType& key, std::uint64_t& leaf_version) const {
+  Node* node = root.load();
+  std::uint64_t version;
+  if (!lock_of(node).read_lock(version) || node != root.load()) {
+    return nullptr;
+  }
+
+  while (!node->isLeaf()) {
+    auto* internal = static_cast<InternalNode*>(node);
+    Node* child = internal->children[internal->child_index(key)];
+    // The child pointer is only trustworthy if the node didn't change while we read it.
+    if (!internal->lock.validate(version)) {
+      return nullptr;
+    }
+    std::uint64_t child_version;
+    if (!lock_of(child).read_lock(child_version)) {
+      return nullptr;
+    }
+    // And the child has to still be the right one now that we hold its version, it could have been split in between.
+    if (!internal->lock.validate(version)) {
+      return nullptr;
+    }
+    node = child;
+    version = child_version;
+  }
+
+  leaf_version = version;
+  return static_cast<LeafNode*>(node);
+}
+
+template <typename KeyType, std::size_t N> LookupResult ConcurrentBTree<KeyType, N>::find(const KeyType& key) const {
+  auto guard = epochs.pin();
+  LookupResult result;
+  while (!try_find(key, result)) {
+  }
+  return result;
+}
+
+template <typename KeyType, std::size_t N>
+bool ConcurrentBTree<KeyType, N>::try_find(const KeyType& key, LookupResult& result) const {
+  std::uint64_t version;
+  LeafNode* leaf = find_leaf_optimistic(key, version);
+  if (leaf == nullptr) {
+    return false;
+  }
+
+  std::size_t count = std::min<std::size_t>(leaf->numKeys, N - 1);
+  std::size_t idx = node_lower_bound<N - 1>(leaf->keys, count, key);
+  bool found = idx != count && leaf->keys[idx] == key;
+  PageData* data = found ? leaf->dataPointers[idx] : nullptr;
+
+  if (!leaf->lock.validate(version)) {
+    return false;
+  }
+  result = {found, data};
+  return true;
+}
+
+template <typename KeyType, std::size_t N>
+InsertResult ConcurrentBTree<KeyType, N>::insert(const KeyType& key, PageData* data) {
+  auto guard = epochs.pin();
+  InsertResult result;
+  while (!try_insert(key, data, result)) {
+  }
+  return result;
+}
+
+template <typename KeyType, std::size_t N>
+bool ConcurrentBTree<KeyType, N>::try_insert(const KeyType& key, PageData* data, InsertResult& result) {
+  Node* node = root.load();
+  std::uint64_t version;
+  if (!lock_of(node).read_lock(version) || node != root.load()) {
+    return false;
+  }
+
+  InternalNode* parent = nullptr;
+  std::uint64_t parent_version = 0;
+
+  while (!node->isLeaf()) {
+    auto* internal = static_cast<InternalNode*>(node);
+
+    // Split full internal nodes on the way down, that way whatever split happens below always finds room in its parent
+    // and never has to lock more than two levels.
+    if (internal->isFull()) {
+      if (parent != nullptr && !parent->lock.try_upgrade(parent_version)) {
+        return false;
+      }
+      if (!internal->lock.try_upgrade(version)) {
+        if (parent != nullptr) parent->lock.write_unlock();
+        return false;
+      }
+      if (parent == nullptr && node != root.load()) {
+        internal->lock.write_unlock();
+        return false;
+      }
+
+      split_internal(internal, parent);
+
+      internal->lock.write_unlock();
+      if (parent != nullptr) parent->lock.write_unlock();
+      return false;
+    }
+
+    if (parent != nullptr && !parent->lock.validate(parent_version)) {
+      return false;
+    }
+
+    parent = internal;
+    parent_version = version;
+
+    node = internal->children[internal->child_index(key)];
+    if (!internal->lock.validate(version)) {
+      return false;
+    }
+    if (!lock_of(node).read_lock(version)) {
+      return false;
+    }
+  }
+
+  auto* leaf = static_cast<LeafNode*>(node);
+
+  if (!leaf->isFull()) {
+    if (!leaf->lock.try_upgrade(version)) {
+      return false;
+    }
+    if (parent != nullptr && !parent->lock.validate(parent_version)) {
+      leaf->lock.write_unlock();
+      return false;
+    }
+    result = leaf->insert_key(key, data);
+    leaf->lock.write_unlock();
+    return true;
+  }
+
+  // Full leaf: the split has to insert a separator into the parent, so take both.
+  if (parent != nullptr && !parent->lock.try_upgrade(parent_version)) {
+    return false;
+  }
+  if (!leaf->lock.try_upgrade(version)) {
+    if (parent != nullptr) parent->lock.write_unlock();
+    return false;
+  }
+  if (parent == nullptr && node != root.load()) {
+    leaf->lock.write_unlock();
+    return false;
+  }
+
+  // Duplicates are rejected before the leaf is considered full.
+  result = leaf->insert_key(key, data);
+  if (result == InsertResult::Full) {
+    split_leaf(leaf, parent, key, data);
+    result = InsertResult::Success;
+  }
+
+  leaf->lock.write_unlock();
+  if (parent != nullptr) parent->lock.write_unlock();
+  return true;
+}
+
+// Both node and parent (if any) are write locked. The parent is known not to be full.
+template <typename KeyType, std::size_t N>
+void ConcurrentBTree<KeyType, N>::split_internal(InternalNode* node, InternalNode* parent) {
+  // N - 1 keys: keep the first half, push the middle one up, move the rest to the new right node.
+  std::size_t split_idx = (N - 1) / 2;
+  KeyType promoted_key = node->keys[split_idx];
+
+  auto* sibling = new InternalNode();
+  std::size_t moved = node->numKeys - split_idx - 1;
+  std::ranges::copy(node->keys + split_idx + 1, node->keys + node->numKeys, sibling->keys);
+  std::ranges::copy(node->children + split_idx + 1, node->children + node->numKeys + 1, sibling->children);
+  sibling->numKeys = moved;
+  sibling->keys_changed();
+
+  node->numKeys = split_idx;
+  node->keys_changed();
+
+  if (parent == nullptr) {
+    make_root(node, promoted_key, sibling);
+  } else {
+    parent->insert_key(promoted_key, sibling);
+  }
+}
+
+// Both leaf and parent (if any) are write locked. The parent is known not to be full.
+template <typename KeyType, std::size_t N>
+void ConcurrentBTree<KeyType, N>::split_leaf(LeafNode* leaf, InternalNode* parent, const KeyType& key,
+                                             PageData* data) {
+  auto* right = new LeafNode();
+
+  std::size_t split_idx = N / 2;
+  std::ranges::copy(leaf->keys + split_idx, leaf->keys + leaf->numKeys, right->keys);
+  std::ranges::copy(leaf->dataPointers + split_idx, leaf->dataPointers + leaf->numKeys, right->dataPointers);
+  right->numKeys = leaf->numKeys - split_idx;
+  leaf->numKeys = split_idx;
+
+  if (key >= right->keys[0]) {
+    right->insert_key(key, data);
+  } else {
+    leaf->insert_key(key, data);
+  }
+
+  // Publish the new leaf only once it's complete, scans following right_sibling may get to it immediately.
+  right->right_sibling = leaf->right_sibling;
+  leaf->right_sibling = right;
+
+  if (parent == nullptr) {
+    make_root(leaf, right->keys[0], right);
+  } else {
+    parent->insert_key(right->keys[0], right);
+  }
+}
+
+template <typename KeyType, std::size_t N>
+void ConcurrentBTree<KeyType, N>::make_root(Node* left, const KeyType& separator, Node* right) {
+  auto* new_root = new InternalNode();
+  new_root->keys[0] = separator;
+  new_root->children[0] = left;
+  new_root->children[1] = right;
+  new_root->numKeys = 1;
+  new_root->keys_changed();
+  root.store(new_root);
+}
+
+template <typename KeyType, std::size_t N>
+DeletionResult ConcurrentBTree<KeyType, N>::delete_key(const KeyType& key) {
+  auto guard = epochs.pin();
+  std::optional<DeletionResult> result;
+  while (!try_delete_optimistic(key, result)) {
+  }
+  if (result.has_value()) {
+    return *result;
+  }
+  return delete_pessimistic(key);
+}
+
+// Handles deletes that don't need any restructuring by locking only the leaf. Leaves result empty when the leaf would
+// underflow, in which case the caller goes the pessimistic route.
+template <typename KeyType, std::size_t N>
+bool ConcurrentBTree<KeyType, N>::try_delete_optimistic(const KeyType& key, std::optional<DeletionResult>& result) {
+  std::uint64_t version;
+  LeafNode* leaf = find_leaf_optimistic(key, version);
+  if (leaf == nullptr || !leaf->lock.try_upgrade(version)) {
+    return false;
+  }
+
+  std::size_t idx = node_lower_bound<N - 1>(leaf->keys, leaf->numKeys, key);
+  if (idx == leaf->numKeys || leaf->keys[idx] != key) {
+    result = DeletionResult::KeyNotFound;
+  } else if (leaf == root.load() || safe_for_delete(leaf)) {
+    leaf->delete_key(key);
+    result = DeletionResult::Success;
+  }
+
+  leaf->lock.write_unlock();
+  return true;
+}
+
+// Whether node can lose one entry without underflowing.
+template <typename KeyType, std::size_t N> bool ConcurrentBTree<KeyType, N>::safe_for_delete(Node* node) {
+  if (node->isLeaf()) {
+    return node->numKeys > N / 2;
+  }
+  return node->numKeys >= (N + 1) / 2;
+}
+
+template <typename KeyType, std::size_t N>
+DeletionResult ConcurrentBTree<KeyType, N>::delete_pessimistic(const KeyType& key) {
+  // Every node from the topmost one that might have to change down to the leaf, all write locked.
+  std::vector<Node*> locked;
+
+  while (true) {
+    Node* node = root.load();
+    if (!lock_of(node).write_lock()) {
+      continue;
+    }
+    if (node != root.load()) {
+      lock_of(node).write_unlock();
+      continue;
+    }
+    locked.push_back(node);
+    break;
+  }
+
+  Node* node = locked.back();
+  while (!node->isLeaf()) {
+    auto* internal = static_cast<InternalNode*>(node);
+    Node* child = internal->children[internal->child_index(key)];
+    // Can't be obsolete, unlinking it would need the parent we're holding.
+    lock_of(child).write_lock();
+
+    if (safe_for_delete(child)) {
+      for (Node* ancestor : locked) {
+        lock_of(ancestor).write_unlock();
+      }
+      locked.clear();
+    }
+    locked.push_back(child);
+    node = child;
+  }
+
+  auto* leaf = static_cast<LeafNode*>(node);
+  DeletionResult result = DeletionResult::KeyNotFound;
+  if (leaf->delete_key(key)) {
+    result = DeletionResult::Success;
+    rebalance(locked);
+  }
+
+  for (Node* held : locked) {
+    if (held != nullptr) {
+      lock_of(held).write_unlock();
+    }
+  }
+  return result;
+}
+
+// Fixes underflows bottom-up along locked, the same way BTree::handle_underflow does. Nodes that get unlinked are
+// released as obsolete and replaced by nullptr in locked.
+template <typename KeyType, std::size_t N> void ConcurrentBTree<KeyType, N>::rebalance(std::vector<Node*>& locked) {
+  for (std::size_t i = locked.size() - 1; i > 0; --i) {
+    Node* node = locked[i];
+    auto* parent = static_cast<InternalNode*>(locked[i - 1]);
+
+    bool underflow = node->isLeaf() ? static_cast<LeafNode*>(node)->isUnderflow()
+                                    : static_cast<InternalNode*>(node)->isUnderflow();
+    if (!underflow) {
+      return;
+    }
+
+    std::size_t node_index = 0;
+    while (parent->children[node_index] != node) {
+      node_index++;
+    }
+    bool sibling_is_left = node_index > 0;
+    std::size_t separator_index = sibling_is_left ? node_index - 1 : node_index;
+    Node* sibling = parent->children[sibling_is_left ? node_index - 1 : node_index + 1];
+    KeyType separator = parent->keys[separator_index];
+    lock_of(sibling).write_lock();
+
+    Node* left = sibling_is_left ? sibling : node;
+    Node* right = sibling_is_left ? node : sibling;
+
+    bool fits = node->isLeaf() ? std::size_t{node->numKeys} + sibling->numKeys <= N - 1
+                               : std::size_t{node->numKeys} + sibling->numKeys + 1 <= N - 1;
+    if (fits) {
+      if (node->isLeaf()) {
+        auto* left_leaf = static_cast<LeafNode*>(left);
+        auto* right_leaf = static_cast<LeafNode*>(right);
+        std::ranges::copy(right_leaf->keys, right_leaf->keys + right_leaf->numKeys, left_leaf->keys + left_leaf->numKeys);
+        std::ranges::copy(right_leaf->dataPointers, right_leaf->dataPointers + right_leaf->numKeys,
+                          left_leaf->dataPointers + left_leaf->numKeys);
+        left_leaf->numKeys += right_leaf->numKeys;
+        left_leaf->right_sibling = right_leaf->right_sibling;
+      } else {
+        auto* left_internal = static_cast<InternalNode*>(left);
+        auto* right_internal = static_cast<InternalNode*>(right);
+        left_internal->keys[left_internal->numKeys] = separator;
+        left_internal->numKeys++;
+        std::ranges::copy(right_internal->keys, right_internal->keys + right_internal->numKeys,
+                          left_internal->keys + left_internal->numKeys);
+        std::ranges::copy(right_internal->children, right_internal->children + right_internal->numKeys + 1,
+                          left_internal->children + left_internal->numKeys);
+        left_internal->numKeys += right_internal->numKeys;
+        left_internal->keys_changed();
+      }
+
+      parent->delete_entry(separator, right);
+
+      // The right node is gone. If that was node, the surviving left one is the sibling and we're done with it,
+      // otherwise node survives and stays locked in `locked`.
+      lock_of(right).write_unlock_obsolete();
+      retire(right);
+      if (right == node) {
+        locked[i] = nullptr;
+        lock_of(left).write_unlock();
+      }
+
+      if (parent == root.load() && parent->numKeys == 0) {
+        root.store(left);
+        parent->lock.write_unlock_obsolete();
+        retire(parent);
+        locked[i - 1] = nullptr;
+        return;
+      }
+      continue;
+    }
+
+    // Can't merge, so borrow one entry from the sibling instead.
+    if (node->isLeaf()) {
+      auto* leaf = static_cast<LeafNode*>(node);
+      auto* sibling_leaf = static_cast<LeafNode*>(sibling);
+      if (sibling_is_left) {
+        std::size_t borrow_idx = sibling_leaf->numKeys - 1;
+        std::ranges::move_backward(leaf->keys, leaf->keys + leaf->numKeys, leaf->keys + leaf->numKeys + 1);
+        std::ranges::move_backward(leaf->dataPointers, leaf->dataPointers + leaf->numKeys,
+                                   leaf->dataPointers + leaf->numKeys + 1);
+        leaf->keys[0] = sibling_leaf->keys[borrow_idx];
+        leaf->dataPointers[0] = sibling_leaf->dataPointers[borrow_idx];
+        leaf->numKeys++;
+        sibling_leaf->numKeys--;
+        parent->keys[separator_index] = leaf->keys[0];
+      } else {
+        leaf->keys[leaf->numKeys] = sibling_leaf->keys[0];
+        leaf->dataPointers[leaf->numKeys] = sibling_leaf->dataPointers[0];
+        leaf->numKeys++;
+        std::ranges::copy(sibling_leaf->keys + 1, sibling_leaf->keys + sibling_leaf->numKeys, sibling_leaf->keys);
+        std::ranges::copy(sibling_leaf->dataPointers + 1, sibling_leaf->dataPointers + sibling_leaf->numKeys,
+                          sibling_leaf->dataPointers);
+        sibling_leaf->numKeys--;
+        parent->keys[separator_index] = sibling_leaf->keys[0];
+      }
+    } else {
+      auto* internal = static_cast<InternalNode*>(node);
+      auto* sibling_internal = static_cast<InternalNode*>(sibling);
+      if (sibling_is_left) {
+        std::ranges::move_backward(internal->keys, internal->keys + internal->numKeys,
+                                   internal->keys + internal->numKeys + 1);
+        std::ranges::move_backward(internal->children, internal->children + internal->numKeys + 1,
+                                   internal->children + internal->numKeys + 2);
+        internal->keys[0] = separator;
+        internal->children[0] = sibling_internal->children[sibling_internal->numKeys];
+        internal->numKeys++;
+        parent->keys[separator_index] = sibling_internal->keys[sibling_internal->numKeys - 1];
+        sibling_internal->numKeys--;
+      } else {
+        internal->keys[internal->numKeys] = separator;
+        internal->children[internal->numKeys + 1] = sibling_internal->children[0];
+        internal->numKeys++;
+        parent->keys[separator_index] = sibling_internal->keys[0];
+        std::ranges::copy(sibling_internal->keys + 1, sibling_internal->keys + sibling_internal->numKeys,
+                          sibling_internal->keys);
+        std::ranges::copy(sibling_internal->children + 1, sibling_internal->children + sibling_internal->numKeys + 1,
+                          sibling_internal->children);
+        sibling_internal->numKeys--;
+      }
+      internal->keys_changed();
+      sibling_internal->keys_changed();
+    }
+    parent->keys_changed();
+    lock_of(sibling).write_unlock();
+    return;
+  }
+}
+
+// Find keys in range: [lower_bound, upper_bound). Copies one leaf at a time and only keeps the copy if the leaf's
+// version didn't move. If the next leaf got unlinked before we could get to it, we go back down the tree to the first
+// key after the last one we've emitted.
+template <typename KeyType, std::size_t N>
+std::vector<KeyType> ConcurrentBTree<KeyType, N>::find_keys_in_range(const KeyType& lower_bound,
+                                                                     const KeyType& upper_bound) const {
+  // Pinned for the whole scan, so a leaf we got to through right_sibling stays readable even if it's unlinked right
+  // after. Its version tells us whether what we read from it counts.
+  auto guard = epochs.pin();
+  std::vector<KeyType> result;
+  std::optional<KeyType> last_emitted;
+
+  while (true) {
+    const KeyType& from = last_emitted.has_value() ? *last_emitted : lower_bound;
+    std::uint64_t version;
+    LeafNode* leaf = find_leaf_optimistic(from, version);
+    if (leaf == nullptr) {
+      continue;
+    }
+
+    while (true) {
+      KeyType batch[N - 1];
+      std::size_t batch_size = 0;
+      bool done = false;
+
+      std::size_t count = std::min<std::size_t>(leaf->numKeys, N - 1);
+      for (std::size_t i = 0; i < count; ++i) {
+        const KeyType key = leaf->keys[i];
+        if (key < lower_bound || (last_emitted.has_value() && !(*last_emitted < key))) {
+          continue;
+        }
+        if (!(key < upper_bound)) {
+          done = true;
+          break;
+        }
+        batch[batch_size++] = key;
+      }
+      LeafNode* next = static_cast<LeafNode*>(leaf->right_sibling);
+
+      if (!leaf->lock.validate(version)) {
+        break;
+      }
+
+      result.insert(result.end(), batch, batch + batch_size);
+      if (batch_size > 0) {
+        last_emitted = batch[batch_size - 1];
+      }
+      if (done || next == nullptr) {
+        return result;
+      }
+
+      // Hand over hand: the leaf we came from must not have changed until we hold next's version. A redistribution
+      // can move next's first keys into it, and we'd step right past them.
+      std::uint64_t next_version;
+      if (!next->lock.read_lock(next_version) || !leaf->lock.validate(version)) {
+        break;
+      }
+      leaf = next;
+      version = next_version;
+    }
+  }
+}
+
+template <typename KeyType, std::size_t N> bool ConcurrentBTree<KeyType, N>::validate() const {
+  std::size_t leaf_depth = 0;
+  LeafNode* prev_leaf = nullptr;
+  if (!validate_node(root.load(), nullptr, nullptr, 0, leaf_depth, prev_leaf)) {
+    return false;
+  }
+  return prev_leaf->right_sibling == nullptr;
+}
+
+template <typename KeyType, std::size_t N>
+bool ConcurrentBTree<KeyType, N>::validate_node(Node* node, const KeyType* lower, const KeyType* upper,
+                                                std::size_t depth, std::size_t& leaf_depth,
+                                                LeafNode*& prev_leaf) const {
+  if (node == nullptr || node->numKeys > N - 1) {
+    return false;
+  }
+
+  const KeyType* keys =
+      node->isLeaf() ? static_cast<LeafNode*>(node)->keys : static_cast<InternalNode*>(node)->keys;
+  for (std::size_t i = 0; i < node->numKeys; ++i) {
+    if (i > 0 && !(keys[i - 1] < keys[i])) return false;
+    if (lower != nullptr && keys[i] < *lower) return false;
+    if (upper != nullptr && !(keys[i] < *upper)) return false;
+  }
+
+  if (node->isLeaf()) {
+    if (node != root.load() && node->numKeys == 0) {
+      return false;
+    }
+    if (leaf_depth == 0) {
+      leaf_depth = depth + 1;
+    } else if (leaf_depth != depth + 1) {
+      return false;
+    }
+    auto* leaf = static_cast<LeafNode*>(node);
+    if (prev_leaf != nullptr && prev_leaf->right_sibling != leaf) {
+      return false;
+    }
+    prev_leaf = leaf;
+    return true;
+  }
+
+  auto* internal = static_cast<InternalNode*>(node);
+  if (internal->numKeys == 0) {
+    return false;
+  }
+  for (std::size_t i = 0; i <= internal->numKeys; ++i) {
+    const KeyType* child_lower = i == 0 ? lower : &internal->keys[i - 1];
+    const KeyType* child_upper = i == internal->numKeys ? upper : &internal->keys[i];
+    if (!validate_node(internal->children[i], child_lower, child_upper, depth + 1, leaf_depth, prev_leaf)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
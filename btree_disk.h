@@ -0,0 +1,596 @@
+#ifndef BTREE_DISK_H
+#define BTREE_DISK_H
+
+#include "btree_buffer_pool.h"
+#include "btree_page_file.h"
+#include "btree_types.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Persistent BTree: every node is one page of a PageFile, and nodes point at each other (and at the data pages of the
+// leaves) by PageId. Opening an existing file only reads its header, the nodes are read as they're visited.
+//
+// Pages go through a BufferPool of a fixed number of frames, nodes are changed in place in their frame and only written
+// to the file when they're evicted, on sync() or on close(). An operation only pins the pages it's working on (at most
+// three at once), the rest of the path down is kept as PageIds and fetched again on the way back up, which is a hit
+// unless something in between pushed it out. Keys are stored as raw bytes, so they have to be trivially copyable.
+
+// Most pointers per node such that both node types still fit in a page.
+template <typename KeyType> constexpr std::size_t disk_fanout() {
+  // Node header plus padding in front of the PageId arrays.
+  constexpr std::size_t OVERHEAD = 24;
+  constexpr std::size_t ENTRY = sizeof(KeyType) + sizeof(PageId);
+  // N - 1 entries plus the sibling link, against N - 1 keys plus N children.
+  constexpr std::size_t leaf = (PageData::PAGE_SIZE - OVERHEAD - sizeof(PageId)) / ENTRY + 1;
+  constexpr std::size_t internal = (PageData::PAGE_SIZE - OVERHEAD + sizeof(KeyType)) / ENTRY;
+  return std::min(leaf, internal);
+}
+
+template <typename KeyType, std::size_t N> struct DiskLeafNode : BTreeNode<KeyType, N> {
+  PageId right_sibling = NO_PAGE;
+  KeyType keys[N - 1];
+  // Whatever the caller inserted with the key, usually a data page of the same file (see DiskBTree::store_data).
+  PageId values[N - 1];
+
+  DiskLeafNode() : BTreeNode<KeyType, N>(BTreeNodeType::LeafNode) {}
+};
+
+template <typename KeyType, std::size_t N> struct DiskInternalNode : BTreeNode<KeyType, N> {
+  KeyType keys[N - 1];
+  PageId children[N];
+
+  DiskInternalNode() : BTreeNode<KeyType, N>(BTreeNodeType::BranchNode) {}
+};
+
+struct DiskLookupResult {
+  bool found;
+  PageId value;
+  // The leaf couldn't be read, so found says nothing about the key.
+  bool io_error = false;
+};
+
+template <typename KeyType, std::size_t N = disk_fanout<KeyType>(), typename EvictionPolicy = LruEviction>
+class DiskBTree {
+  static_assert(std::is_trivially_copyable_v<KeyType>, "keys are written to disk as raw bytes");
+  static_assert(N >= 4, "a node has to hold at least 3 keys");
+
+  using LeafNode = DiskLeafNode<KeyType, N>;
+  using InternalNode = DiskInternalNode<KeyType, N>;
+  using Pool = BufferPool<EvictionPolicy>;
+  using Page = typename Pool::PageHandle;
+  static_assert(sizeof(LeafNode) <= PageFile::PAGE_SIZE && sizeof(InternalNode) <= PageFile::PAGE_SIZE,
+                "N is too large for a page");
+
+  // Both node types underflow below the same number of keys: half of N - 1 for leaves, ceil(N / 2) pointers for
+  // internal nodes. Splits leave at least this much on both sides.
+  static constexpr std::size_t MIN_KEYS = (N - 1) / 2;
+
+  // The internal nodes on the way down to a leaf, and which child we took in each. Not pinned.
+  struct Path {
+    PageId nodes[max_tree_height<N>()];
+    std::size_t child[max_tree_height<N>()];
+    std::size_t depth = 0;
+  };
+
+public:
+  // 4MB worth of pages.
+  static constexpr std::size_t DEFAULT_POOL_FRAMES = 1024;
+  // Most pages pinned at once (a rebalance holds the node, its sibling and their parent), plus one for data pages.
+  static constexpr std::size_t MIN_POOL_FRAMES = 4;
+
+  explicit DiskBTree(std::size_t pool_frames = DEFAULT_POOL_FRAMES)
+      : pool(file, std::max(pool_frames, MIN_POOL_FRAMES)) {}
+  DiskBTree(const DiskBTree&) = delete;
+  DiskBTree& operator=(const DiskBTree&) = delete;
+  ~DiskBTree() { close(); }
+
+  // Opens the index at path, or starts a new empty one if there's no file yet.
+  [[nodiscard]] FileResult open(const std::string& path) {
+    close();
+    return file.open(path, layout());
+  }
+  // Writes back whatever is still only in the pool and closes the file.
+  void close() {
+    if (file.is_open()) {
+      pool.flush_all();
+      pool.discard_all();
+      file.close();
+    }
+  }
+  // Makes everything written so far durable.
+  [[nodiscard]] bool sync() { return pool.flush_all() && file.sync(); }
+  // An I/O error happened at some point, results since then can't be trusted.
+  bool failed() const { return file.failed(); }
+
+  [[nodiscard]] DiskLookupResult find(const KeyType& key);
+  // IoError when a page it needed couldn't be read or allocated, failed() is then true as well.
+  [[nodiscard]] InsertResult insert(const KeyType& key, PageId value);
+  // IoError like insert's, the key may then already be gone.
+  [[nodiscard]] DeletionResult delete_key(const KeyType& key);
+  std::vector<KeyType> find_keys_in_range(const KeyType& lower_bound, const KeyType& upper_bound);
+
+  // Calls fn(key, value) for every entry in [lower_bound, upper_bound), in order, until fn returns false.
+  template <typename Fn> void scan(const KeyType& lower_bound, const KeyType& upper_bound, Fn&& fn);
+
+  // Data pages live in the same file and go through the same pool. The tree never looks at them, it just stores the
+  // PageId it's given.
+  PageId store_data(const PageData& data);
+  bool load_data(PageId id, PageData& data);
+  void free_data(PageId id) { pool.free_page(id); }
+
+  const BufferPoolStats& buffer_pool_stats() const { return pool.stats(); }
+  void reset_buffer_pool_stats() { pool.reset_stats(); }
+
+  // Same checks as BTree::validate, plus minimum occupancy.
+  [[nodiscard]] bool validate();
+
+private:
+  PageFile file;
+  Pool pool;
+
+  // What the pages hold, so a file isn't opened as a tree of the wrong key type or fanout.
+  static constexpr std::uint64_t layout() {
+    return key_layout_tag<KeyType>() | N;
+  }
+
+  static const BTreeNode<KeyType, N>& header(const Page& page) {
+    return *std::launder(reinterpret_cast<const BTreeNode<KeyType, N>*>(page.bytes()));
+  }
+  static LeafNode& leaf(const Page& page) { return *std::launder(reinterpret_cast<LeafNode*>(page.bytes())); }
+  static InternalNode& internal(const Page& page) {
+    return *std::launder(reinterpret_cast<InternalNode*>(page.bytes()));
+  }
+  static LeafNode& new_leaf(const Page& page) { return *new (page.bytes()) LeafNode(); }
+  static InternalNode& new_internal(const Page& page) { return *new (page.bytes()) InternalNode(); }
+
+  Page find_leaf(const KeyType& key, Path* path);
+  // False if a page couldn't be read or allocated, the split below is then only half linked in.
+  bool insert_in_parent(Path& path, PageId left, KeyType separator, PageId right);
+  // False if the parent or the sibling couldn't be read, node is then left below its minimum.
+  bool rebalance(Path& path, Page node);
+
+  bool validate_node(PageId id, const KeyType* lower, const KeyType* upper, std::size_t depth, std::size_t& leaf_depth,
+                     PageId& prev_leaf, PageId& expected_next);
+};
+
+// Walks down to the leaf for key and hands it back pinned. Only the node we're in is pinned on the way (plus the child
+// for a moment while we step into it).
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+typename DiskBTree<KeyType, N, EvictionPolicy>::Page
+DiskBTree<KeyType, N, EvictionPolicy>::find_leaf(const KeyType& key, Path* path) {
+  if (file.root() == NO_PAGE) {
+    return {};
+  }
+  Page page = pool.fetch(file.root());
+  while (page && !header(page).isLeaf()) {
+    InternalNode& node = internal(page);
+    std::size_t child = node_upper_bound<N - 1>(node.keys, node.numKeys, key);
+    if (path != nullptr) {
+      path->nodes[path->depth] = page.id();
+      path->child[path->depth] = child;
+      path->depth++;
+    }
+    page = pool.fetch(node.children[child]);
+  }
+  return page;
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+DiskLookupResult DiskBTree<KeyType, N, EvictionPolicy>::find(const KeyType& key) {
+  if (file.root() == NO_PAGE) {
+    return {false, NO_PAGE};
+  }
+  Page page = find_leaf(key, nullptr);
+  if (!page) {
+    return {false, NO_PAGE, true};
+  }
+  LeafNode& node = leaf(page);
+  std::size_t idx = node_lower_bound<N - 1>(node.keys, node.numKeys, key);
+  if (idx != node.numKeys && node.keys[idx] == key) {
+    return {true, node.values[idx]};
+  }
+  return {false, NO_PAGE};
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+InsertResult DiskBTree<KeyType, N, EvictionPolicy>::insert(const KeyType& key, PageId value) {
+  if (file.root() == NO_PAGE) {
+    Page page = pool.create();
+    if (page) {
+      LeafNode& node = new_leaf(page);
+      node.keys[0] = key;
+      node.values[0] = value;
+      node.numKeys = 1;
+      file.set_root(page.id());
+      return InsertResult::Success;
+    }
+    return InsertResult::IoError;
+  }
+
+  Path path;
+  Page page = find_leaf(key, &path);
+  if (!page) {
+    return InsertResult::IoError;
+  }
+  LeafNode& node = leaf(page);
+  std::size_t pos = node_lower_bound<N - 1>(node.keys, node.numKeys, key);
+  if (pos != node.numKeys && node.keys[pos] == key) {
+    return InsertResult::Duplicate;
+  }
+
+  page.mark_dirty();
+  if (node.numKeys < N - 1) {
+    std::copy_backward(node.keys + pos, node.keys + node.numKeys, node.keys + node.numKeys + 1);
+    std::copy_backward(node.values + pos, node.values + node.numKeys, node.values + node.numKeys + 1);
+    node.keys[pos] = key;
+    node.values[pos] = value;
+    node.numKeys++;
+    return InsertResult::Success;
+  }
+
+  // Full, so lay out all N entries in order and split them in half between the leaf and a new right sibling.
+  KeyType keys[N];
+  PageId values[N];
+  std::copy(node.keys, node.keys + pos, keys);
+  std::copy(node.values, node.values + pos, values);
+  keys[pos] = key;
+  values[pos] = value;
+  std::copy(node.keys + pos, node.keys + N - 1, keys + pos + 1);
+  std::copy(node.values + pos, node.values + N - 1, values + pos + 1);
+
+  Page right_page = pool.create();
+  if (!right_page) {
+    return InsertResult::IoError;
+  }
+  LeafNode& right = new_leaf(right_page);
+  constexpr std::size_t left_count = N / 2;
+  std::copy(keys, keys + left_count, node.keys);
+  std::copy(values, values + left_count, node.values);
+  std::copy(keys + left_count, keys + N, right.keys);
+  std::copy(values + left_count, values + N, right.values);
+  node.numKeys = left_count;
+  right.numKeys = N - left_count;
+  right.right_sibling = node.right_sibling;
+  node.right_sibling = right_page.id();
+
+  PageId left_id = page.id();
+  PageId right_id = right_page.id();
+  page.release();
+  right_page.release();
+  return insert_in_parent(path, left_id, keys[left_count], right_id) ? InsertResult::Success : InsertResult::IoError;
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+bool DiskBTree<KeyType, N, EvictionPolicy>::insert_in_parent(Path& path, PageId left, KeyType separator,
+                                                             PageId right) {
+  if (path.depth == 0) {
+    Page page = pool.create();
+    if (!page) {
+      return false;
+    }
+    InternalNode& root = new_internal(page);
+    root.keys[0] = separator;
+    root.children[0] = left;
+    root.children[1] = right;
+    root.numKeys = 1;
+    file.set_root(page.id());
+    return true;
+  }
+
+  path.depth--;
+  std::size_t pos = path.child[path.depth];
+  Page page = pool.fetch(path.nodes[path.depth]);
+  if (!page) {
+    return false;
+  }
+  page.mark_dirty();
+  InternalNode& parent = internal(page);
+
+  if (parent.numKeys < N - 1) {
+    std::copy_backward(parent.keys + pos, parent.keys + parent.numKeys, parent.keys + parent.numKeys + 1);
+    std::copy_backward(parent.children + pos + 1, parent.children + parent.numKeys + 1,
+                       parent.children + parent.numKeys + 2);
+    parent.keys[pos] = separator;
+    parent.children[pos + 1] = right;
+    parent.numKeys++;
+    return true;
+  }
+
+  // N keys and N + 1 children, the middle key moves up and each side keeps the children around it.
+  KeyType keys[N];
+  PageId children[N + 1];
+  std::copy(parent.keys, parent.keys + pos, keys);
+  keys[pos] = separator;
+  std::copy(parent.keys + pos, parent.keys + N - 1, keys + pos + 1);
+  std::copy(parent.children, parent.children + pos + 1, children);
+  children[pos + 1] = right;
+  std::copy(parent.children + pos + 1, parent.children + N, children + pos + 2);
+
+  Page sibling_page = pool.create();
+  if (!sibling_page) {
+    return false;
+  }
+  InternalNode& sibling = new_internal(sibling_page);
+  constexpr std::size_t left_count = N / 2;
+  std::copy(keys, keys + left_count, parent.keys);
+  std::copy(children, children + left_count + 1, parent.children);
+  std::copy(keys + left_count + 1, keys + N, sibling.keys);
+  std::copy(children + left_count + 1, children + N + 1, sibling.children);
+  parent.numKeys = left_count;
+  sibling.numKeys = N - 1 - left_count;
+
+  PageId parent_id = page.id();
+  PageId sibling_id = sibling_page.id();
+  page.release();
+  sibling_page.release();
+  return insert_in_parent(path, parent_id, keys[left_count], sibling_id);
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+DeletionResult DiskBTree<KeyType, N, EvictionPolicy>::delete_key(const KeyType& key) {
+  if (file.root() == NO_PAGE) {
+    return DeletionResult::KeyNotFound;
+  }
+  Path path;
+  Page page = find_leaf(key, &path);
+  if (!page) {
+    return DeletionResult::IoError;
+  }
+  LeafNode& node = leaf(page);
+  std::size_t pos = node_lower_bound<N - 1>(node.keys, node.numKeys, key);
+  if (pos == node.numKeys || !(node.keys[pos] == key)) {
+    return DeletionResult::KeyNotFound;
+  }
+  page.mark_dirty();
+  std::copy(node.keys + pos + 1, node.keys + node.numKeys, node.keys + pos);
+  std::copy(node.values + pos + 1, node.values + node.numKeys, node.values + pos);
+  node.numKeys--;
+
+  if (path.depth == 0) {
+    if (node.numKeys == 0) {
+      PageId id = page.id();
+      page.release();
+      pool.free_page(id);
+      file.set_root(NO_PAGE);
+    }
+    return DeletionResult::Success;
+  }
+
+  if (node.numKeys < MIN_KEYS && !rebalance(path, std::move(page))) {
+    return DeletionResult::IoError;
+  }
+  return DeletionResult::Success;
+}
+
+// node (pinned and already changed) is below its minimum. Merge it with a sibling if the two fit in one node, otherwise
+// take one entry over from the sibling. A merge takes an entry out of the parent, which can then underflow in turn.
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+bool DiskBTree<KeyType, N, EvictionPolicy>::rebalance(Path& path, Page node) {
+  path.depth--;
+  std::size_t child = path.child[path.depth];
+  Page parent_page = pool.fetch(path.nodes[path.depth]);
+  if (!parent_page) {
+    return false;
+  }
+  InternalNode& parent = internal(parent_page);
+
+  // Prefer the left sibling, the rightmost child has no right one.
+  bool node_is_left = child == 0;
+  std::size_t separator = node_is_left ? 0 : child - 1;
+  Page sibling = pool.fetch(parent.children[node_is_left ? 1 : child - 1]);
+  if (!sibling) {
+    return false;
+  }
+  node.mark_dirty();
+  sibling.mark_dirty();
+  parent_page.mark_dirty();
+  Page& left_page = node_is_left ? node : sibling;
+  Page& right_page = node_is_left ? sibling : node;
+
+  bool merged = false;
+  if (header(node).isLeaf()) {
+    LeafNode& left = leaf(left_page);
+    LeafNode& right = leaf(right_page);
+    if (std::size_t{left.numKeys} + right.numKeys <= N - 1) {
+      std::copy(right.keys, right.keys + right.numKeys, left.keys + left.numKeys);
+      std::copy(right.values, right.values + right.numKeys, left.values + left.numKeys);
+      left.numKeys += right.numKeys;
+      left.right_sibling = right.right_sibling;
+      merged = true;
+    } else if (node_is_left) {
+      left.keys[left.numKeys] = right.keys[0];
+      left.values[left.numKeys] = right.values[0];
+      left.numKeys++;
+      std::copy(right.keys + 1, right.keys + right.numKeys, right.keys);
+      std::copy(right.values + 1, right.values + right.numKeys, right.values);
+      right.numKeys--;
+      parent.keys[separator] = right.keys[0];
+    } else {
+      std::copy_backward(right.keys, right.keys + right.numKeys, right.keys + right.numKeys + 1);
+      std::copy_backward(right.values, right.values + right.numKeys, right.values + right.numKeys + 1);
+      right.keys[0] = left.keys[left.numKeys - 1];
+      right.values[0] = left.values[left.numKeys - 1];
+      right.numKeys++;
+      left.numKeys--;
+      parent.keys[separator] = right.keys[0];
+    }
+  } else {
+    InternalNode& left = internal(left_page);
+    InternalNode& right = internal(right_page);
+    if (std::size_t{left.numKeys} + right.numKeys + 1 <= N - 1) {
+      // The separator comes down between the two.
+      left.keys[left.numKeys] = parent.keys[separator];
+      std::copy(right.keys, right.keys + right.numKeys, left.keys + left.numKeys + 1);
+      std::copy(right.children, right.children + right.numKeys + 1, left.children + left.numKeys + 1);
+      left.numKeys += right.numKeys + 1;
+      merged = true;
+    } else if (node_is_left) {
+      // Rotate left through the parent.
+      left.keys[left.numKeys] = parent.keys[separator];
+      left.children[left.numKeys + 1] = right.children[0];
+      left.numKeys++;
+      parent.keys[separator] = right.keys[0];
+      std::copy(right.keys + 1, right.keys + right.numKeys, right.keys);
+      std::copy(right.children + 1, right.children + right.numKeys + 1, right.children);
+      right.numKeys--;
+    } else {
+      std::copy_backward(right.keys, right.keys + right.numKeys, right.keys + right.numKeys + 1);
+      std::copy_backward(right.children, right.children + right.numKeys + 1, right.children + right.numKeys + 2);
+      right.keys[0] = parent.keys[separator];
+      right.children[0] = left.children[left.numKeys];
+      right.numKeys++;
+      parent.keys[separator] = left.keys[left.numKeys - 1];
+      left.numKeys--;
+    }
+  }
+
+  if (!merged) {
+    return true;
+  }
+
+  PageId left_id = left_page.id();
+  PageId right_id = right_page.id();
+  node.release();
+  sibling.release();
+  pool.free_page(right_id);
+  std::copy(parent.keys + separator + 1, parent.keys + parent.numKeys, parent.keys + separator);
+  std::copy(parent.children + separator + 2, parent.children + parent.numKeys + 1, parent.children + separator + 1);
+  parent.numKeys--;
+
+  if (path.depth == 0) {
+    // Root with a single child left, that child is the new root.
+    if (parent.numKeys == 0) {
+      PageId parent_id = parent_page.id();
+      parent_page.release();
+      pool.free_page(parent_id);
+      file.set_root(left_id);
+    }
+  } else if (parent.numKeys < MIN_KEYS) {
+    return rebalance(path, std::move(parent_page));
+  }
+  return true;
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+template <typename Fn>
+void DiskBTree<KeyType, N, EvictionPolicy>::scan(const KeyType& lower_bound, const KeyType& upper_bound, Fn&& fn) {
+  Page page = find_leaf(lower_bound, nullptr);
+  if (!page) {
+    return;
+  }
+  std::size_t idx = node_lower_bound<N - 1>(leaf(page).keys, leaf(page).numKeys, lower_bound);
+  while (true) {
+    const LeafNode& node = leaf(page);
+    for (; idx < node.numKeys; ++idx) {
+      if (!(node.keys[idx] < upper_bound) || !fn(node.keys[idx], node.values[idx])) {
+        return;
+      }
+    }
+    if (node.right_sibling == NO_PAGE) {
+      return;
+    }
+    page = pool.fetch(node.right_sibling);
+    if (!page) {
+      return;
+    }
+    idx = 0;
+  }
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+std::vector<KeyType> DiskBTree<KeyType, N, EvictionPolicy>::find_keys_in_range(const KeyType& lower_bound,
+                                                                               const KeyType& upper_bound) {
+  std::vector<KeyType> result;
+  scan(lower_bound, upper_bound, [&](const KeyType& key, PageId) {
+    result.push_back(key);
+    return true;
+  });
+  return result;
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+PageId DiskBTree<KeyType, N, EvictionPolicy>::store_data(const PageData& data) {
+  Page page = pool.create();
+  if (!page) {
+    return NO_PAGE;
+  }
+  std::memcpy(page.bytes(), data.getData(), PageFile::PAGE_SIZE);
+  return page.id();
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+bool DiskBTree<KeyType, N, EvictionPolicy>::load_data(PageId id, PageData& data) {
+  Page page = pool.fetch(id);
+  if (!page) {
+    return false;
+  }
+  std::memcpy(data.getData(), page.bytes(), PageFile::PAGE_SIZE);
+  return true;
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+bool DiskBTree<KeyType, N, EvictionPolicy>::validate() {
+  if (file.root() == NO_PAGE) {
+    return !file.failed();
+  }
+  std::size_t leaf_depth = 0;
+  PageId prev_leaf = NO_PAGE;
+  PageId expected_next = NO_PAGE;
+  return validate_node(file.root(), nullptr, nullptr, 0, leaf_depth, prev_leaf, expected_next) &&
+         expected_next == NO_PAGE && !file.failed();
+}
+
+template <typename KeyType, std::size_t N, typename EvictionPolicy>
+bool DiskBTree<KeyType, N, EvictionPolicy>::validate_node(PageId id, const KeyType* lower, const KeyType* upper,
+                                                          std::size_t depth, std::size_t& leaf_depth,
+                                                          PageId& prev_leaf, PageId& expected_next) {
+  Page page = pool.fetch(id);
+  if (!page) {
+    return false;
+  }
+  const std::size_t count = header(page).numKeys;
+  const bool is_root = depth == 0;
+  if (count > N - 1 || (!is_root && count < MIN_KEYS) || (is_root && count == 0)) {
+    return false;
+  }
+
+  const KeyType* keys = header(page).isLeaf() ? leaf(page).keys : internal(page).keys;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (i > 0 && !(keys[i - 1] < keys[i])) return false;
+    if (lower != nullptr && keys[i] < *lower) return false;
+    if (upper != nullptr && !(keys[i] < *upper)) return false;
+  }
+
+  if (header(page).isLeaf()) {
+    if (prev_leaf == NO_PAGE) {
+      leaf_depth = depth;
+    } else if (leaf_depth != depth || expected_next != id) {
+      return false;
+    }
+    prev_leaf = id;
+    expected_next = leaf(page).right_sibling;
+    return true;
+  }
+
+  // Copy out what we need and unpin, so checking a deep tree doesn't pin a whole path.
+  InternalNode& node = internal(page);
+  std::vector<KeyType> separators(node.keys, node.keys + count);
+  std::vector<PageId> children(node.children, node.children + count + 1);
+  page.release();
+  for (std::size_t i = 0; i <= count; ++i) {
+    const KeyType* child_lower = i == 0 ? lower : &separators[i - 1];
+    const KeyType* child_upper = i == count ? upper : &separators[i];
+    if (!validate_node(children[i], child_lower, child_upper, depth + 1, leaf_depth, prev_leaf, expected_next)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef BTREE_EPOCH_H
+#define BTREE_EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Epoch based reclamation for nodes that were unlinked while optimistic readers might still be looking at them.
+//
+// Every operation on the tree pins the current global epoch for as long as it runs. A node unlinked by a writer is
+// retired, tagged with the epoch at that point, instead of being freed. The global epoch only moves forward once every
+// pinned thread has seen the current one, so by the time it's two past the tag, everyone that could have found the node
+// before it was unlinked has unpinned, and it can be freed.
+//
+// Readers pay one CAS on a slot of their own to pin and one store to unpin, they never wait for writers and writers
+// never wait for them. A reader that stays pinned for a long scan only holds back freeing, not progress.
+class EpochManager {
+public:
+  // Pins the epoch for its lifetime.
+  class Guard {
+  public:
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+    ~Guard() { slot.store(IDLE, std::memory_order_release); }
+
+  private:
+    friend class EpochManager;
+    explicit Guard(std::atomic<std::uint64_t>& slot) : slot(slot) {}
+
+    std::atomic<std::uint64_t>& slot;
+  };
+
+  EpochManager() = default;
+  EpochManager(const EpochManager&) = delete;
+  EpochManager& operator=(const EpochManager&) = delete;
+
+  // Nothing can be pinned anymore once we're being destroyed, so everything still waiting goes.
+  ~EpochManager() {
+    for (const auto& entry : retired) {
+      entry.deleter(entry.ptr);
+    }
+  }
+
+  [[nodiscard]] Guard pin() {
+    std::size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    while (true) {
+      std::uint64_t epoch = global_epoch.load(std::memory_order_acquire);
+      for (std::size_t i = 0; i < MAX_PINNED; ++i) {
+        auto& slot = slots[(start + i) % MAX_PINNED].epoch;
+        std::uint64_t expected = IDLE;
+        // seq_cst so the slot is visible to reclaim() before any node pointer we read afterwards.
+        if (slot.load(std::memory_order_relaxed) == IDLE && slot.compare_exchange_strong(expected, epoch)) {
+          return Guard(slot);
+        }
+      }
+      // More threads inside the tree than slots, wait for one to leave.
+      std::this_thread::yield();
+    }
+  }
+
+  // Frees ptr with `delete` once no pinned thread can still reach it. Must be called after ptr was unlinked.
+  template <typename T> void retire(T* ptr) {
+    std::lock_guard<std::mutex> guard(retired_mutex);
+    retired.push_back({ptr, [](void* p) { delete static_cast<T*>(p); }, global_epoch.load()});
+    if (++retired_since_reclaim >= RECLAIM_INTERVAL) {
+      reclaim_locked();
+    }
+  }
+
+  // Tries to advance the epoch and frees whatever is old enough. retire() does this on its own every so often.
+  void reclaim() {
+    std::lock_guard<std::mutex> guard(retired_mutex);
+    reclaim_locked();
+  }
+
+  // Number of retired pointers not freed yet.
+  std::size_t pending() {
+    std::lock_guard<std::mutex> guard(retired_mutex);
+    return retired.size();
+  }
+
+private:
+  static constexpr std::uint64_t IDLE = 0;
+  static constexpr std::size_t MAX_PINNED = 128;
+  static constexpr std::size_t RECLAIM_INTERVAL = 64;
+
+  struct alignas(64) Slot {
+    std::atomic<std::uint64_t> epoch{IDLE};
+  };
+
+  struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+    std::uint64_t epoch;
+  };
+
+  std::atomic<std::uint64_t> global_epoch{1};
+  Slot slots[MAX_PINNED];
+
+  std::mutex retired_mutex;
+  std::vector<Retired> retired;
+  std::size_t retired_since_reclaim = 0;
+
+  void reclaim_locked() {
+    retired_since_reclaim = 0;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::uint64_t epoch = global_epoch.load();
+    bool everyone_caught_up = true;
+    for (const auto& slot : slots) {
+      std::uint64_t pinned = slot.epoch.load();
+      if (pinned != IDLE && pinned != epoch) {
+        everyone_caught_up = false;
+        break;
+      }
+    }
+    if (everyone_caught_up) {
+      // Only ever called with retired_mutex held, so nobody else is advancing it.
+      global_epoch.store(++epoch);
+    }
+
+    std::erase_if(retired, [epoch](const Retired& entry) {
+      if (entry.epoch + 2 > epoch) {
+        return false;
+      }
+      entry.deleter(entry.ptr);
+      return true;
+    });
+  }
+};
+
+#endif
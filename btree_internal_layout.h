@@ -0,0 +1,82 @@
+#ifndef BTREE_INTERNAL_LAYOUT_H
+#define BTREE_INTERNAL_LAYOUT_H
+
+#include "btree_types.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+
+// How an internal node is searched on the way down to a leaf. The sorted keys array in BTreeInternalNode stays the
+// source of truth for every structural change, a layout only gets to add a search index next to it. The node calls
+// Index::rebuild() whenever its keys change and Index::upper_bound() to pick the child to follow.
+
+// Binary search (or linear scan, see btree_node_search.h) straight over the sorted keys. Adds nothing to the node.
+struct SortedInternalLayout {
+  template <typename KeyType, std::size_t N> class Index {
+  public:
+    void rebuild(const KeyType* /* keys */, std::size_t /* count */) {}
+    void prefetch() const {}
+
+    std::size_t upper_bound(const KeyType* keys, std::size_t count, const KeyType& key) const {
+      return node_upper_bound<N - 1>(keys, count, key);
+    }
+  };
+};
+
+// Keeps a second copy of the keys in Eytzinger (breadth first) order. The first levels of the implicit search tree
+// share the first cache line, and a cache line's worth of descendants a few levels below any position are contiguous,
+// so the search can prefetch them while it's still comparing, instead of taking a dependent miss every other step like
+// a binary search over a wide node. Costs a second copy of the keys plus a small index per key in every internal node,
+// rebuilt on every change to the node, which is a good trade for read-mostly trees.
+struct EytzingerInternalLayout {
+  template <typename KeyType, std::size_t N> class Index {
+  public:
+    // 1-based, position 0 is unused.
+    KeyType eytzinger[N];
+    // Position in the sorted keys array of eytzinger[i].
+    NodeCountType<N> sorted_index[N];
+
+    void rebuild(const KeyType* keys, std::size_t count) {
+      std::size_t next = 0;
+      fill(keys, count, 1, next);
+    }
+
+    // Pull in the top levels of the search tree before we start walking it.
+    void prefetch() const {
+      for (std::size_t line = 0; line < std::min<std::size_t>(PREFETCH_LINES, sizeof(eytzinger) / CACHE_LINE); ++line) {
+        __builtin_prefetch(reinterpret_cast<const char*>(eytzinger) + line * CACHE_LINE);
+      }
+    }
+
+    std::size_t upper_bound(const KeyType* /* keys */, std::size_t count, const KeyType& key) const {
+      std::size_t k = 1;
+      while (k <= count) {
+        __builtin_prefetch(eytzinger + std::min(k * KEYS_PER_LINE, N - 1));
+        k = 2 * k + static_cast<std::size_t>(!(key < eytzinger[k]));
+      }
+      // Every right turn appended a 1 bit, the last left turn is where the answer is. Strip the trailing right turns
+      // and that left turn to get back to it, 0 means we only ever went right.
+      k >>= std::countr_one(k) + 1;
+      return k == 0 ? count : sorted_index[k];
+    }
+
+  private:
+    static constexpr std::size_t CACHE_LINE = 64;
+    static constexpr std::size_t KEYS_PER_LINE = std::max<std::size_t>(CACHE_LINE / sizeof(KeyType), 1);
+    static constexpr std::size_t PREFETCH_LINES = 2;
+
+    // In-order walk of the implicit tree hands out the sorted keys in order.
+    void fill(const KeyType* keys, std::size_t count, std::size_t k, std::size_t& next) {
+      if (k > count) {
+        return;
+      }
+      fill(keys, count, 2 * k, next);
+      eytzinger[k] = keys[next];
+      sorted_index[k] = static_cast<NodeCountType<N>>(next);
+      next++;
+      fill(keys, count, 2 * k + 1, next);
+    }
+  };
+};
+
+#endif
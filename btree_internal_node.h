@@ -1,13 +1,16 @@
 #ifndef BTREE_INTERNAL_NODE_H
 #define BTREE_INTERNAL_NODE_H
 
+#include "btree_internal_layout.h"
 #include "btree_types.h"
 #include <algorithm>
 #include <ranges>
 
 // Internal node can be root or branch, contains pointers to child nodes.
-// Keys are of type KeyType, and a max capacity of N pointers.
-template <typename KeyType, std::size_t N> class BTreeInternalNode : public BTreeNode<KeyType, N> {
+// Keys are of type KeyType, and a max capacity of N pointers. Layout decides how the node is searched when descending,
+// see btree_internal_layout.h.
+template <typename KeyType, std::size_t N, typename Layout = SortedInternalLayout>
+class alignas(NODE_ALIGNMENT) BTreeInternalNode : public BTreeNode<KeyType, N> {
 public:
   BTreeInternalNode() : BTreeNode<KeyType, N>(BTreeNodeType::BranchNode) {
     for (std::size_t i = 0; i < N; ++i) {
@@ -15,14 +18,22 @@ public:
     }
   }
 
-  BTreeNode<KeyType, N>* children[N];
+  // Keys come first so they sit right behind the header, this way N - 1 keys plus the header line up with the end of
+  // a cache line for 4 byte keys too.
   KeyType keys[N - 1];
+  BTreeNode<KeyType, N>* children[N];
+  [[no_unique_address]] typename Layout::template Index<KeyType, N> search_index;
+
+  bool isFull() const { return this->numKeys >= (N - 1); }
+
+  // Index of the child whose subtree holds key.
+  std::size_t child_index(const KeyType& key) const { return search_index.upper_bound(keys, this->numKeys, key); }
 
-  bool isFull() const override { return this->numKeys >= (N - 1); }
-  bool isLeaf() const override { return false; }
+  // Has to be called after keys are changed directly instead of through insert_key/delete_entry.
+  void keys_changed() { search_index.rebuild(keys, this->numKeys); }
   
   // Check if node has fewer than minimum required pointers (underflow condition)
-  bool isUnderflow() const { return (this->numKeys + 1) < (N + 1) / 2; }  // ceil(N/2) pointers
+  bool isUnderflow() const { return (std::size_t{this->numKeys} + 1) < (N + 1) / 2; }  // ceil(N/2) pointers
 
   InsertResult insert_key(const KeyType& key, BTreeNode<KeyType, N>* node);
   
@@ -32,9 +43,9 @@ public:
 
 // Key is inserted with a pointer, we go with index i for key, and i + 1 for the pointer. Likely will populate the first
 // pointer when creating the node or something. Not sure right now.
-template <typename KeyType, std::size_t N>
-InsertResult BTreeInternalNode<KeyType, N>::insert_key(const KeyType& key, BTreeNode<KeyType, N>* node) {
-  const InsertPosition pos = find_index_greater_than_or_equal(std::span<const KeyType>(keys, this->numKeys), key);
+template <typename KeyType, std::size_t N, typename Layout>
+InsertResult BTreeInternalNode<KeyType, N, Layout>::insert_key(const KeyType& key, BTreeNode<KeyType, N>* node) {
+  const InsertPosition pos = find_index_greater_than_or_equal<N - 1>(std::span<const KeyType>(keys, this->numKeys), key);
   if (pos.is_duplicate) {
     return InsertResult::Duplicate;
   }
@@ -49,19 +60,18 @@ InsertResult BTreeInternalNode<KeyType, N>::insert_key(const KeyType& key, BTree
   keys[pos.index] = key;
   children[pos.index + 1] = node;
   this->numKeys++;
+  keys_changed();
 
   return InsertResult::Success;
 }
 
 // Delete a key and its associated child pointer from internal node
-template <typename KeyType, std::size_t N>
-void BTreeInternalNode<KeyType, N>::delete_entry(const KeyType& key, BTreeNode<KeyType, N>* /* child */) {
+template <typename KeyType, std::size_t N, typename Layout>
+void BTreeInternalNode<KeyType, N, Layout>::delete_entry(const KeyType& key, BTreeNode<KeyType, N>* /* child */) {
   // Find the key to delete
-  auto it = std::ranges::lower_bound(keys, keys + this->numKeys, key);
-  
-  if (it != keys + this->numKeys && *it == key) {
-    std::size_t key_pos = std::distance(keys, it);
-    
+  std::size_t key_pos = node_lower_bound<N - 1>(keys, this->numKeys, key);
+
+  if (key_pos != this->numKeys && keys[key_pos] == key) {
     // Find the child pointer position (it's at key_pos + 1)
     std::size_t child_pos = key_pos + 1;
     
@@ -72,6 +82,7 @@ void BTreeInternalNode<KeyType, N>::delete_entry(const KeyType& key, BTreeNode<K
     std::ranges::copy(children + child_pos + 1, children + this->numKeys + 1, children + child_pos);
     
     this->numKeys--;
+    keys_changed();
   }
 }
 
@@ -0,0 +1,156 @@
+#ifndef BTREE_ITERATOR_H
+#define BTREE_ITERATOR_H
+
+#include "btree_internal_node.h"
+#include "btree_leaf_node.h"
+#include "btree_types.h"
+#include <cstddef>
+#include <iterator>
+
+// What iterating a BTree hands out. The key is a reference into the leaf, so scanning never copies (or allocates for)
+// keys.
+template <typename KeyType> struct BTreeEntry {
+  const KeyType& key;
+  PageData* data;
+};
+
+// Walks the (key, PageData*) entries of a BTree in key order, straight off the leaves. Going forward follows
+// right_sibling. Leaves don't point back, so stepping back past the start of a leaf goes down from the root again to
+// the leaf before it, once per leaf. Nothing is allocated either way.
+//
+// Like any iterator into the tree it's invalidated by insert/delete.
+template <typename KeyType, std::size_t N, typename InternalLayout, std::size_t LeafN = N> class BTreeIterator {
+  using Node = BTreeNode<KeyType, N>;
+  using LeafNode = BTreeLeafNode<KeyType, N, LeafN>;
+  using InternalNode = BTreeInternalNode<KeyType, N, InternalLayout>;
+
+public:
+  using iterator_concept = std::bidirectional_iterator_tag;
+  // Dereferencing hands out an entry by value, which only makes this an input iterator to pre-C++20 algorithms.
+  using iterator_category = std::input_iterator_tag;
+  using value_type = BTreeEntry<KeyType>;
+  using reference = BTreeEntry<KeyType>;
+  using difference_type = std::ptrdiff_t;
+
+  BTreeIterator() = default;
+
+  // The first entry whose key is >= key (or > key for upper_bound).
+  static BTreeIterator lower_bound(const Node* root, const KeyType& key) {
+    const LeafNode* leaf = leaf_for_key(root, key);
+    if (leaf == nullptr) {
+      return BTreeIterator(root);
+    }
+    return BTreeIterator(root, leaf, node_lower_bound<LeafN - 1>(leaf->keys, leaf->numKeys, key));
+  }
+  static BTreeIterator upper_bound(const Node* root, const KeyType& key) {
+    const LeafNode* leaf = leaf_for_key(root, key);
+    if (leaf == nullptr) {
+      return BTreeIterator(root);
+    }
+    return BTreeIterator(root, leaf, node_upper_bound<LeafN - 1>(leaf->keys, leaf->numKeys, key));
+  }
+  static BTreeIterator first(const Node* root) {
+    if (root == nullptr) {
+      return BTreeIterator(root);
+    }
+    while (!root->isLeaf()) {
+      root = static_cast<const InternalNode*>(root)->children[0];
+    }
+    return BTreeIterator(root, static_cast<const LeafNode*>(root), 0);
+  }
+  static BTreeIterator past_end(const Node* root) { return BTreeIterator(root); }
+
+  reference operator*() const { return {leaf->keys[idx], leaf->dataPointers[idx]}; }
+
+  BTreeIterator& operator++() {
+    idx++;
+    skip_exhausted_leaves();
+    return *this;
+  }
+  BTreeIterator operator++(int) {
+    BTreeIterator before = *this;
+    ++*this;
+    return before;
+  }
+
+  BTreeIterator& operator--() {
+    while (idx == 0) {
+      leaf = leaf == nullptr ? last_leaf() : previous_leaf();
+      idx = leaf->numKeys;
+    }
+    idx--;
+    return *this;
+  }
+  BTreeIterator operator--(int) {
+    BTreeIterator before = *this;
+    --*this;
+    return before;
+  }
+
+  friend bool operator==(const BTreeIterator& a, const BTreeIterator& b) { return a.leaf == b.leaf && a.idx == b.idx; }
+
+private:
+  const Node* root = nullptr;
+  // nullptr once we're past the last entry.
+  const LeafNode* leaf = nullptr;
+  std::size_t idx = 0;
+
+  explicit BTreeIterator(const Node* root) : root(root) {}
+  BTreeIterator(const Node* root, const LeafNode* leaf, std::size_t idx) : root(root), leaf(leaf), idx(idx) {
+    skip_exhausted_leaves();
+  }
+
+  // Keeps end() unique: an iterator never sits one past the last key of a leaf, it moves on to the next leaf instead.
+  void skip_exhausted_leaves() {
+    while (leaf != nullptr && idx >= leaf->numKeys) {
+      leaf = leaf->right_sibling;
+      idx = 0;
+    }
+  }
+
+  static const LeafNode* leaf_for_key(const Node* node, const KeyType& key) {
+    if (node == nullptr) {
+      return nullptr;
+    }
+    while (!node->isLeaf()) {
+      auto* internal = static_cast<const InternalNode*>(node);
+      node = internal->children[internal->child_index(key)];
+    }
+    return static_cast<const LeafNode*>(node);
+  }
+
+  const LeafNode* last_leaf() const {
+    const Node* node = root;
+    while (!node->isLeaf()) {
+      auto* internal = static_cast<const InternalNode*>(node);
+      node = internal->children[internal->numKeys];
+    }
+    return static_cast<const LeafNode*>(node);
+  }
+
+  // Goes down to our leaf again, remembering the lowest node where we didn't take the leftmost child. The leaf before
+  // ours is the rightmost one under the child just left of that.
+  const LeafNode* previous_leaf() const {
+    const Node* node = root;
+    const InternalNode* branch = nullptr;
+    std::size_t branch_child = 0;
+    while (!node->isLeaf()) {
+      auto* internal = static_cast<const InternalNode*>(node);
+      std::size_t child = internal->child_index(leaf->keys[0]);
+      if (child > 0) {
+        branch = internal;
+        branch_child = child - 1;
+      }
+      node = internal->children[child];
+    }
+
+    node = branch->children[branch_child];
+    while (!node->isLeaf()) {
+      auto* internal = static_cast<const InternalNode*>(node);
+      node = internal->children[internal->numKeys];
+    }
+    return static_cast<const LeafNode*>(node);
+  }
+};
+
+#endif
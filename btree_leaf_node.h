@@ -3,26 +3,31 @@
 
 #include "btree_types.h"
 #include <algorithm>
+#include <limits>
 #include <ranges>
 
 // Leaf node, contains key-pointer pairs pointing to PageData, and pointers to their right sibling.
-template <typename KeyType, std::size_t N> class BTreeLeafNode : public BTreeNode<KeyType, N> {
+// N is the tree's order and only picks the header shared with internal nodes. The leaf's own capacity is LeafN - 1
+// entries, which is N - 1 unless the tree sizes leaves and internal nodes separately (see NodeFanout in btree.h).
+template <typename KeyType, std::size_t N, std::size_t LeafN>
+class alignas(NODE_ALIGNMENT) BTreeLeafNode : public BTreeNode<KeyType, N> {
+  static_assert(LeafN - 1 <= std::numeric_limits<NodeCountType<N>>::max(), "leaf entry count doesn't fit the header");
+
 public:
-  KeyType keys[N - 1];
-  PageData* dataPointers[N - 1];
-  BTreeLeafNode<KeyType, N>* right_sibling;
+  KeyType keys[LeafN - 1];
+  PageData* dataPointers[LeafN - 1];
+  BTreeLeafNode<KeyType, N, LeafN>* right_sibling;
 
   BTreeLeafNode() : BTreeNode<KeyType, N>(BTreeNodeType::LeafNode), right_sibling(nullptr) {
-    for (std::size_t i = 0; i < N - 1; ++i) {
+    for (std::size_t i = 0; i < LeafN - 1; ++i) {
       dataPointers[i] = nullptr;
     }
   }
 
-  bool isFull() const override { return this->numKeys >= (N - 1); }
-  bool isLeaf() const override { return true; }
+  bool isFull() const { return this->numKeys >= (LeafN - 1); }
   
   // Check if node has fewer than minimum required keys (underflow condition)
-  bool isUnderflow() const { return this->numKeys < (N / 2); }  // ceil((N-1)/2) simplified
+  bool isUnderflow() const { return this->numKeys < (LeafN / 2); }  // ceil((N-1)/2) simplified
 
   InsertResult insert_key(const KeyType& key, PageData* page);
   
@@ -31,16 +36,17 @@ public:
 };
 
 // I'll have to think more on the return types and the API contract for this one maybe
-template <typename KeyType, std::size_t N> InsertResult BTreeLeafNode<KeyType, N>::insert_key(const KeyType& key, PageData* page) {
+template <typename KeyType, std::size_t N, std::size_t LeafN>
+InsertResult BTreeLeafNode<KeyType, N, LeafN>::insert_key(const KeyType& key, PageData* page) {
   // We don't want duplicates
-  const InsertPosition pos = find_index_greater_than_or_equal(std::span<const KeyType>(keys, this->numKeys), key);
+  const InsertPosition pos = find_index_greater_than_or_equal<LeafN - 1>(std::span<const KeyType>(keys, this->numKeys), key);
   // TODO: We need something better maybe?
   if (pos.is_duplicate) {
     return InsertResult::Duplicate;
   }
 
   // If it's full we need a split so we return -1
-  if (this->numKeys >= (N - 1)) {
+  if (this->numKeys >= (LeafN - 1)) {
     return InsertResult::Full;
   }
 
@@ -57,19 +63,16 @@ template <typename KeyType, std::size_t N> InsertResult BTreeLeafNode<KeyType, N
 };
 
 // Delete a key from the leaf node
-template <typename KeyType, std::size_t N>
-bool BTreeLeafNode<KeyType, N>::delete_key(const KeyType& key) {
-  // Find the key using binary search
-  auto it = std::ranges::lower_bound(keys, keys + this->numKeys, key);
-  
+template <typename KeyType, std::size_t N, std::size_t LeafN>
+bool BTreeLeafNode<KeyType, N, LeafN>::delete_key(const KeyType& key) {
+  // Find the position of the key
+  std::size_t pos = node_lower_bound<LeafN - 1>(keys, this->numKeys, key);
+
   // Key not found
-  if (it == keys + this->numKeys || *it != key) {
+  if (pos == this->numKeys || keys[pos] != key) {
     return false;
   }
   
-  // Calculate position of the key to delete
-  std::size_t pos = std::distance(keys, it);
-  
   // Shift keys and data pointers left to remove the key
   std::ranges::copy(keys + pos + 1, keys + this->numKeys, keys + pos);
   std::ranges::copy(dataPointers + pos + 1, dataPointers + this->numKeys, dataPointers + pos);
@@ -0,0 +1,391 @@
+#ifndef BTREE_MULTIMAP_H
+#define BTREE_MULTIMAP_H
+
+#include "btree.h"
+#include <algorithm>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Key of the BTree underneath BTreeMultimap: the user's key, then the value's address to tell apart entries that share
+// the key. Every (key, value) pair is its own entry that way, and all of a key's entries sit next to each other.
+template <typename KeyType> struct MultimapKey {
+  KeyType key;
+  std::uintptr_t value;
+
+  friend auto operator<=>(const MultimapKey&, const MultimapKey&) = default;
+  friend bool operator==(const MultimapKey&, const MultimapKey&) = default;
+};
+
+// Values of one hot key, out of the tree. Sorted chunks of addresses, so it's 8 bytes a value plus a little per chunk,
+// and adding or removing a value only moves what's in its own chunk around.
+class PostingList {
+public:
+  std::size_t size() const { return count; }
+
+  // False if value is already in there.
+  bool insert(std::uintptr_t value) {
+    if (chunks.empty()) {
+      chunks.push_back({value});
+      count++;
+      return true;
+    }
+    auto chunk = chunk_for(value);
+    auto pos = std::ranges::lower_bound(*chunk, value);
+    if (pos != chunk->end() && *pos == value) {
+      return false;
+    }
+    chunk->insert(pos, value);
+    count++;
+    if (chunk->size() > CHUNK_SIZE) {
+      // Half of it goes into a new chunk right after.
+      std::vector<std::uintptr_t> upper(chunk->begin() + CHUNK_SIZE / 2, chunk->end());
+      chunk->resize(CHUNK_SIZE / 2);
+      chunks.insert(chunk + 1, std::move(upper));
+    }
+    return true;
+  }
+
+  bool erase(std::uintptr_t value) {
+    if (chunks.empty()) {
+      return false;
+    }
+    auto chunk = chunk_for(value);
+    auto pos = std::ranges::lower_bound(*chunk, value);
+    if (pos == chunk->end() || *pos != value) {
+      return false;
+    }
+    chunk->erase(pos);
+    count--;
+    if (chunk->empty()) {
+      chunks.erase(chunk);
+    }
+    return true;
+  }
+
+  // Calls fn(value) in order until it returns false. False if fn stopped early.
+  template <typename Fn> bool for_each(Fn&& fn) const {
+    for (const auto& chunk : chunks) {
+      for (std::uintptr_t value : chunk) {
+        if (!fn(value)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  bool validate() const {
+    std::size_t seen = 0;
+    std::uintptr_t previous = 0;
+    for (const auto& chunk : chunks) {
+      if (chunk.empty() || chunk.size() > CHUNK_SIZE) {
+        return false;
+      }
+      for (std::uintptr_t value : chunk) {
+        if (seen > 0 && !(previous < value)) {
+          return false;
+        }
+        previous = value;
+        seen++;
+      }
+    }
+    return seen == count;
+  }
+
+private:
+  static constexpr std::size_t CHUNK_SIZE = 256;
+
+  std::vector<std::vector<std::uintptr_t>> chunks;
+  std::size_t count = 0;
+
+  // The first chunk whose last value is >= value, or the last chunk.
+  std::vector<std::vector<std::uintptr_t>>::iterator chunk_for(std::uintptr_t value) {
+    auto chunk = std::ranges::lower_bound(chunks, value, {}, [](const auto& c) { return c.back(); });
+    return chunk == chunks.end() ? chunks.end() - 1 : chunk;
+  }
+};
+
+// BTree where a key can map to many PageData*, for indexing attributes that aren't unique. A (key, value) pair is only
+// refused as a duplicate if that exact pair is already in there.
+//
+// Up to InlineLimit values of a key are entries of the tree like any other, next to each other in the leaves. Past that
+// the key's values move out into a PostingList and the tree keeps a single entry for the key that points to it, so a
+// very popular key costs one leaf slot instead of splitting leaf after leaf. Once a posting list shrinks to half the
+// limit its values move back into the tree.
+//
+// Values of a key come out ordered by address, keys in key order.
+template <typename KeyType, std::size_t N, std::size_t InlineLimit = 8,
+          template <typename> class NodeAllocator = HeapNodeAllocator, typename InternalLayout = SortedInternalLayout>
+class BTreeMultimap {
+  static_assert(InlineLimit >= 1, "a key needs at least one value inline");
+
+  using Key = MultimapKey<KeyType>;
+  using Tree = BTree<Key, N, NodeAllocator, InternalLayout>;
+
+public:
+  BTreeMultimap() = default;
+  BTreeMultimap(const BTreeMultimap&) = delete;
+  BTreeMultimap& operator=(const BTreeMultimap&) = delete;
+  ~BTreeMultimap();
+
+  // Duplicate only if value is already stored under key.
+  [[nodiscard]] InsertResult insert(const KeyType& key, PageData* value);
+  // Removes one (key, value) pair.
+  [[nodiscard]] DeletionResult delete_key(const KeyType& key, PageData* value);
+  // Removes every value of key, returns how many there were.
+  std::size_t delete_all(const KeyType& key);
+
+  std::size_t count(const KeyType& key) const;
+  // Calls fn(value) for every value of key until fn returns false.
+  template <typename Fn> void find(const KeyType& key, Fn&& fn) const;
+  std::vector<PageData*> find_all(const KeyType& key) const;
+  // Calls fn(key, value) for every pair with a key in [lower_bound, upper_bound), until fn returns false.
+  template <typename Fn> void scan(const KeyType& lower_bound, const KeyType& upper_bound, Fn&& fn) const;
+  // A key shows up once per value.
+  std::vector<KeyType> find_keys_in_range(const KeyType& lower_bound, const KeyType& upper_bound) const;
+
+  // Number of (key, value) pairs.
+  std::size_t size() const { return pairs; }
+  // Keys whose values are in a posting list right now.
+  std::size_t spilled_keys() const { return spilled; }
+
+  // The tree's own checks, plus: a key is either inline with at most InlineLimit values, or has a single entry
+  // pointing to a posting list that holds more than InlineLimit / 2.
+  [[nodiscard]] bool validate() const;
+
+private:
+  // value of the entry that stands for a spilled key. Sorts after every real address, and no PageData lives there.
+  static constexpr std::uintptr_t SPILLED = std::numeric_limits<std::uintptr_t>::max();
+
+  Tree tree;
+  std::size_t pairs = 0;
+  std::size_t spilled = 0;
+
+  static std::uintptr_t address(PageData* value) { return reinterpret_cast<std::uintptr_t>(value); }
+  static PageData* page(std::uintptr_t value) { return reinterpret_cast<PageData*>(value); }
+  static PostingList* posting_list(PageData* data) { return reinterpret_cast<PostingList*>(data); }
+
+  // The key's posting list if it's spilled, otherwise found is how many inline values it has, counting up to limit.
+  PostingList* lookup(const KeyType& key, std::size_t limit, std::size_t& found) const;
+};
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::~BTreeMultimap() {
+  for (auto entry : tree) {
+    if (entry.key.value == SPILLED) {
+      delete posting_list(entry.data);
+    }
+  }
+}
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+PostingList* BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::lookup(const KeyType& key,
+                                                                                            std::size_t limit,
+                                                                                            std::size_t& found) const {
+  found = 0;
+  for (auto it = tree.lower_bound(Key{key, 0}); it != tree.end(); ++it) {
+    auto entry = *it;
+    if (!(entry.key.key == key)) {
+      break;
+    }
+    if (entry.key.value == SPILLED) {
+      return posting_list(entry.data);
+    }
+    if (found == limit) {
+      break;
+    }
+    found++;
+  }
+  return nullptr;
+}
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+InsertResult BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::insert(const KeyType& key,
+                                                                                           PageData* value) {
+  std::size_t found = 0;
+  if (PostingList* list = lookup(key, InlineLimit, found)) {
+    if (!list->insert(address(value))) {
+      return InsertResult::Duplicate;
+    }
+    pairs++;
+    return InsertResult::Success;
+  }
+
+  if (found < InlineLimit || tree.find(Key{key, address(value)}).leaf_node != nullptr) {
+    InsertResult result = tree.insert(Key{key, address(value)}, value);
+    pairs += result == InsertResult::Success;
+    return result;
+  }
+
+  // One value too many for the leaves, move them all out.
+  auto* list = new PostingList();
+  for (auto it = tree.lower_bound(Key{key, 0}); it != tree.end() && (*it).key.key == key; ++it) {
+    list->insert((*it).key.value);
+  }
+  list->for_each([&](std::uintptr_t moved) {
+    (void)tree.delete_key(Key{key, moved});
+    return true;
+  });
+  list->insert(address(value));
+  (void)tree.insert(Key{key, SPILLED}, reinterpret_cast<PageData*>(list));
+  pairs++;
+  spilled++;
+  return InsertResult::Success;
+}
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+DeletionResult BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::delete_key(const KeyType& key,
+                                                                                                 PageData* value) {
+  std::size_t found = 0;
+  PostingList* list = lookup(key, 0, found);
+  if (list == nullptr) {
+    DeletionResult result = tree.delete_key(Key{key, address(value)});
+    pairs -= result == DeletionResult::Success;
+    return result;
+  }
+
+  if (!list->erase(address(value))) {
+    return DeletionResult::KeyNotFound;
+  }
+  pairs--;
+  if (list->size() <= InlineLimit / 2) {
+    // Few enough to go back into the leaves.
+    (void)tree.delete_key(Key{key, SPILLED});
+    list->for_each([&](std::uintptr_t remaining) {
+      (void)tree.insert(Key{key, remaining}, page(remaining));
+      return true;
+    });
+    delete list;
+    spilled--;
+  }
+  return DeletionResult::Success;
+}
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+std::size_t BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::delete_all(const KeyType& key) {
+  std::size_t found = 0;
+  std::size_t removed = 0;
+  if (PostingList* list = lookup(key, 0, found)) {
+    removed = list->size();
+    (void)tree.delete_key(Key{key, SPILLED});
+    delete list;
+    spilled--;
+  } else {
+    for (auto it = tree.lower_bound(Key{key, 0}); it != tree.end() && (*it).key.key == key;
+         it = tree.lower_bound(Key{key, 0})) {
+      Key inline_key = (*it).key;
+      (void)tree.delete_key(inline_key);
+      removed++;
+    }
+  }
+  pairs -= removed;
+  return removed;
+}
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+std::size_t BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::count(const KeyType& key) const {
+  std::size_t found = 0;
+  PostingList* list = lookup(key, std::numeric_limits<std::size_t>::max(), found);
+  return list != nullptr ? list->size() : found;
+}
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+template <typename Fn>
+void BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::find(const KeyType& key, Fn&& fn) const {
+  scan(key, key, [&](const KeyType&, PageData* value) { return fn(value); });
+}
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+std::vector<PageData*> BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::find_all(
+    const KeyType& key) const {
+  std::vector<PageData*> values;
+  find(key, [&](PageData* value) {
+    values.push_back(value);
+    return true;
+  });
+  return values;
+}
+
+// find() passes lower_bound == upper_bound to get just that key, hence the inclusive check of the first key.
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+template <typename Fn>
+void BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::scan(const KeyType& lower_bound,
+                                                                                 const KeyType& upper_bound,
+                                                                                 Fn&& fn) const {
+  const bool single_key = lower_bound == upper_bound;
+  for (auto it = tree.lower_bound(Key{lower_bound, 0}); it != tree.end(); ++it) {
+    auto entry = *it;
+    const KeyType& key = entry.key.key;
+    if (single_key ? !(key == lower_bound) : !(key < upper_bound)) {
+      return;
+    }
+    if (entry.key.value != SPILLED) {
+      if (!fn(key, entry.data)) {
+        return;
+      }
+    } else if (!posting_list(entry.data)->for_each([&](std::uintptr_t value) { return fn(key, page(value)); })) {
+      return;
+    }
+  }
+}
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+std::vector<KeyType> BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::find_keys_in_range(
+    const KeyType& lower_bound, const KeyType& upper_bound) const {
+  std::vector<KeyType> keys;
+  if (!(lower_bound < upper_bound)) {
+    return keys;
+  }
+  scan(lower_bound, upper_bound, [&](const KeyType& key, PageData*) {
+    keys.push_back(key);
+    return true;
+  });
+  return keys;
+}
+
+template <typename KeyType, std::size_t N, std::size_t InlineLimit, template <typename> class NodeAllocator,
+          typename InternalLayout>
+bool BTreeMultimap<KeyType, N, InlineLimit, NodeAllocator, InternalLayout>::validate() const {
+  if (!tree.validate()) {
+    return false;
+  }
+  std::size_t seen_pairs = 0;
+  std::size_t seen_spilled = 0;
+  // Inline values of the current key so far.
+  std::size_t run = 0;
+  const KeyType* previous = nullptr;
+  for (auto entry : tree) {
+    bool same_key = previous != nullptr && *previous == entry.key.key;
+    run = same_key ? run + 1 : 1;
+    previous = &entry.key.key;
+    if (entry.key.value == SPILLED) {
+      const PostingList* list = posting_list(entry.data);
+      if (same_key || !list->validate() || list->size() <= InlineLimit / 2) {
+        return false;
+      }
+      seen_pairs += list->size();
+      seen_spilled++;
+    } else {
+      if (run > InlineLimit || entry.data != page(entry.key.value)) {
+        return false;
+      }
+      seen_pairs++;
+    }
+  }
+  return seen_pairs == pairs && seen_spilled == spilled;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef BTREE_NODE_ALLOCATOR_H
+#define BTREE_NODE_ALLOCATOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Node allocators used by BTree. An allocator is instantiated once per node type and has to provide:
+//   Node* create()              - a default constructed node
+//   void destroy(Node*)         - release a node handed out by create()
+//   void release_all()          - release every node handed out so far, without running destructors
+//   static constexpr bool BULK_RELEASE - whether release_all() actually frees memory, so the tree can skip walking
+//                                        itself on teardown
+// and can provide
+//   Node* create_sequential()   - like create(), but placed right after the node the previous call returned where
+//                                 possible, used by BTree::compact to lay leaves out in key order
+
+// Plain new/delete, one allocation per node.
+template <typename Node> class HeapNodeAllocator {
+public:
+  static constexpr bool BULK_RELEASE = false;
+
+  Node* create() { return new Node(); }
+  void destroy(Node* node) { delete node; }
+  void release_all() {}
+};
+
+// Carves nodes out of page aligned slabs. Every node starts on its own cache line, nodes freed by merges go onto a free
+// list and get handed out again before the slab is bumped any further, and release_all() drops whole slabs at once.
+template <typename Node> class SlabNodeAllocator {
+public:
+  static constexpr bool BULK_RELEASE = true;
+
+  static constexpr std::size_t CACHE_LINE_SIZE = 64;
+  static constexpr std::size_t SLAB_ALIGNMENT = 4096;
+  static constexpr std::size_t SLOT_SIZE = (sizeof(Node) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  // At least 64 nodes per slab, rounded up to whole pages.
+  static constexpr std::size_t SLAB_SIZE =
+      (std::max<std::size_t>(SLOT_SIZE * 64, 64 * 1024) + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT * SLAB_ALIGNMENT;
+
+  static_assert(alignof(Node) <= CACHE_LINE_SIZE, "Node alignment exceeds a cache line");
+
+  SlabNodeAllocator() = default;
+  SlabNodeAllocator(const SlabNodeAllocator&) = delete;
+  SlabNodeAllocator& operator=(const SlabNodeAllocator&) = delete;
+  ~SlabNodeAllocator() { release_all(); }
+
+  Node* create() {
+    void* slot;
+    if (free_list != nullptr) {
+      slot = free_list;
+      free_list = free_list->next;
+    } else {
+      if (bump == bump_end) {
+        grow();
+      }
+      slot = bump;
+      bump += SLOT_SIZE;
+    }
+    return new (slot) Node();
+  }
+
+  // Always bumps, so consecutive calls get consecutive slots, apart from where a new slab starts. Whatever it skips on
+  // the free list stays there for create().
+  Node* create_sequential() {
+    if (bump == bump_end) {
+      grow();
+    }
+    void* slot = bump;
+    bump += SLOT_SIZE;
+    return new (slot) Node();
+  }
+
+  void destroy(Node* node) {
+    node->~Node();
+    auto* slot = reinterpret_cast<FreeSlot*>(node);
+    slot->next = free_list;
+    free_list = slot;
+  }
+
+  void release_all() {
+    for (void* slab : slabs) {
+      std::free(slab);
+    }
+    slabs.clear();
+    free_list = nullptr;
+    bump = nullptr;
+    bump_end = nullptr;
+  }
+
+private:
+  struct FreeSlot {
+    FreeSlot* next;
+  };
+
+  std::vector<void*> slabs;
+  FreeSlot* free_list = nullptr;
+  std::byte* bump = nullptr;
+  std::byte* bump_end = nullptr;
+
+  void grow() {
+    void* slab = std::aligned_alloc(SLAB_ALIGNMENT, SLAB_SIZE);
+    if (slab == nullptr) {
+      throw std::bad_alloc();
+    }
+    slabs.push_back(slab);
+    bump = static_cast<std::byte*>(slab);
+    bump_end = bump + SLAB_SIZE / SLOT_SIZE * SLOT_SIZE;
+  }
+};
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef BTREE_NODE_SEARCH_H
+#define BTREE_NODE_SEARCH_H
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+// Searching for a key inside a single node. For arithmetic keys we don't need the generality of std::lower_bound, and
+// its branches mispredict about half the time on wide nodes, so we pick one of these per key type and node size:
+//   Generic          - std::ranges::lower_bound/upper_bound, for everything that isn't arithmetic.
+//   BranchlessBinary - binary search where the only branch is the loop, the comparison becomes a conditional move.
+//   Linear           - count the keys below the search key, SIMD when the target supports it. No branches on the keys
+//                      at all, and for small nodes it's just a handful of vector compares.
+enum class KeySearch { Generic, BranchlessBinary, Linear };
+
+// Nodes whose keys fit in a single cache line are scanned linearly. Past that the branchless binary search wins, even
+// with AVX2 (see the "search" section of btree_bench.cpp).
+inline constexpr std::size_t LINEAR_SEARCH_MAX_BYTES = 64;
+
+template <typename KeyType, std::size_t Capacity> constexpr KeySearch pick_key_search() {
+  if constexpr (!std::is_arithmetic_v<KeyType>) {
+    return KeySearch::Generic;
+  } else if constexpr (Capacity != 0 && Capacity * sizeof(KeyType) <= LINEAR_SEARCH_MAX_BYTES) {
+    return KeySearch::Linear;
+  } else {
+    return KeySearch::BranchlessBinary;
+  }
+}
+
+// Compares a vector's worth of keys against a key, returning a bitmask with one bit per lane. WIDTH == 1 means there's
+// no vector implementation for the type on this target.
+template <typename KeyType> struct SimdKeyCompare {
+  static constexpr std::size_t WIDTH = 1;
+};
+
+#if defined(__AVX2__)
+template <> struct SimdKeyCompare<std::int32_t> {
+  static constexpr std::size_t WIDTH = 8;
+  static unsigned less(const std::int32_t* keys, std::int32_t key) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(key), v)));
+  }
+  static unsigned greater(const std::int32_t* keys, std::int32_t key) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, _mm256_set1_epi32(key))));
+  }
+};
+
+// There's no unsigned compare, flipping the sign bit maps unsigned order onto signed order.
+template <> struct SimdKeyCompare<std::uint32_t> {
+  static constexpr std::size_t WIDTH = 8;
+  static __m256i biased(__m256i v) { return _mm256_xor_si256(v, _mm256_set1_epi32(INT32_MIN)); }
+  static unsigned less(const std::uint32_t* keys, std::uint32_t key) {
+    __m256i v = biased(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys)));
+    __m256i k = biased(_mm256_set1_epi32(static_cast<std::int32_t>(key)));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+  }
+  static unsigned greater(const std::uint32_t* keys, std::uint32_t key) {
+    __m256i v = biased(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys)));
+    __m256i k = biased(_mm256_set1_epi32(static_cast<std::int32_t>(key)));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, k)));
+  }
+};
+
+template <> struct SimdKeyCompare<std::int64_t> {
+  static constexpr std::size_t WIDTH = 4;
+  static unsigned less(const std::int64_t* keys, std::int64_t key) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+    return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(key), v)));
+  }
+  static unsigned greater(const std::int64_t* keys, std::int64_t key) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+    return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, _mm256_set1_epi64x(key))));
+  }
+};
+
+template <> struct SimdKeyCompare<std::uint64_t> {
+  static constexpr std::size_t WIDTH = 4;
+  static __m256i biased(__m256i v) { return _mm256_xor_si256(v, _mm256_set1_epi64x(INT64_MIN)); }
+  static unsigned less(const std::uint64_t* keys, std::uint64_t key) {
+    __m256i v = biased(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys)));
+    __m256i k = biased(_mm256_set1_epi64x(static_cast<std::int64_t>(key)));
+    return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v)));
+  }
+  static unsigned greater(const std::uint64_t* keys, std::uint64_t key) {
+    __m256i v = biased(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys)));
+    __m256i k = biased(_mm256_set1_epi64x(static_cast<std::int64_t>(key)));
+    return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, k)));
+  }
+};
+
+template <> struct SimdKeyCompare<float> {
+  static constexpr std::size_t WIDTH = 8;
+  static unsigned less(const float* keys, float key) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(keys), _mm256_set1_ps(key), _CMP_LT_OQ));
+  }
+  static unsigned greater(const float* keys, float key) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(keys), _mm256_set1_ps(key), _CMP_GT_OQ));
+  }
+};
+
+template <> struct SimdKeyCompare<double> {
+  static constexpr std::size_t WIDTH = 4;
+  static unsigned less(const double* keys, double key) {
+    return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(keys), _mm256_set1_pd(key), _CMP_LT_OQ));
+  }
+  static unsigned greater(const double* keys, double key) {
+    return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(keys), _mm256_set1_pd(key), _CMP_GT_OQ));
+  }
+};
+#elif defined(__SSE4_2__)
+template <> struct SimdKeyCompare<std::int32_t> {
+  static constexpr std::size_t WIDTH = 4;
+  static unsigned less(const std::int32_t* keys, std::int32_t key) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(key), v)));
+  }
+  static unsigned greater(const std::int32_t* keys, std::int32_t key) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, _mm_set1_epi32(key))));
+  }
+};
+
+template <> struct SimdKeyCompare<std::uint32_t> {
+  static constexpr std::size_t WIDTH = 4;
+  static __m128i biased(__m128i v) { return _mm_xor_si128(v, _mm_set1_epi32(INT32_MIN)); }
+  static unsigned less(const std::uint32_t* keys, std::uint32_t key) {
+    __m128i v = biased(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)));
+    __m128i k = biased(_mm_set1_epi32(static_cast<std::int32_t>(key)));
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, v)));
+  }
+  static unsigned greater(const std::uint32_t* keys, std::uint32_t key) {
+    __m128i v = biased(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)));
+    __m128i k = biased(_mm_set1_epi32(static_cast<std::int32_t>(key)));
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, k)));
+  }
+};
+
+template <> struct SimdKeyCompare<std::int64_t> {
+  static constexpr std::size_t WIDTH = 2;
+  static unsigned less(const std::int64_t* keys, std::int64_t key) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+    return _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(_mm_set1_epi64x(key), v)));
+  }
+  static unsigned greater(const std::int64_t* keys, std::int64_t key) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+    return _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v, _mm_set1_epi64x(key))));
+  }
+};
+
+template <> struct SimdKeyCompare<std::uint64_t> {
+  static constexpr std::size_t WIDTH = 2;
+  static __m128i biased(__m128i v) { return _mm_xor_si128(v, _mm_set1_epi64x(INT64_MIN)); }
+  static unsigned less(const std::uint64_t* keys, std::uint64_t key) {
+    __m128i v = biased(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)));
+    __m128i k = biased(_mm_set1_epi64x(static_cast<std::int64_t>(key)));
+    return _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, v)));
+  }
+  static unsigned greater(const std::uint64_t* keys, std::uint64_t key) {
+    __m128i v = biased(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)));
+    __m128i k = biased(_mm_set1_epi64x(static_cast<std::int64_t>(key)));
+    return _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v, k)));
+  }
+};
+
+template <> struct SimdKeyCompare<float> {
+  static constexpr std::size_t WIDTH = 4;
+  static unsigned less(const float* keys, float key) {
+    return _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(keys), _mm_set1_ps(key)));
+  }
+  static unsigned greater(const float* keys, float key) {
+    return _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(keys), _mm_set1_ps(key)));
+  }
+};
+
+template <> struct SimdKeyCompare<double> {
+  static constexpr std::size_t WIDTH = 2;
+  static unsigned less(const double* keys, double key) {
+    return _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(keys), _mm_set1_pd(key)));
+  }
+  static unsigned greater(const double* keys, double key) {
+    return _mm_movemask_pd(_mm_cmpgt_pd(_mm_loadu_pd(keys), _mm_set1_pd(key)));
+  }
+};
+#endif
+
+// Number of keys that are < key, or <= key for Inclusive. Since keys are sorted that's lower_bound/upper_bound.
+template <bool Inclusive, typename KeyType>
+std::size_t linear_rank(const KeyType* keys, std::size_t count, const KeyType& key) {
+  std::size_t rank = 0;
+  std::size_t i = 0;
+
+  // Only the first `count` keys are initialized, so the vector loop stops at the last full vector and the scalar loop
+  // picks up the rest.
+  using Simd = SimdKeyCompare<std::remove_cv_t<KeyType>>;
+  if constexpr (Simd::WIDTH > 1) {
+    for (; i + Simd::WIDTH <= count; i += Simd::WIDTH) {
+      if constexpr (Inclusive) {
+        rank += Simd::WIDTH - std::popcount(Simd::greater(keys + i, key));
+      } else {
+        rank += std::popcount(Simd::less(keys + i, key));
+      }
+    }
+  }
+
+  for (; i < count; ++i) {
+    if constexpr (Inclusive) {
+      rank += static_cast<std::size_t>(!(key < keys[i]));
+    } else {
+      rank += static_cast<std::size_t>(keys[i] < key);
+    }
+  }
+  return rank;
+}
+
+template <bool Inclusive, typename KeyType>
+std::size_t branchless_rank(const KeyType* keys, std::size_t count, const KeyType& key) {
+  if (count == 0) {
+    return 0;
+  }
+
+  // Halve the window every step and move its base forward when the probe is still on the wrong side of key. Written
+  // as a select so it compiles to a cmov rather than a branch.
+  const KeyType* base = keys;
+  while (count > 1) {
+    std::size_t half = count / 2;
+    bool go_right = Inclusive ? !(key < base[half]) : base[half] < key;
+    base = go_right ? base + half : base;
+    count -= half;
+  }
+  bool past = Inclusive ? !(key < *base) : *base < key;
+  return static_cast<std::size_t>(base - keys) + past;
+}
+
+template <KeySearch Strategy, bool Inclusive, typename KeyType>
+std::size_t key_rank(const KeyType* keys, std::size_t count, const KeyType& key) {
+  if constexpr (Strategy == KeySearch::Linear) {
+    return linear_rank<Inclusive>(keys, count, key);
+  } else if constexpr (Strategy == KeySearch::BranchlessBinary) {
+    return branchless_rank<Inclusive>(keys, count, key);
+  } else if constexpr (Inclusive) {
+    return std::ranges::upper_bound(keys, keys + count, key) - keys;
+  } else {
+    return std::ranges::lower_bound(keys, keys + count, key) - keys;
+  }
+}
+
+// Index of the first of keys[0, count) that is >= key, for a node that holds at most Capacity keys.
+template <std::size_t Capacity, typename KeyType>
+std::size_t node_lower_bound(const KeyType* keys, std::size_t count, const KeyType& key) {
+  return key_rank<pick_key_search<KeyType, Capacity>(), false>(keys, count, key);
+}
+
+// Index of the first of keys[0, count) that is > key, for a node that holds at most Capacity keys.
+template <std::size_t Capacity, typename KeyType>
+std::size_t node_upper_bound(const KeyType* keys, std::size_t count, const KeyType& key) {
+  return key_rank<pick_key_search<KeyType, Capacity>(), true>(keys, count, key);
+}
+
+#endif
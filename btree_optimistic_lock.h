@@ -0,0 +1,73 @@
+#ifndef BTREE_OPTIMISTIC_LOCK_H
+#define BTREE_OPTIMISTIC_LOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// Version lock for optimistic lock coupling. Readers never write to it: they remember the version they saw, read the
+// node, and check the version is still the same afterwards, restarting if it isn't. Writers take it exclusively, which
+// bumps the version on release so every reader that overlapped with them notices.
+//
+// Layout of the version word: bit 0 marks the node obsolete (unlinked from the tree, must not be used), bit 1 is the
+// write lock, the rest is a counter. Unlocking adds 0b10, which clears the lock bit and carries into the counter.
+class OptimisticLock {
+public:
+  // Waits until no writer holds the lock and returns the version to validate against. False if the node is obsolete.
+  bool read_lock(std::uint64_t& version) const {
+    version = await_unlocked();
+    return !is_obsolete(version);
+  }
+
+  // Whether nothing has changed since read_lock returned version.
+  bool validate(std::uint64_t version) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version == word.load(std::memory_order_relaxed);
+  }
+
+  // Turn a read into a write lock, but only if no one else has written in between. Never blocks.
+  bool try_upgrade(std::uint64_t version) {
+    return word.compare_exchange_strong(version, version + LOCKED, std::memory_order_acquire);
+  }
+
+  // Blocking write lock. False if the node turned obsolete while we were waiting.
+  bool write_lock() {
+    while (true) {
+      std::uint64_t version;
+      if (!read_lock(version)) {
+        return false;
+      }
+      if (try_upgrade(version)) {
+        return true;
+      }
+    }
+  }
+
+  void write_unlock() { word.fetch_add(LOCKED, std::memory_order_release); }
+
+  // Release the lock and mark the node as unlinked. Readers currently on it will restart.
+  void write_unlock_obsolete() { word.fetch_add(LOCKED | OBSOLETE, std::memory_order_release); }
+
+private:
+  static constexpr std::uint64_t OBSOLETE = 0b01;
+  static constexpr std::uint64_t LOCKED = 0b10;
+
+  std::atomic<std::uint64_t> word{0b100};
+
+  static bool is_locked(std::uint64_t version) { return (version & LOCKED) != 0; }
+  static bool is_obsolete(std::uint64_t version) { return (version & OBSOLETE) != 0; }
+
+  std::uint64_t await_unlocked() const {
+    std::uint64_t version = word.load(std::memory_order_acquire);
+    for (int spins = 0; is_locked(version); ++spins) {
+      // Writers only hold the lock for a node-sized memmove, so spin a little before giving up the core.
+      if (spins > 64) {
+        std::this_thread::yield();
+      }
+      version = word.load(std::memory_order_acquire);
+    }
+    return version;
+  }
+};
+
+#endif
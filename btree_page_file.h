@@ -0,0 +1,227 @@
+#ifndef BTREE_PAGE_FILE_H
+#define BTREE_PAGE_FILE_H
+
+#include "btree_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Pages on disk are addressed by number, page N lives at byte N * PAGE_SIZE of the file. Page 0 is the file header, so
+// 0 doubles as "no page".
+using PageId = std::uint64_t;
+inline constexpr PageId NO_PAGE = 0;
+
+// How opening one of the on-disk formats went: a PageFile, a BTreeSnapshot or a WriteAheadLog.
+enum class FileResult { Success, IoError, BadFormat, LayoutMismatch };
+
+// Identifies the key type in a file header's layout field, so a file isn't read back as keys of another type. Each
+// format ORs its own parameters (fanout, block size) into the low 32 bits.
+template <typename KeyType> constexpr std::uint64_t key_layout_tag() {
+  return (std::uint64_t{sizeof(KeyType)} << 40) | (std::uint64_t{std::is_floating_point_v<KeyType>} << 33) |
+         (std::uint64_t{std::is_signed_v<KeyType>} << 32);
+}
+
+// A single file of PageData::PAGE_SIZE pages. Handles the header page and page allocation, pages freed go onto a free
+// list threaded through the pages themselves and get handed out again before the file grows.
+//
+// There is no crash consistency at this level. The header only makes it to disk on sync() and close(), and pages are
+// written in place whenever they are (a BufferPool writes a dirty page back as soon as it evicts it), so a crash between
+// two syncs can leave pages of the old tree already overwritten with the new one's. A file that has to survive crashes
+// needs the write-ahead log and snapshots of btree_wal.h on top, nothing here replaces them.
+//
+// Any I/O error sticks: failed() turns true and every later read/write fails too, so a caller can do a whole operation
+// and check once at the end.
+class PageFile {
+public:
+  static constexpr std::size_t PAGE_SIZE = PageData::PAGE_SIZE;
+  static constexpr std::uint32_t FORMAT_VERSION = 1;
+
+  PageFile() = default;
+  PageFile(const PageFile&) = delete;
+  PageFile& operator=(const PageFile&) = delete;
+  ~PageFile() { close(); }
+
+  // Opens path, creating an empty page file if it doesn't exist yet. layout identifies what the pages hold (see
+  // DiskBTree), a file written with a different layout is refused.
+  [[nodiscard]] FileResult open(const std::string& path, std::uint64_t layout);
+  // Writes the header and closes the file.
+  void close();
+  [[nodiscard]] bool sync();
+
+  bool is_open() const { return fd >= 0; }
+  bool failed() const { return io_failed; }
+  // For layers on top that hit a failure of their own, so there's still a single flag to check.
+  void mark_failed() { io_failed = true; }
+  bool created() const { return was_created; }
+
+  bool read(PageId id, void* page);
+  bool write(PageId id, const void* page);
+
+  PageId allocate();
+  void free(PageId id);
+
+  // Page the caller treats as its entry point (a tree's root), kept in the header.
+  PageId root() const { return header.root; }
+  void set_root(PageId id) { header.root = id; }
+
+  std::uint64_t page_count() const { return header.page_count; }
+
+private:
+  static constexpr char MAGIC[8] = {'B', 'P', 'T', 'R', 'E', 'E', 'P', 'F'};
+
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t page_size;
+    std::uint64_t layout;
+    // Pages in the file, including the header.
+    std::uint64_t page_count;
+    std::uint64_t free_head;
+    PageId root;
+  };
+  static_assert(sizeof(Header) <= PAGE_SIZE);
+
+  int fd = -1;
+  bool io_failed = false;
+  bool was_created = false;
+  Header header{};
+
+  bool write_header();
+};
+
+inline FileResult PageFile::open(const std::string& path, std::uint64_t layout) {
+  close();
+  io_failed = false;
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return FileResult::IoError;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close();
+    return FileResult::IoError;
+  }
+
+  was_created = st.st_size == 0;
+  if (was_created) {
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.page_size = PAGE_SIZE;
+    header.layout = layout;
+    header.page_count = 1;
+    header.free_head = NO_PAGE;
+    header.root = NO_PAGE;
+    if (!write_header()) {
+      close();
+      return FileResult::IoError;
+    }
+    return FileResult::Success;
+  }
+
+  if (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+    ::close(fd);
+    fd = -1;
+    return FileResult::IoError;
+  }
+  FileResult result = FileResult::Success;
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION ||
+      header.page_size != PAGE_SIZE || static_cast<std::uint64_t>(st.st_size) < header.page_count * PAGE_SIZE) {
+    result = FileResult::BadFormat;
+  } else if (header.layout != layout) {
+    result = FileResult::LayoutMismatch;
+  }
+  if (result != FileResult::Success) {
+    // Not ours, leave it exactly as it was.
+    ::close(fd);
+    fd = -1;
+  }
+  return result;
+}
+
+inline void PageFile::close() {
+  if (fd < 0) {
+    return;
+  }
+  if (!io_failed) {
+    write_header();
+  }
+  ::close(fd);
+  fd = -1;
+}
+
+inline bool PageFile::sync() {
+  if (io_failed || !write_header() || fdatasync(fd) != 0) {
+    io_failed = true;
+  }
+  return !io_failed;
+}
+
+inline bool PageFile::read(PageId id, void* page) {
+  if (io_failed || id == NO_PAGE || id >= header.page_count ||
+      pread(fd, page, PAGE_SIZE, static_cast<off_t>(id * PAGE_SIZE)) != static_cast<ssize_t>(PAGE_SIZE)) {
+    io_failed = true;
+  }
+  return !io_failed;
+}
+
+inline bool PageFile::write(PageId id, const void* page) {
+  if (io_failed || id == NO_PAGE || id >= header.page_count ||
+      pwrite(fd, page, PAGE_SIZE, static_cast<off_t>(id * PAGE_SIZE)) != static_cast<ssize_t>(PAGE_SIZE)) {
+    io_failed = true;
+  }
+  return !io_failed;
+}
+
+inline PageId PageFile::allocate() {
+  if (io_failed) {
+    return NO_PAGE;
+  }
+  if (header.free_head != NO_PAGE) {
+    PageId id = header.free_head;
+    PageId next;
+    if (pread(fd, &next, sizeof(next), static_cast<off_t>(id * PAGE_SIZE)) != static_cast<ssize_t>(sizeof(next))) {
+      io_failed = true;
+      return NO_PAGE;
+    }
+    header.free_head = next;
+    return id;
+  }
+  // Grow the file right away, so that read()/write() of a fresh page behave like any other.
+  PageId id = header.page_count;
+  if (ftruncate(fd, static_cast<off_t>((id + 1) * PAGE_SIZE)) != 0) {
+    io_failed = true;
+    return NO_PAGE;
+  }
+  header.page_count++;
+  return id;
+}
+
+inline void PageFile::free(PageId id) {
+  if (io_failed) {
+    return;
+  }
+  if (pwrite(fd, &header.free_head, sizeof(header.free_head), static_cast<off_t>(id * PAGE_SIZE)) !=
+      static_cast<ssize_t>(sizeof(header.free_head))) {
+    io_failed = true;
+    return;
+  }
+  header.free_head = id;
+}
+
+inline bool PageFile::write_header() {
+  alignas(NODE_ALIGNMENT) unsigned char page[PAGE_SIZE] = {};
+  std::memcpy(page, &header, sizeof(header));
+  if (pwrite(fd, page, PAGE_SIZE, 0) != static_cast<ssize_t>(PAGE_SIZE)) {
+    io_failed = true;
+  }
+  return !io_failed;
+}
+
+#endif
@@ -0,0 +1,429 @@
+#ifndef BTREE_SNAPSHOT_H
+#define BTREE_SNAPSHOT_H
+
+#include "btree_node_search.h"
+#include "btree_page_file.h"
+#include "btree_types.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Immutable snapshot of a tree's keys (and optionally a 64 bit value per key) in a file that's searched in place
+// through mmap. Opening one is a handful of syscalls and a header check, pages come in as lookups touch them, nothing
+// is deserialized or allocated.
+//
+// The layout is an implicit tree, every node is a run of B consecutive keys and there are no pointers at all:
+//   header page | keys (all of them, sorted) | values | level 1 | level 2 | ... | level L
+// Level i holds the first key of every block of B keys of level i - 1 (level 0 being the keys), up to a level that fits
+// in a single block. So the child of entry j of a level is block j of the level below, found by multiplying instead of
+// following a pointer. Every section starts on a 64 byte boundary, the keys on a page boundary.
+
+struct SnapshotLookupResult {
+  bool found;
+  // 0 if the snapshot was written without values.
+  std::uint64_t value;
+};
+
+// Checksum of the words in bytes, size has to be a multiple of 8. Not cryptographic, just meant to catch a torn or
+// corrupted file, and cheap enough (one multiply per word) to run over a few GB.
+inline std::uint64_t snapshot_checksum(std::uint64_t state, const unsigned char* bytes, std::size_t size) {
+  for (std::size_t i = 0; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    state = (state ^ word) * 0x9E3779B97F4A7C15ull;
+    state ^= state >> 29;
+  }
+  return state;
+}
+
+template <typename KeyType, std::size_t B = 64> class BTreeSnapshot {
+  static_assert(std::is_trivially_copyable_v<KeyType>, "keys are written to disk as raw bytes");
+  static_assert(B >= 2, "a block has to hold at least 2 keys");
+
+public:
+  static constexpr std::uint32_t FORMAT_VERSION = 1;
+  // 100M keys need 5 levels at B = 64, this is plenty for anything that fits in a file.
+  static constexpr std::size_t MAX_LEVELS = 16;
+
+  BTreeSnapshot() = default;
+  BTreeSnapshot(const BTreeSnapshot&) = delete;
+  BTreeSnapshot& operator=(const BTreeSnapshot&) = delete;
+  ~BTreeSnapshot() { close(); }
+
+  // Writes the entries of tree (anything iterating BTreeEntry in key order, so a BTree) to path. value_of maps each
+  // entry's PageData* to the value stored with its key, without it no values are stored. The file is written next to
+  // path and renamed over it at the end, so readers that open path see either the old snapshot or the new one.
+  template <typename Tree> [[nodiscard]] static FileResult write(const std::string& path, const Tree& tree) {
+    return write_file(path, tree, [](PageData*) { return std::uint64_t{0}; }, false);
+  }
+  template <typename Tree, typename ValueOf>
+  [[nodiscard]] static FileResult write(const std::string& path, const Tree& tree, ValueOf&& value_of) {
+    return write_file(path, tree, std::forward<ValueOf>(value_of), true);
+  }
+
+  // Maps the snapshot at path. Only the header is checked here, see verify() for the rest.
+  [[nodiscard]] FileResult open(const std::string& path);
+  void close();
+  bool is_open() const { return base != nullptr; }
+
+  // Reads the whole file to check it against the checksum in the header. Touches every page, so it's up to the caller
+  // whether that's worth it on startup.
+  [[nodiscard]] bool verify() const;
+
+  std::size_t size() const { return header().count; }
+  bool has_values() const { return header().values_offset != 0; }
+
+  [[nodiscard]] SnapshotLookupResult find(const KeyType& key) const;
+  std::vector<KeyType> find_keys_in_range(const KeyType& lower_bound, const KeyType& upper_bound) const;
+  // Calls fn(key, value) for every entry in [lower_bound, upper_bound), in order, until fn returns false.
+  template <typename Fn> void scan(const KeyType& lower_bound, const KeyType& upper_bound, Fn&& fn) const;
+  // Calls fn(key, value) for every entry, in order.
+  template <typename Fn> void for_each(Fn&& fn) const;
+
+private:
+  static constexpr char MAGIC[8] = {'B', 'P', 'T', 'S', 'N', 'A', 'P', 'S'};
+  static constexpr std::size_t HEADER_SIZE = 4096;
+  static constexpr std::size_t SECTION_ALIGNMENT = 64;
+
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t levels;
+    std::uint64_t layout;
+    std::uint64_t count;
+    std::uint64_t file_size;
+    std::uint64_t keys_offset;
+    // 0 when there are no values.
+    std::uint64_t values_offset;
+    // Index i for level i + 1.
+    std::uint64_t level_offsets[MAX_LEVELS];
+    std::uint64_t level_counts[MAX_LEVELS];
+    // Over everything after the header page.
+    std::uint64_t body_checksum;
+    // Over the header with this field set to 0.
+    std::uint64_t header_checksum;
+  };
+  static_assert(sizeof(Header) <= HEADER_SIZE && sizeof(Header) % sizeof(std::uint64_t) == 0);
+
+  const unsigned char* base = nullptr;
+  std::size_t mapped_size = 0;
+
+  // Key type and block size, so a file isn't searched as something it isn't.
+  static constexpr std::uint64_t layout() {
+    return key_layout_tag<KeyType>() | B;
+  }
+
+  static std::uint64_t align_section(std::uint64_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+  }
+
+  static std::uint64_t header_checksum(Header header) {
+    header.header_checksum = 0;
+    return snapshot_checksum(0, reinterpret_cast<const unsigned char*>(&header), sizeof(header));
+  }
+
+  const Header& header() const { return *reinterpret_cast<const Header*>(base); }
+  const KeyType* keys_at(std::uint64_t offset) const { return reinterpret_cast<const KeyType*>(base + offset); }
+  const KeyType* keys() const { return keys_at(header().keys_offset); }
+
+  // Index of the first key >= key.
+  std::size_t lower_bound_index(const KeyType& key) const;
+
+  template <typename Tree, typename ValueOf>
+  static FileResult write_file(const std::string& path, const Tree& tree, ValueOf&& value_of, bool with_values);
+};
+
+namespace snapshot_detail {
+
+// Appends to a file through a buffer, checksumming everything past the header as it goes out.
+class Writer {
+public:
+  explicit Writer(int fd) : fd(fd), buffer(BUFFER_SIZE) {}
+
+  void append(const void* data, std::size_t size) {
+    auto* bytes = static_cast<const unsigned char*>(data);
+    while (size > 0) {
+      std::size_t chunk = std::min(size, BUFFER_SIZE - used);
+      std::memcpy(buffer.data() + used, bytes, chunk);
+      used += chunk;
+      bytes += chunk;
+      size -= chunk;
+      if (used == BUFFER_SIZE) {
+        flush();
+      }
+    }
+  }
+
+  void pad_to(std::uint64_t offset) {
+    static constexpr unsigned char zeros[64] = {};
+    while (written + used < offset) {
+      append(zeros, std::min<std::uint64_t>(sizeof(zeros), offset - written - used));
+    }
+  }
+
+  // Everything appended so far, as long as it adds up to whole words (the sections are padded, so it does).
+  void flush() {
+    checksum = snapshot_checksum(checksum, buffer.data(), used);
+    std::size_t done = 0;
+    while (!failed && done < used) {
+      ssize_t n = ::pwrite(fd, buffer.data() + done, used - done, static_cast<off_t>(written + done));
+      if (n <= 0) {
+        failed = true;
+      } else {
+        done += static_cast<std::size_t>(n);
+      }
+    }
+    written += used;
+    used = 0;
+  }
+
+  std::uint64_t offset() const { return written + used; }
+  // Starts counting at the body, the header is written separately at the end.
+  void skip_to(std::uint64_t offset) { written = offset; }
+
+  bool failed = false;
+  std::uint64_t checksum = 0;
+
+private:
+  static constexpr std::size_t BUFFER_SIZE = std::size_t{1} << 20;
+
+  int fd;
+  std::vector<unsigned char> buffer;
+  std::size_t used = 0;
+  std::uint64_t written = 0;
+};
+
+} // namespace snapshot_detail
+
+template <typename KeyType, std::size_t B>
+template <typename Tree, typename ValueOf>
+FileResult BTreeSnapshot<KeyType, B>::write_file(const std::string& path, const Tree& tree, ValueOf&& value_of,
+                                                     bool with_values) {
+  Header header{};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = FORMAT_VERSION;
+  header.layout = layout();
+  for (auto entry : tree) {
+    (void)entry;
+    header.count++;
+  }
+
+  // Where everything goes, worked out from the count alone so the file can be written front to back.
+  header.keys_offset = HEADER_SIZE;
+  std::uint64_t end = header.keys_offset + header.count * sizeof(KeyType);
+  if (with_values) {
+    header.values_offset = align_section(end);
+    end = header.values_offset + header.count * sizeof(std::uint64_t);
+  }
+  for (std::uint64_t below = header.count; below > B; below = header.level_counts[header.levels++]) {
+    if (header.levels == MAX_LEVELS) {
+      return FileResult::BadFormat;
+    }
+    header.level_counts[header.levels] = (below + B - 1) / B;
+    header.level_offsets[header.levels] = align_section(end);
+    end = header.level_offsets[header.levels] + header.level_counts[header.levels] * sizeof(KeyType);
+  }
+  header.file_size = align_section(end);
+
+  const std::string temp_path = path + ".tmp";
+  int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return FileResult::IoError;
+  }
+  snapshot_detail::Writer writer(fd);
+  writer.skip_to(HEADER_SIZE);
+
+  // Level 1 comes out of the key pass, every level above it out of the one below.
+  std::vector<std::vector<KeyType>> levels(header.levels);
+  std::uint64_t index = 0;
+  for (auto entry : tree) {
+    if (header.levels > 0 && index % B == 0) {
+      levels[0].push_back(entry.key);
+    }
+    writer.append(&entry.key, sizeof(KeyType));
+    index++;
+  }
+  if (with_values) {
+    writer.pad_to(header.values_offset);
+    for (auto entry : tree) {
+      std::uint64_t value = value_of(entry.data);
+      writer.append(&value, sizeof(value));
+    }
+  }
+  for (std::size_t level = 0; level < header.levels; ++level) {
+    if (level > 0) {
+      for (std::size_t i = 0; i < levels[level - 1].size(); i += B) {
+        levels[level].push_back(levels[level - 1][i]);
+      }
+    }
+    writer.pad_to(header.level_offsets[level]);
+    writer.append(levels[level].data(), levels[level].size() * sizeof(KeyType));
+  }
+  writer.pad_to(header.file_size);
+  writer.flush();
+
+  header.body_checksum = writer.checksum;
+  header.header_checksum = header_checksum(header);
+  alignas(std::uint64_t) unsigned char page[HEADER_SIZE] = {};
+  std::memcpy(page, &header, sizeof(header));
+  bool ok = !writer.failed && ::pwrite(fd, page, HEADER_SIZE, 0) == static_cast<ssize_t>(HEADER_SIZE) &&
+            ::fsync(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    ::unlink(temp_path.c_str());
+    return FileResult::IoError;
+  }
+  // The rename itself is only durable once the directory is synced.
+  std::string directory = std::filesystem::path(path).parent_path().string();
+  int directory_fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+  ok = directory_fd >= 0 && ::fsync(directory_fd) == 0;
+  if (directory_fd >= 0) {
+    ::close(directory_fd);
+  }
+  return ok ? FileResult::Success : FileResult::IoError;
+}
+
+template <typename KeyType, std::size_t B> FileResult BTreeSnapshot<KeyType, B>::open(const std::string& path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return FileResult::IoError;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return FileResult::IoError;
+  }
+  if (static_cast<std::uint64_t>(st.st_size) < HEADER_SIZE) {
+    ::close(fd);
+    return FileResult::BadFormat;
+  }
+  void* mapping = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping keeps the file alive on its own.
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return FileResult::IoError;
+  }
+  base = static_cast<const unsigned char*>(mapping);
+  mapped_size = static_cast<std::size_t>(st.st_size);
+
+  const Header& h = header();
+  FileResult result = FileResult::Success;
+  if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != FORMAT_VERSION ||
+      h.header_checksum != header_checksum(h) || h.file_size != mapped_size || h.levels > MAX_LEVELS) {
+    result = FileResult::BadFormat;
+  } else if (h.layout != layout()) {
+    result = FileResult::LayoutMismatch;
+  } else {
+    // The checksum says the header is what was written, this is just so a bad writer can't make us read past the end.
+    auto fits = [&](std::uint64_t offset, std::uint64_t count, std::size_t size) {
+      return offset >= HEADER_SIZE && offset <= mapped_size && count <= (mapped_size - offset) / size;
+    };
+    bool ok = fits(h.keys_offset, h.count, sizeof(KeyType)) &&
+              (h.values_offset == 0 || fits(h.values_offset, h.count, sizeof(std::uint64_t)));
+    for (std::size_t level = 0; level < h.levels; ++level) {
+      ok = ok && fits(h.level_offsets[level], h.level_counts[level], sizeof(KeyType));
+    }
+    if (!ok) {
+      result = FileResult::BadFormat;
+    }
+  }
+  if (result != FileResult::Success) {
+    close();
+  }
+  return result;
+}
+
+template <typename KeyType, std::size_t B> void BTreeSnapshot<KeyType, B>::close() {
+  if (base != nullptr) {
+    munmap(const_cast<unsigned char*>(base), mapped_size);
+    base = nullptr;
+    mapped_size = 0;
+  }
+}
+
+template <typename KeyType, std::size_t B> bool BTreeSnapshot<KeyType, B>::verify() const {
+  return snapshot_checksum(0, base + HEADER_SIZE, mapped_size - HEADER_SIZE) == header().body_checksum;
+}
+
+// Down from the top level, one block per level. In each block the last key <= key picks the block below.
+template <typename KeyType, std::size_t B>
+std::size_t BTreeSnapshot<KeyType, B>::lower_bound_index(const KeyType& key) const {
+  const Header& h = header();
+  std::size_t block = 0;
+  for (std::size_t level = h.levels; level > 0; --level) {
+    const KeyType* level_keys = keys_at(h.level_offsets[level - 1]);
+    std::size_t begin = block * B;
+    std::size_t count = std::min<std::size_t>(B, h.level_counts[level - 1] - begin);
+    std::size_t rank = node_upper_bound<B>(level_keys + begin, count, key);
+    block = begin + (rank == 0 ? 0 : rank - 1);
+  }
+  std::size_t begin = block * B;
+  std::size_t count = std::min<std::size_t>(B, h.count - begin);
+  return begin + node_lower_bound<B>(keys() + begin, count, key);
+}
+
+template <typename KeyType, std::size_t B>
+SnapshotLookupResult BTreeSnapshot<KeyType, B>::find(const KeyType& key) const {
+  if (size() == 0) {
+    return {false, 0};
+  }
+  std::size_t idx = lower_bound_index(key);
+  if (idx == size() || !(keys()[idx] == key)) {
+    return {false, 0};
+  }
+  if (!has_values()) {
+    return {true, 0};
+  }
+  return {true, reinterpret_cast<const std::uint64_t*>(base + header().values_offset)[idx]};
+}
+
+template <typename KeyType, std::size_t B>
+template <typename Fn>
+void BTreeSnapshot<KeyType, B>::scan(const KeyType& lower_bound, const KeyType& upper_bound, Fn&& fn) const {
+  if (size() == 0) {
+    return;
+  }
+  const KeyType* all_keys = keys();
+  const auto* values = has_values() ? reinterpret_cast<const std::uint64_t*>(base + header().values_offset) : nullptr;
+  for (std::size_t idx = lower_bound_index(lower_bound); idx < size() && all_keys[idx] < upper_bound; ++idx) {
+    if (!fn(all_keys[idx], values != nullptr ? values[idx] : std::uint64_t{0})) {
+      return;
+    }
+  }
+}
+
+template <typename KeyType, std::size_t B>
+template <typename Fn>
+void BTreeSnapshot<KeyType, B>::for_each(Fn&& fn) const {
+  const KeyType* all_keys = keys();
+  const auto* values = has_values() ? reinterpret_cast<const std::uint64_t*>(base + header().values_offset) : nullptr;
+  for (std::size_t idx = 0; idx < size(); ++idx) {
+    fn(all_keys[idx], values != nullptr ? values[idx] : std::uint64_t{0});
+  }
+}
+
+template <typename KeyType, std::size_t B>
+std::vector<KeyType> BTreeSnapshot<KeyType, B>::find_keys_in_range(const KeyType& lower_bound,
+                                                                   const KeyType& upper_bound) const {
+  std::vector<KeyType> result;
+  scan(lower_bound, upper_bound, [&](const KeyType& key, std::uint64_t) {
+    result.push_back(key);
+    return true;
+  });
+  return result;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef BTREE_STATS_H
+#define BTREE_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Operations that get a latency histogram. Range is find_keys_in_range, the lazy iterators aren't timed.
+enum class BTreeOp { Find, Insert, Delete, Range };
+inline constexpr std::size_t BTREE_OP_COUNT = 4;
+
+inline const char* btree_op_name(BTreeOp op) {
+  switch (op) {
+  case BTreeOp::Find:
+    return "find";
+  case BTreeOp::Insert:
+    return "insert";
+  case BTreeOp::Delete:
+    return "delete";
+  case BTreeOp::Range:
+    return "range";
+  }
+  return "unknown";
+}
+
+// Log-linear histogram along the lines of HdrHistogram. Values below 32 get a bucket each, above that every power of two
+// is split into 32 buckets, so a percentile is never off by more than 1/32 of the value, from nanoseconds up to the
+// 2^40 (about 18 minutes) everything gets clamped to. That's 1152 buckets, recording is a bit_width and an increment.
+class LatencyHistogram {
+public:
+  void record(std::uint64_t value) {
+    value = std::min(value, MAX_VALUE);
+    buckets[bucket_of(value)]++;
+    total++;
+    sum += value;
+    largest = std::max(largest, value);
+  }
+
+  std::uint64_t count() const { return total; }
+  std::uint64_t max() const { return largest; }
+  double mean() const { return total == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(total); }
+
+  // The smallest value that at least percent % of the recorded ones are at or below, rounded up to its bucket's end.
+  std::uint64_t percentile(double percent) const {
+    if (total == 0) {
+      return 0;
+    }
+    auto wanted = static_cast<std::uint64_t>(std::ceil(percent / 100.0 * static_cast<double>(total)));
+    wanted = std::clamp<std::uint64_t>(wanted, 1, total);
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+      seen += buckets[bucket];
+      if (seen >= wanted) {
+        return std::min(bucket_end(bucket), largest);
+      }
+    }
+    return largest;
+  }
+
+private:
+  static constexpr unsigned SUB_BUCKET_BITS = 5;
+  static constexpr std::uint64_t SUB_BUCKETS = std::uint64_t{1} << SUB_BUCKET_BITS;
+  static constexpr unsigned VALUE_BITS = 40;
+  static constexpr std::uint64_t MAX_VALUE = (std::uint64_t{1} << VALUE_BITS) - 1;
+  static constexpr std::size_t BUCKETS = (VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  // Lives on the heap so a tree with stats doesn't carry 9KB per histogram around inline.
+  std::vector<std::uint64_t> buckets = std::vector<std::uint64_t>(BUCKETS);
+  std::uint64_t total = 0;
+  std::uint64_t sum = 0;
+  std::uint64_t largest = 0;
+
+  static std::size_t bucket_of(std::uint64_t value) {
+    if (value < SUB_BUCKETS) {
+      return value;
+    }
+    // value's top SUB_BUCKET_BITS + 1 bits, the leading one picks the power of two and the rest the bucket in it.
+    unsigned shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+  }
+  static std::uint64_t bucket_end(std::size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+      return bucket;
+    }
+    unsigned shift = static_cast<unsigned>(bucket / SUB_BUCKETS) - 1;
+    return ((SUB_BUCKETS + bucket % SUB_BUCKETS + 1) << shift) - 1;
+  }
+};
+
+// Everything BTreeStats keeps, copied out by BTreeStats::snapshot().
+struct BTreeStatsSnapshot {
+  std::uint64_t leaf_splits = 0;
+  std::uint64_t internal_splits = 0;
+  std::uint64_t leaf_merges = 0;
+  std::uint64_t internal_merges = 0;
+  std::uint64_t redistributions = 0;
+  // Every time the root pointer moves: the tree growing or shrinking a level, or going from/to empty.
+  std::uint64_t root_changes = 0;
+  std::uint64_t nodes_allocated = 0;
+  std::uint64_t nodes_freed = 0;
+  // Root to leaf walks by find/insert/delete/upsert and the nodes on them, nodes_visited / descents is the average
+  // number of nodes an operation touches.
+  std::uint64_t descents = 0;
+  std::uint64_t nodes_visited = 0;
+  // Inserts of a key above everything in the tree that went straight to the cached rightmost leaf, no descent.
+  std::uint64_t appends = 0;
+  // In nanoseconds, indexed by BTreeOp.
+  std::array<LatencyHistogram, BTREE_OP_COUNT> latency;
+
+  const LatencyHistogram& latency_of(BTreeOp op) const { return latency[static_cast<std::size_t>(op)]; }
+
+  // Prometheus text format, one metric per line.
+  std::string to_text() const;
+  std::string to_json() const;
+
+private:
+  template <typename Fn> void for_each_counter(Fn&& fn) const {
+    fn("leaf_splits", leaf_splits);
+    fn("internal_splits", internal_splits);
+    fn("leaf_merges", leaf_merges);
+    fn("internal_merges", internal_merges);
+    fn("redistributions", redistributions);
+    fn("root_changes", root_changes);
+    fn("nodes_allocated", nodes_allocated);
+    fn("nodes_freed", nodes_freed);
+    fn("descents", descents);
+    fn("nodes_visited", nodes_visited);
+    fn("appends", appends);
+  }
+};
+
+inline constexpr double BTREE_STATS_PERCENTILES[] = {50, 90, 99, 99.9};
+
+inline std::string BTreeStatsSnapshot::to_text() const {
+  std::ostringstream out;
+  for_each_counter([&](const char* name, std::uint64_t value) { out << "btree_" << name << ' ' << value << '\n'; });
+  for (std::size_t op = 0; op < BTREE_OP_COUNT; ++op) {
+    const char* name = btree_op_name(static_cast<BTreeOp>(op));
+    for (double percentile : BTREE_STATS_PERCENTILES) {
+      out << "btree_latency_ns{op=\"" << name << "\",quantile=\"" << percentile / 100 << "\"} "
+          << latency[op].percentile(percentile) << '\n';
+    }
+    out << "btree_latency_ns_max{op=\"" << name << "\"} " << latency[op].max() << '\n';
+    out << "btree_latency_ns_count{op=\"" << name << "\"} " << latency[op].count() << '\n';
+  }
+  return out.str();
+}
+
+inline std::string BTreeStatsSnapshot::to_json() const {
+  std::ostringstream out;
+  out << "{\"counters\":{";
+  const char* separator = "";
+  for_each_counter([&](const char* name, std::uint64_t value) {
+    out << separator << '"' << name << "\":" << value;
+    separator = ",";
+  });
+  out << "},\"latency_ns\":{";
+  for (std::size_t op = 0; op < BTREE_OP_COUNT; ++op) {
+    out << (op > 0 ? "," : "") << '"' << btree_op_name(static_cast<BTreeOp>(op)) << "\":{\"count\":"
+        << latency[op].count() << ",\"mean\":" << latency[op].mean();
+    for (double percentile : BTREE_STATS_PERCENTILES) {
+      out << ",\"p" << percentile << "\":" << latency[op].percentile(percentile);
+    }
+    out << ",\"max\":" << latency[op].max() << '}';
+  }
+  out << "}}";
+  return out.str();
+}
+
+// Stats policies, BTree's last template parameter. The tree calls these hooks at every split, merge, allocation and so
+// on, and wraps each public operation in time().
+//
+// NoBTreeStats, the default, only has empty inline hooks and takes no space in the tree ([[no_unique_address]]), so a
+// tree without stats compiles to what it was before there were any.
+struct NoBTreeStats {
+  struct Timer {};
+  Timer time(BTreeOp) { return {}; }
+  void split(bool /* leaf */) {}
+  void merge(bool /* leaf */) {}
+  void redistribute() {}
+  void root_changed() {}
+  void node_allocated() {}
+  void node_freed() {}
+  void descended(std::size_t /* nodes */) {}
+  void appended() {}
+};
+
+// Counts everything and keeps a latency histogram per BTreeOp. Not thread safe, neither is BTree.
+class BTreeStats {
+public:
+  class Timer {
+  public:
+    explicit Timer(LatencyHistogram& histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+    ~Timer() {
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      histogram.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+  private:
+    LatencyHistogram& histogram;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  Timer time(BTreeOp op) { return Timer(current.latency[static_cast<std::size_t>(op)]); }
+  void split(bool leaf) { (leaf ? current.leaf_splits : current.internal_splits)++; }
+  void merge(bool leaf) { (leaf ? current.leaf_merges : current.internal_merges)++; }
+  void redistribute() { current.redistributions++; }
+  void root_changed() { current.root_changes++; }
+  void node_allocated() { current.nodes_allocated++; }
+  void node_freed() { current.nodes_freed++; }
+  void descended(std::size_t nodes) {
+    current.descents++;
+    current.nodes_visited += nodes;
+  }
+  void appended() { current.appends++; }
+
+  BTreeStatsSnapshot snapshot() const { return current; }
+  void reset() { current = {}; }
+
+private:
+  BTreeStatsSnapshot current;
+};
+
+#endif
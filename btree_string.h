@@ -0,0 +1,750 @@
+#ifndef BTREE_STRING_H
+#define BTREE_STRING_H
+
+#include "btree_node_allocator.h"
+#include "btree_types.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// BTree for variable length byte string keys (URLs, paths, composite keys encoded with append_key_part below). BTree
+// itself stores KeyType keys[N - 1] by value, which for std::string is a heap allocation per key and a pointer to
+// chase on every compare. Here a node is one fixed size block of NodeBytes instead, with the key bytes in the node:
+//
+//   header | slots -->                  <-- key bytes | prefix
+//
+// Slots (offset, length, the first 4 bytes of the key, payload) grow up from the front and stay sorted, key bytes are
+// appended downwards from the back. How many entries fit depends on how long the keys are, a node splits once the two
+// meet.
+//
+// Two things keep keys short:
+//   - Prefix truncation: the bytes all keys of a node share are stored once, the slots only hold what comes after.
+//   - Suffix truncation: a leaf split pushes up the shortest key that still separates the two leaves, not the first
+//     key of the right one. For URLs that's usually a few bytes past the shared part instead of the whole URL.
+
+template <std::size_t NodeBytes> struct alignas(NODE_ALIGNMENT) StringBTreeNode {
+  static_assert(NodeBytes % NODE_ALIGNMENT == 0 && NodeBytes >= 256 && NodeBytes <= 32768,
+                "node size has to be a multiple of a cache line, between 256 bytes and 32KB");
+
+  struct Slot {
+    std::uint16_t offset;
+    std::uint16_t length;
+    // First 4 bytes of the stored key, big endian and zero padded. Comparing these decides most comparisons without
+    // touching the key bytes.
+    std::uint32_t head;
+    // The entry's PageData* in a leaf, the child left of the key in an internal node.
+    void* payload;
+  };
+
+  static constexpr std::size_t SLOTS_OFFSET = 24;
+  static constexpr std::size_t MAX_SLOTS = (NodeBytes - SLOTS_OFFSET) / sizeof(Slot);
+
+  BTreeNodeType type = BTreeNodeType::LeafNode;
+  std::uint16_t count = 0;
+  std::uint16_t prefix_offset = NodeBytes;
+  std::uint16_t prefix_length = 0;
+  std::uint16_t heap_start = NodeBytes;
+  // Key bytes still referenced, prefix included. Erasing an entry leaves a hole in the heap until the node is
+  // compacted.
+  std::uint16_t heap_used = 0;
+  // Leaves: the next leaf. Internal nodes: the rightmost child, for keys >= the last separator.
+  void* link = nullptr;
+  // The key bytes share this space from the back.
+  Slot slots[MAX_SLOTS];
+
+  bool is_leaf() const { return type == BTreeNodeType::LeafNode; }
+
+  const char* chars() const { return reinterpret_cast<const char*>(this); }
+  char* chars() { return reinterpret_cast<char*>(this); }
+  std::string_view prefix() const { return {chars() + prefix_offset, prefix_length}; }
+  std::string_view suffix(std::size_t i) const { return {chars() + slots[i].offset, slots[i].length}; }
+
+  std::size_t used_bytes() const { return SLOTS_OFFSET + count * sizeof(Slot) + heap_used; }
+  std::size_t contiguous_free() const { return heap_start - (SLOTS_OFFSET + count * sizeof(Slot)); }
+
+  void reset(BTreeNodeType node_type) {
+    type = node_type;
+    count = 0;
+    prefix_offset = NodeBytes;
+    prefix_length = 0;
+    heap_start = NodeBytes;
+    heap_used = 0;
+    link = nullptr;
+  }
+
+  static std::uint32_t head_of(std::string_view first, std::string_view second = {}) {
+    unsigned char bytes[4] = {};
+    std::size_t from_first = std::min<std::size_t>(first.size(), 4);
+    // std::ranges::copy rather than memcpy, an empty string_view may hand out a null data().
+    std::ranges::copy(first.substr(0, from_first), bytes);
+    std::ranges::copy(second.substr(0, 4 - from_first), bytes + from_first);
+    return std::uint32_t{bytes[0]} << 24 | std::uint32_t{bytes[1]} << 16 | std::uint32_t{bytes[2]} << 8 | bytes[3];
+  }
+
+  // Copies first + second onto the heap. The caller made sure there's room.
+  std::uint16_t store(std::string_view first, std::string_view second = {}) {
+    heap_start -= static_cast<std::uint16_t>(first.size() + second.size());
+    std::ranges::copy(first, chars() + heap_start);
+    std::ranges::copy(second, chars() + heap_start + first.size());
+    heap_used += static_cast<std::uint16_t>(first.size() + second.size());
+    return heap_start;
+  }
+
+  void set_prefix(std::string_view first, std::string_view second) {
+    prefix_offset = store(first, second);
+    prefix_length = static_cast<std::uint16_t>(first.size() + second.size());
+  }
+
+  // Puts an entry whose key is prefix() + first + second at pos.
+  void insert_at(std::size_t pos, std::string_view first, std::string_view second, void* payload) {
+    std::uint16_t offset = store(first, second);
+    std::memmove(slots + pos + 1, slots + pos, (count - pos) * sizeof(Slot));
+    slots[pos] = {offset, static_cast<std::uint16_t>(first.size() + second.size()), head_of(first, second), payload};
+    count++;
+  }
+
+  void erase(std::size_t pos) {
+    heap_used -= slots[pos].length;
+    std::memmove(slots + pos, slots + pos + 1, (count - pos - 1) * sizeof(Slot));
+    count--;
+  }
+
+  void* child(std::size_t i) const { return i < count ? slots[i].payload : link; }
+  void set_child(std::size_t i, void* node) { (i < count ? slots[i].payload : link) = node; }
+
+  // Index of the first key >= key, or > key for Upper.
+  template <bool Upper> std::size_t search(std::string_view key) const {
+    std::string_view shared = prefix();
+    std::size_t common = std::min(key.size(), shared.size());
+    int order = std::memcmp(key.data(), shared.data(), common);
+    if (order < 0 || (order == 0 && key.size() < shared.size())) {
+      return 0;
+    }
+    if (order > 0) {
+      return count;
+    }
+    std::string_view rest = key.substr(shared.size());
+    std::uint32_t head = head_of(rest);
+    std::size_t lo = 0;
+    std::size_t hi = count;
+    while (lo < hi) {
+      std::size_t mid = (lo + hi) / 2;
+      int c = head != slots[mid].head ? (head < slots[mid].head ? -1 : 1) : rest.compare(suffix(mid));
+      if (Upper ? c >= 0 : c > 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  bool key_equals(std::size_t i, std::string_view key) const {
+    return key.size() == prefix_length + slots[i].length && key.starts_with(prefix()) &&
+           key.substr(prefix_length) == suffix(i);
+  }
+};
+
+template <std::size_t NodeBytes = 4096, template <typename> class NodeAllocator = HeapNodeAllocator>
+class StringBTree {
+  using Node = StringBTreeNode<NodeBytes>;
+  using Slot = typename Node::Slot;
+
+public:
+  // Splitting needs at least four of the longest keys to fit in a node.
+  static constexpr std::size_t MAX_KEY_LENGTH = (NodeBytes - Node::SLOTS_OFFSET) / 4 - sizeof(Slot);
+
+  StringBTree() = default;
+  StringBTree(const StringBTree&) = delete;
+  StringBTree& operator=(const StringBTree&) = delete;
+  ~StringBTree() { delete_tree(root); }
+
+  [[nodiscard]] LookupResult find(std::string_view key) const;
+  // Full for keys longer than MAX_KEY_LENGTH.
+  [[nodiscard]] InsertResult insert(std::string_view key, PageData* data);
+  [[nodiscard]] DeletionResult delete_key(std::string_view key);
+  std::vector<std::string> find_keys_in_range(std::string_view lower_bound, std::string_view upper_bound) const;
+  // Calls fn(key, data) for every entry in [lower_bound, upper_bound), in order, until fn returns false. key is only
+  // valid during the call.
+  template <typename Fn> void scan(std::string_view lower_bound, std::string_view upper_bound, Fn&& fn) const;
+
+  // Bytes taken by nodes.
+  std::size_t memory_usage() const { return node_count * sizeof(Node); }
+
+  // Key order, separator bounds, equal leaf depth, the leaf chain, and the bookkeeping inside each node.
+  [[nodiscard]] bool validate() const;
+
+private:
+  // Every internal node has at least one key (see rebalance), so 64 levels is more leaves than there's memory for.
+  static constexpr std::size_t MAX_HEIGHT = 64;
+
+  struct Path {
+    Node* nodes[MAX_HEIGHT];
+    std::size_t child[MAX_HEIGHT];
+    std::size_t depth = 0;
+  };
+
+  // An entry while it's being moved between nodes: its key is prefix + suffix, both pointing wherever the key
+  // currently lives.
+  struct EntryRef {
+    std::string_view prefix;
+    std::string_view suffix;
+    void* payload;
+
+    std::size_t size() const { return prefix.size() + suffix.size(); }
+    char at(std::size_t i) const { return i < prefix.size() ? prefix[i] : suffix[i - prefix.size()]; }
+    // The key split at i, as the two pieces before and after.
+    std::pair<std::string_view, std::string_view> head(std::size_t i) const {
+      if (i <= prefix.size()) return {prefix.substr(0, i), {}};
+      return {prefix, suffix.substr(0, i - prefix.size())};
+    }
+    std::pair<std::string_view, std::string_view> tail(std::size_t i) const {
+      if (i <= prefix.size()) return {prefix.substr(i), suffix};
+      return {{}, suffix.substr(i - prefix.size())};
+    }
+  };
+
+  NodeAllocator<Node> allocator;
+  Node* root = nullptr;
+  std::size_t node_count = 0;
+
+  Node* new_node(BTreeNodeType type) {
+    Node* node = allocator.create();
+    node->reset(type);
+    node_count++;
+    return node;
+  }
+  void free_node(Node* node) {
+    allocator.destroy(node);
+    node_count--;
+  }
+  void delete_tree(Node* node);
+
+  Node* find_leaf(std::string_view key, Path* path) const;
+
+  static EntryRef entry(const Node& node, std::size_t i) {
+    return {node.prefix(), node.suffix(i), node.slots[i].payload};
+  }
+  static std::size_t gather(const Node& node, EntryRef* refs);
+  static std::size_t common_prefix(const EntryRef& a, const EntryRef& b);
+  static std::size_t built_size(const EntryRef* refs, std::size_t first, std::size_t last);
+  static void build(Node& node, BTreeNodeType type, const EntryRef* refs, std::size_t first, std::size_t last,
+                    void* link);
+  static std::size_t copy_key(const EntryRef& ref, std::size_t length, char* out);
+
+  // Adds the entry without splitting, false if it doesn't fit.
+  static bool try_insert(Node& node, std::size_t pos, std::string_view key, void* payload);
+  // node didn't have room for (key, payload) at pos. Splits it, and returns the new right half and the key to put
+  // between the two in the parent (in separator_out).
+  Node* split(Node& node, std::size_t pos, std::string_view key, void* payload, char* separator_out,
+              std::size_t& separator_length);
+  // Puts separator between left and right into the parent at the top of path, splitting upwards as needed.
+  void insert_in_parent(Path& path, Node* left, std::string_view separator, Node* right);
+
+  void rebalance(Path& path, Node* node);
+  bool try_merge(Node* left, Node* right, Node* parent, std::size_t separator);
+  void rotate_into_empty(Path& path, Node* node);
+
+  bool validate_node(const Node* node, const std::string* lower, const std::string* upper, std::size_t depth,
+                     std::size_t& leaf_depth, const Node*& prev_leaf) const;
+};
+
+// Appends value to key so that byte order of the encoded keys is the order of the values, for building composite keys
+// (e.g. tenant id, then path) out of parts.
+inline void append_key_part(std::string& key, std::uint64_t value) {
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    key.push_back(static_cast<char>(value >> shift));
+  }
+}
+
+inline void append_key_part(std::string& key, std::int64_t value) {
+  // Flipping the sign bit puts negative numbers first.
+  append_key_part(key, static_cast<std::uint64_t>(value) ^ (std::uint64_t{1} << 63));
+}
+
+// Strings are terminated by 00 00 and 00 inside them becomes 00 FF, so a part that's a prefix of another sorts first
+// no matter what follows it.
+inline void append_key_part(std::string& key, std::string_view value) {
+  for (char c : value) {
+    key.push_back(c);
+    if (c == '\0') {
+      key.push_back('\xff');
+    }
+  }
+  key.append(2, '\0');
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+void StringBTree<NodeBytes, NodeAllocator>::delete_tree(Node* node) {
+  if (node == nullptr) {
+    return;
+  }
+  if (!node->is_leaf()) {
+    for (std::size_t i = 0; i <= node->count; ++i) {
+      delete_tree(static_cast<Node*>(node->child(i)));
+    }
+  }
+  free_node(node);
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+typename StringBTree<NodeBytes, NodeAllocator>::Node*
+StringBTree<NodeBytes, NodeAllocator>::find_leaf(std::string_view key, Path* path) const {
+  Node* node = root;
+  while (!node->is_leaf()) {
+    std::size_t child = node->template search<true>(key);
+    if (path != nullptr) {
+      path->nodes[path->depth] = node;
+      path->child[path->depth] = child;
+      path->depth++;
+    }
+    node = static_cast<Node*>(node->child(child));
+  }
+  return node;
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+LookupResult StringBTree<NodeBytes, NodeAllocator>::find(std::string_view key) const {
+  if (root == nullptr) {
+    return {false, nullptr};
+  }
+  Node* leaf = find_leaf(key, nullptr);
+  std::size_t idx = leaf->template search<false>(key);
+  if (idx < leaf->count && leaf->key_equals(idx, key)) {
+    return {true, static_cast<PageData*>(leaf->slots[idx].payload)};
+  }
+  return {false, nullptr};
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+std::size_t StringBTree<NodeBytes, NodeAllocator>::gather(const Node& node, EntryRef* refs) {
+  for (std::size_t i = 0; i < node.count; ++i) {
+    refs[i] = entry(node, i);
+  }
+  return node.count;
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+std::size_t StringBTree<NodeBytes, NodeAllocator>::common_prefix(const EntryRef& a, const EntryRef& b) {
+  std::size_t length = std::min(a.size(), b.size());
+  std::size_t i = 0;
+  // Usually both come from the same node and share its prefix outright.
+  if (a.prefix.data() == b.prefix.data()) {
+    i = std::min(a.prefix.size(), length);
+  }
+  while (i < length && a.at(i) == b.at(i)) {
+    i++;
+  }
+  return i;
+}
+
+// What refs[first, last) take up as a node of their own, under the prefix they'd share there.
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+std::size_t StringBTree<NodeBytes, NodeAllocator>::built_size(const EntryRef* refs, std::size_t first,
+                                                              std::size_t last) {
+  std::size_t size = Node::SLOTS_OFFSET + (last - first) * sizeof(Slot);
+  if (first == last) {
+    return size;
+  }
+  std::size_t shared = common_prefix(refs[first], refs[last - 1]);
+  size += shared;
+  for (std::size_t i = first; i < last; ++i) {
+    size += refs[i].size() - shared;
+  }
+  return size;
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+void StringBTree<NodeBytes, NodeAllocator>::build(Node& node, BTreeNodeType type, const EntryRef* refs,
+                                                  std::size_t first, std::size_t last, void* link) {
+  node.reset(type);
+  node.link = link;
+  if (first == last) {
+    return;
+  }
+  std::size_t shared = common_prefix(refs[first], refs[last - 1]);
+  auto [prefix_first, prefix_second] = refs[first].head(shared);
+  node.set_prefix(prefix_first, prefix_second);
+  for (std::size_t i = first; i < last; ++i) {
+    auto [suffix_first, suffix_second] = refs[i].tail(shared);
+    node.insert_at(node.count, suffix_first, suffix_second, refs[i].payload);
+  }
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+std::size_t StringBTree<NodeBytes, NodeAllocator>::copy_key(const EntryRef& ref, std::size_t length, char* out) {
+  auto [first, second] = ref.head(length);
+  std::ranges::copy(first, out);
+  std::ranges::copy(second, out + first.size());
+  return length;
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+bool StringBTree<NodeBytes, NodeAllocator>::try_insert(Node& node, std::size_t pos, std::string_view key,
+                                                       void* payload) {
+  if (key.starts_with(node.prefix())) {
+    std::string_view rest = key.substr(node.prefix_length);
+    std::size_t needed = sizeof(Slot) + rest.size();
+    if (node.contiguous_free() < needed) {
+      if (node.used_bytes() + needed > NodeBytes) {
+        return false;
+      }
+      // Enough room once the holes left by erased keys are gone.
+      EntryRef refs[Node::MAX_SLOTS];
+      std::size_t count = gather(node, refs);
+      Node compacted;
+      build(compacted, node.type, refs, 0, count, node.link);
+      std::memcpy(static_cast<void*>(&node), &compacted, sizeof(Node));
+      // The prefix may have come out longer than before, and might not cover key anymore.
+      if (!key.starts_with(node.prefix())) {
+        return try_insert(node, pos, key, payload);
+      }
+      rest = key.substr(node.prefix_length);
+    }
+    node.insert_at(pos, rest, {}, payload);
+    return true;
+  }
+
+  // The key sorts before or after everything in the node, and the prefix has to get shorter to take it. Worth it as
+  // long as all the longer stored keys still fit, otherwise it's a split.
+  EntryRef refs[Node::MAX_SLOTS + 1];
+  gather(node, refs);
+  std::copy_backward(refs + pos, refs + node.count, refs + node.count + 1);
+  refs[pos] = {{}, key, payload};
+  if (built_size(refs, 0, node.count + 1) > NodeBytes) {
+    return false;
+  }
+  Node rebuilt;
+  build(rebuilt, node.type, refs, 0, node.count + 1, node.link);
+  std::memcpy(static_cast<void*>(&node), &rebuilt, sizeof(Node));
+  return true;
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+typename StringBTree<NodeBytes, NodeAllocator>::Node*
+StringBTree<NodeBytes, NodeAllocator>::split(Node& node, std::size_t pos, std::string_view key, void* payload,
+                                             char* separator_out, std::size_t& separator_length) {
+  EntryRef refs[Node::MAX_SLOTS + 1];
+  std::size_t count = gather(node, refs);
+  std::copy_backward(refs + pos, refs + count, refs + count + 1);
+  refs[pos] = {{}, key, payload};
+  count++;
+
+  // A leaf split at m keeps [0, m) and moves [m, count), an internal one pushes key m up and keeps a key on each side.
+  const bool leaf = node.is_leaf();
+  const std::size_t lowest = 1;
+  const std::size_t highest = leaf ? count - 1 : count - 2;
+  auto fits = [&](std::size_t m) {
+    return built_size(refs, 0, m) <= NodeBytes && built_size(refs, leaf ? m : m + 1, count) <= NodeBytes;
+  };
+  // Start from the middle by bytes. When the new key doesn't share the node's prefix the halves can come out very
+  // differently from that estimate, so look further out until both sides fit (splitting off the new key alone always
+  // does).
+  std::size_t shared = common_prefix(refs[0], refs[count - 1]);
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    total += sizeof(Slot) + refs[i].size() - shared;
+  }
+  std::size_t middle = lowest;
+  for (std::size_t left_bytes = 0; middle < highest; ++middle) {
+    left_bytes += sizeof(Slot) + refs[middle - 1].size() - shared;
+    if (2 * left_bytes >= total) {
+      break;
+    }
+  }
+  std::size_t m = middle;
+  for (std::size_t distance = 1; !fits(m); ++distance) {
+    if (middle >= lowest + distance && fits(middle - distance)) {
+      m = middle - distance;
+    } else if (middle + distance <= highest) {
+      m = middle + distance;
+    }
+  }
+
+  Node* right = new_node(node.type);
+  Node left;
+  if (leaf) {
+    build(*right, BTreeNodeType::LeafNode, refs, m, count, node.link);
+    build(left, BTreeNodeType::LeafNode, refs, 0, m, right);
+    // Just enough of the right side's first key to be greater than the left side's last.
+    separator_length = copy_key(refs[m], common_prefix(refs[m - 1], refs[m]) + 1, separator_out);
+  } else {
+    build(*right, BTreeNodeType::BranchNode, refs, m + 1, count, node.link);
+    build(left, BTreeNodeType::BranchNode, refs, 0, m, refs[m].payload);
+    separator_length = copy_key(refs[m], refs[m].size(), separator_out);
+  }
+  std::memcpy(static_cast<void*>(&node), &left, sizeof(Node));
+  return right;
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+InsertResult StringBTree<NodeBytes, NodeAllocator>::insert(std::string_view key, PageData* data) {
+  if (key.size() > MAX_KEY_LENGTH) {
+    return InsertResult::Full;
+  }
+  if (root == nullptr) {
+    root = new_node(BTreeNodeType::LeafNode);
+    root->insert_at(0, key, {}, data);
+    return InsertResult::Success;
+  }
+
+  Path path;
+  Node* leaf = find_leaf(key, &path);
+  std::size_t pos = leaf->template search<false>(key);
+  if (pos < leaf->count && leaf->key_equals(pos, key)) {
+    return InsertResult::Duplicate;
+  }
+  if (try_insert(*leaf, pos, key, data)) {
+    return InsertResult::Success;
+  }
+  char separator[MAX_KEY_LENGTH];
+  std::size_t separator_length = 0;
+  Node* right = split(*leaf, pos, key, data, separator, separator_length);
+  insert_in_parent(path, leaf, {separator, separator_length}, right);
+  return InsertResult::Success;
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+void StringBTree<NodeBytes, NodeAllocator>::insert_in_parent(Path& path, Node* left, std::string_view separator,
+                                                             Node* right) {
+  // The separator to insert lives in one of these while the next one up is worked out in the other.
+  char buffers[2][MAX_KEY_LENGTH];
+  std::size_t next = 0;
+  while (true) {
+    if (path.depth == 0) {
+      root = new_node(BTreeNodeType::BranchNode);
+      root->insert_at(0, separator, {}, left);
+      root->link = right;
+      return;
+    }
+    path.depth--;
+    Node* parent = path.nodes[path.depth];
+    std::size_t pos = path.child[path.depth];
+    // left sits at pos. After the insert the separator is at pos with left before it and right after it.
+    parent->set_child(pos, right);
+    if (try_insert(*parent, pos, separator, left)) {
+      return;
+    }
+    std::size_t length = 0;
+    Node* sibling = split(*parent, pos, separator, left, buffers[next], length);
+    separator = {buffers[next], length};
+    next ^= 1;
+    left = parent;
+    right = sibling;
+  }
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+DeletionResult StringBTree<NodeBytes, NodeAllocator>::delete_key(std::string_view key) {
+  if (root == nullptr) {
+    return DeletionResult::KeyNotFound;
+  }
+  Path path;
+  Node* leaf = find_leaf(key, &path);
+  std::size_t pos = leaf->template search<false>(key);
+  if (pos == leaf->count || !leaf->key_equals(pos, key)) {
+    return DeletionResult::KeyNotFound;
+  }
+  leaf->erase(pos);
+  if (path.depth == 0) {
+    if (leaf->count == 0) {
+      free_node(leaf);
+      root = nullptr;
+    }
+    return DeletionResult::Success;
+  }
+  rebalance(path, leaf);
+  return DeletionResult::Success;
+}
+
+// Nodes below a quarter full get merged into a neighbour when the two fit in one node. With variable length keys
+// there's no taking over a fixed number of entries instead (a longer separator might not fit in the parent), so a
+// node that can't be merged just stays underfull, with one exception: an internal node left without keys gets one
+// rotated in, so every internal node keeps at least two children and the height stays logarithmic.
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+void StringBTree<NodeBytes, NodeAllocator>::rebalance(Path& path, Node* node) {
+  while (path.depth > 0 && node->used_bytes() < NodeBytes / 4) {
+    Node* parent = path.nodes[path.depth - 1];
+    std::size_t child = path.child[path.depth - 1];
+    // Prefer the left neighbour, the leftmost child has no left one.
+    bool node_is_left = child == 0;
+    std::size_t separator = node_is_left ? 0 : child - 1;
+    Node* left = node_is_left ? node : static_cast<Node*>(parent->child(child - 1));
+    Node* right = node_is_left ? static_cast<Node*>(parent->child(1)) : node;
+
+    if (!try_merge(left, right, parent, separator)) {
+      if (!node->is_leaf() && node->count == 0) {
+        rotate_into_empty(path, node);
+      }
+      return;
+    }
+    free_node(right);
+    // Separator and right go, left takes right's place after it.
+    parent->set_child(separator + 1, left);
+    parent->erase(separator);
+
+    path.depth--;
+    node = parent;
+    if (path.depth == 0 && parent->count == 0) {
+      root = static_cast<Node*>(parent->link);
+      free_node(parent);
+      return;
+    }
+  }
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+bool StringBTree<NodeBytes, NodeAllocator>::try_merge(Node* left, Node* right, Node* parent, std::size_t separator) {
+  EntryRef refs[2 * Node::MAX_SLOTS + 1];
+  std::size_t count = gather(*left, refs);
+  if (!left->is_leaf()) {
+    // The separator comes down between the two, over left's rightmost child.
+    refs[count++] = {parent->prefix(), parent->suffix(separator), left->link};
+  }
+  count += gather(*right, refs + count);
+  if (built_size(refs, 0, count) > NodeBytes) {
+    return false;
+  }
+  Node merged;
+  build(merged, left->type, refs, 0, count, right->link);
+  std::memcpy(static_cast<void*>(left), &merged, sizeof(Node));
+  return true;
+}
+
+// node is an internal node that lost its last key and couldn't be merged, so its neighbour is nearly full. The
+// separator between them comes down into node, along with the neighbour's nearest child, and the neighbour's nearest
+// key goes up in its place.
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+void StringBTree<NodeBytes, NodeAllocator>::rotate_into_empty(Path& path, Node* node) {
+  Node* parent = path.nodes[path.depth - 1];
+  std::size_t child = path.child[path.depth - 1];
+  bool node_is_left = child == 0;
+  std::size_t separator = node_is_left ? 0 : child - 1;
+  Node* sibling = static_cast<Node*>(parent->child(node_is_left ? 1 : child - 1));
+
+  char down[MAX_KEY_LENGTH];
+  std::size_t down_length = copy_key(entry(*parent, separator), entry(*parent, separator).size(), down);
+  std::size_t moved = node_is_left ? 0 : sibling->count - 1;
+  char up[MAX_KEY_LENGTH];
+  std::size_t up_length = copy_key(entry(*sibling, moved), entry(*sibling, moved).size(), up);
+
+  void* only_child = node->link;
+  node->reset(BTreeNodeType::BranchNode);
+  if (node_is_left) {
+    // [] -> only_child  becomes  [down -> only_child] -> sibling's first child.
+    node->insert_at(0, {down, down_length}, {}, only_child);
+    node->link = sibling->slots[0].payload;
+    sibling->erase(0);
+  } else {
+    // The sibling's rightmost child moves over, its last key's child becomes its rightmost.
+    node->insert_at(0, {down, down_length}, {}, sibling->link);
+    node->link = only_child;
+    sibling->link = sibling->slots[moved].payload;
+    sibling->erase(moved);
+  }
+
+  // Swap the separator in the parent. The new one can be longer, so it goes in like any other separator and may split
+  // the parent.
+  Node* left = node_is_left ? node : sibling;
+  Node* right = node_is_left ? sibling : node;
+  parent->erase(separator);
+  path.depth--;
+  path.child[path.depth] = separator;
+  path.depth++;
+  insert_in_parent(path, left, {up, up_length}, right);
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+template <typename Fn>
+void StringBTree<NodeBytes, NodeAllocator>::scan(std::string_view lower_bound, std::string_view upper_bound,
+                                                 Fn&& fn) const {
+  if (root == nullptr) {
+    return;
+  }
+  const Node* leaf = find_leaf(lower_bound, nullptr);
+  std::size_t idx = leaf->template search<false>(lower_bound);
+  std::string key;
+  for (; leaf != nullptr; leaf = static_cast<const Node*>(leaf->link), idx = 0) {
+    for (; idx < leaf->count; ++idx) {
+      key.assign(leaf->prefix());
+      key.append(leaf->suffix(idx));
+      if (!(std::string_view(key) < upper_bound) ||
+          !fn(std::string_view(key), static_cast<PageData*>(leaf->slots[idx].payload))) {
+        return;
+      }
+    }
+  }
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+std::vector<std::string> StringBTree<NodeBytes, NodeAllocator>::find_keys_in_range(std::string_view lower_bound,
+                                                                                   std::string_view upper_bound) const {
+  std::vector<std::string> result;
+  scan(lower_bound, upper_bound, [&](std::string_view key, PageData*) {
+    result.emplace_back(key);
+    return true;
+  });
+  return result;
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+bool StringBTree<NodeBytes, NodeAllocator>::validate() const {
+  if (root == nullptr) {
+    return node_count == 0;
+  }
+  std::size_t leaf_depth = 0;
+  const Node* prev_leaf = nullptr;
+  return validate_node(root, nullptr, nullptr, 0, leaf_depth, prev_leaf) && prev_leaf->link == nullptr;
+}
+
+template <std::size_t NodeBytes, template <typename> class NodeAllocator>
+bool StringBTree<NodeBytes, NodeAllocator>::validate_node(const Node* node, const std::string* lower,
+                                                          const std::string* upper, std::size_t depth,
+                                                          std::size_t& leaf_depth, const Node*& prev_leaf) const {
+  // Non-root leaves keep at least one key, internal nodes at least two children.
+  if (node->count > Node::MAX_SLOTS || node->used_bytes() > NodeBytes || (depth > 0 && node->count == 0) ||
+      (!node->is_leaf() && node->count == 0)) {
+    return false;
+  }
+  std::size_t heap_used = node->prefix_length;
+  std::vector<std::string> keys;
+  for (std::size_t i = 0; i < node->count; ++i) {
+    heap_used += node->slots[i].length;
+    if (node->slots[i].offset < node->heap_start || node->slots[i].head != Node::head_of(node->suffix(i))) {
+      return false;
+    }
+    keys.push_back(std::string(node->prefix()) + std::string(node->suffix(i)));
+    if (i > 0 && !(keys[i - 1] < keys[i])) return false;
+    if (lower != nullptr && keys[i] < *lower) return false;
+    if (upper != nullptr && !(keys[i] < *upper)) return false;
+  }
+  if (heap_used != node->heap_used) {
+    return false;
+  }
+
+  if (node->is_leaf()) {
+    if (prev_leaf == nullptr) {
+      leaf_depth = depth;
+    } else if (leaf_depth != depth || prev_leaf->link != node) {
+      return false;
+    }
+    prev_leaf = node;
+    return true;
+  }
+
+  for (std::size_t i = 0; i <= node->count; ++i) {
+    const std::string* child_lower = i == 0 ? lower : &keys[i - 1];
+    const std::string* child_upper = i == node->count ? upper : &keys[i];
+    if (!validate_node(static_cast<const Node*>(node->child(i)), child_lower, child_upper, depth + 1, leaf_depth,
+                       prev_leaf)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
@@ -1,6 +1,12 @@
 #include "btree.h"
 #include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
 
 void test_empty_array() {
   int arr[10] = {};
@@ -79,6 +85,54 @@ void test_single_element_greater() {
   assert(result.is_duplicate == false);
 }
 
+// Every search strategy has to agree with std::lower_bound/upper_bound, for every prefix length so the SIMD tail
+// handling gets exercised too.
+template <typename KeyType> void check_key_search() {
+  std::mt19937_64 rng(1);
+  std::set<KeyType> unique;
+  unique.insert(std::numeric_limits<KeyType>::lowest());
+  unique.insert(std::numeric_limits<KeyType>::max());
+  while (unique.size() < 70) {
+    unique.insert(static_cast<KeyType>(rng()));
+  }
+  std::vector<KeyType> keys(unique.begin(), unique.end());
+
+  std::vector<KeyType> queries(keys);
+  for (int i = 0; i < 100; ++i) {
+    queries.push_back(static_cast<KeyType>(rng()));
+  }
+
+  for (std::size_t count = 0; count <= keys.size(); ++count) {
+    for (const KeyType& query : queries) {
+      std::size_t lower = std::lower_bound(keys.begin(), keys.begin() + count, query) - keys.begin();
+      std::size_t upper = std::upper_bound(keys.begin(), keys.begin() + count, query) - keys.begin();
+
+      assert((key_rank<KeySearch::Linear, false>(keys.data(), count, query) == lower));
+      assert((key_rank<KeySearch::Linear, true>(keys.data(), count, query) == upper));
+      assert((key_rank<KeySearch::BranchlessBinary, false>(keys.data(), count, query) == lower));
+      assert((key_rank<KeySearch::BranchlessBinary, true>(keys.data(), count, query) == upper));
+      assert((key_rank<KeySearch::Generic, false>(keys.data(), count, query) == lower));
+      assert((key_rank<KeySearch::Generic, true>(keys.data(), count, query) == upper));
+    }
+  }
+}
+
+void test_key_search_strategies() {
+  check_key_search<std::int32_t>();
+  check_key_search<std::uint32_t>();
+  check_key_search<std::int64_t>();
+  check_key_search<std::uint64_t>();
+  check_key_search<float>();
+  check_key_search<double>();
+  check_key_search<std::int16_t>();
+}
+
+static_assert(pick_key_search<std::int32_t, 15>() == KeySearch::Linear);
+static_assert(pick_key_search<std::int32_t, 63>() == KeySearch::BranchlessBinary);
+static_assert(pick_key_search<std::uint64_t, 255>() == KeySearch::BranchlessBinary);
+static_assert(pick_key_search<std::int32_t, 0>() == KeySearch::BranchlessBinary);
+static_assert(pick_key_search<std::string, 63>() == KeySearch::Generic);
+
 int main() {
   test_empty_array();
   test_insert_at_beginning();
@@ -90,6 +144,7 @@ int main() {
   test_single_element_match();
   test_single_element_less();
   test_single_element_greater();
+  test_key_search_strategies();
 
   std::cout << "All tests passed!" << std::endl;
   return 0;
@@ -6,24 +6,85 @@
 #include <cstdint>
 
 #include <span>
+#include <type_traits>
+
+#include "btree_node_search.h"
 
 // Forward declarations
 template <typename KeyType, std::size_t N> class BTreeNode;
-template <typename KeyType, std::size_t N> class BTreeInternalNode;
-template <typename KeyType, std::size_t N> class BTreeLeafNode;
-template <typename KeyData, std::size_t N> class BTree;
-
-enum class BTreeNodeType { RootNode, BranchNode, LeafNode };
+template <typename KeyType, std::size_t N, typename Layout> class BTreeInternalNode;
+struct SortedInternalLayout;
+template <typename KeyType, std::size_t N, std::size_t LeafN = N> class BTreeLeafNode;
+template <typename KeyData, std::size_t N, template <typename> class NodeAllocator, typename InternalLayout,
+          std::size_t LeafN, typename Stats>
+class BTree;
+class PageData;
+
+enum class BTreeNodeType : std::uint8_t { RootNode, BranchNode, LeafNode };
+
+// Nodes are aligned to cache lines, and with the compact header below both node types come out at an exact number of
+// cache lines for the usual N (e.g. 64) with 4 and 8 byte keys.
+inline constexpr std::size_t NODE_ALIGNMENT = 64;
+
+// Narrowest unsigned type that can hold a key count of a node with N pointers.
+template <std::size_t N>
+using NodeCountType =
+    std::conditional_t<(N <= 256), std::uint8_t, std::conditional_t<(N <= 65536), std::uint16_t, std::uint32_t>>;
+
+// IoError is DiskBTree's: a page the insert needed couldn't be read or allocated, so the key wasn't stored (or the tree
+// is only partly updated, see DiskBTree::failed()).
+enum class InsertResult { Success, Duplicate, Full, IoError };
+
+// IoError is DiskBTree's, like InsertResult's.
+enum class DeletionResult { Success, KeyNotFound, IoError };
+
+// Outcome of BTree::upsert and friends. Inserted means the key is new, Assigned that the existing entry got a new
+// PageData*, KeyExists that it was there and left alone (try_emplace), KeyNotFound that update had nothing to update.
+enum class UpsertResult { Inserted, Assigned, KeyExists, KeyNotFound };
+
+// Outcome of BTree::bulk_load. On anything other than Success the tree is left untouched.
+enum class BulkLoadResult { Success, NotEmpty, Unsorted, Duplicate };
+
+// How BTree::compact repacks leaves.
+struct CompactionOptions {
+  // Fraction of each leaf to fill, clamped to between half and all of a leaf like bulk_load's. A run is packed into as
+  // few leaves as that allows with its entries spread evenly over them, so none ends up with fewer than the run's
+  // leaves had on average. That's all compact guarantees: a run of leaves that were all at or above the underflow
+  // threshold stays above it, one that already had leaves below it (see set_leaf_merge_threshold) may not.
+  double fill_factor = 0.9;
+  // Also move every leaf the pass goes through into a newly allocated one, in key order. With an allocator that hands
+  // those out one after the other (SlabNodeAllocator::create_sequential), a scan along right_sibling then walks memory
+  // front to back.
+  bool relocate = false;
+};
 
-enum class InsertResult { Success, Duplicate, Full };
+// Where an incremental BTree::compact pass is, handed to every slice. It only holds a key, no node pointers, so the tree
+// is free to change in between.
+template <typename KeyType> struct CompactionCursor {
+  // First key of the leaf the next slice starts at, once started.
+  KeyType next_key{};
+  bool started = false;
+  bool done = false;
+  // Totals for the pass so far.
+  std::size_t leaves_visited = 0;
+  std::size_t leaves_freed = 0;
+};
 
-enum class DeletionResult { Success, KeyNotFound };
+// Whether a bound of BTree::range includes the key itself.
+enum class RangeBound { Inclusive, Exclusive };
 
-template <typename KeyType, std::size_t N> struct FindResult {
-  BTreeLeafNode<KeyType, N>* leaf_node;
+template <typename KeyType, std::size_t N, std::size_t LeafN = N> struct FindResult {
+  BTreeLeafNode<KeyType, N, LeafN>* leaf_node;
   std::size_t idx;
 };
 
+// Lookup result for trees that can't hand out pointers into their nodes, because another thread may change or free
+// the node right after.
+struct LookupResult {
+  bool found;
+  PageData* data;
+};
+
 struct InsertPosition {
   size_t index;
   bool is_duplicate;
@@ -37,6 +98,34 @@ template <typename KeyType, std::size_t N> struct SiblingInfo {
   bool is_left_sibling;           // True if sibling is to the left of node
 };
 
+// Most levels a tree with N pointers per node can ever have. Every internal node but the root keeps at least
+// ceil(N / 2) children, so it takes that many more entries to grow by a level, and there aren't 2^64 entries to go
+// around.
+template <std::size_t N> constexpr std::size_t max_tree_height() {
+  const std::size_t min_fanout = std::max<std::size_t>((N + 1) / 2, 2);
+  std::size_t height = 2;
+  for (std::size_t leaves = 2; leaves < (std::size_t{1} << 62) / min_fanout; leaves *= min_fanout) {
+    height++;
+  }
+  return height + 1;
+}
+
+// The internal nodes passed on the way down to a leaf, root first. Lives on the stack with room for the tallest
+// possible tree, so walking down to insert or delete doesn't allocate.
+template <typename KeyType, std::size_t N> class NodePath {
+public:
+  void push_back(BTreeNode<KeyType, N>* node) { nodes[count++] = node; }
+  void pop_back() { count--; }
+  BTreeNode<KeyType, N>* back() const { return nodes[count - 1]; }
+  bool empty() const { return count == 0; }
+  std::size_t size() const { return count; }
+  BTreeNode<KeyType, N>* operator[](std::size_t i) const { return nodes[i]; }
+
+private:
+  BTreeNode<KeyType, N>* nodes[max_tree_height<N>() - 1];
+  std::size_t count = 0;
+};
+
 // 4KB page data block, that the leaf_nodes points to.
 class PageData {
 public:
@@ -54,25 +143,26 @@ private:
   uint8_t data[PAGE_SIZE];
 };
 
-// Abstract base class for BTree nodes
+// Common header of BTree nodes. There's no vtable, the type tag tells which node this is and the tree static_casts to
+// the right one. Nodes are never destroyed through this base, the tree hands them back to its allocator by type.
 template <typename KeyType, std::size_t N> class BTreeNode {
 public:
   BTreeNodeType type;
-  std::size_t numKeys;
+  NodeCountType<N> numKeys;
 
-  BTreeNode(BTreeNodeType nodeType) : type(nodeType), numKeys(0) {}
-  virtual ~BTreeNode() = default;
+  bool isLeaf() const { return type == BTreeNodeType::LeafNode; }
 
-  virtual bool isFull() const = 0;
-  virtual bool isLeaf() const = 0;
+protected:
+  BTreeNode(BTreeNodeType nodeType) : type(nodeType), numKeys(0) {}
+  ~BTreeNode() = default;
 };
 
-template <typename DataType>
+// Capacity is the most keys the array can ever hold, it picks the search used (see btree_node_search.h). Leaving it at
+// 0 means unknown, which never picks the linear scan.
+template <std::size_t Capacity = 0, typename DataType>
 InsertPosition find_index_greater_than_or_equal(std::span<const DataType> array, DataType value) {
-  auto it = std::ranges::lower_bound(array, value);
-
-  size_t index = std::distance(array.begin(), it);
-  bool is_duplicate = (it != array.end() && *it == value);
+  size_t index = node_lower_bound<Capacity>(array.data(), array.size(), value);
+  bool is_duplicate = (index != array.size() && array[index] == value);
 
   return {index, is_duplicate};
 }
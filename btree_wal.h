@@ -0,0 +1,363 @@
+#ifndef BTREE_WAL_H
+#define BTREE_WAL_H
+
+#include "btree.h"
+#include "btree_page_file.h"
+#include "btree_snapshot.h"
+#include "btree_types.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Write-ahead log of logical operations (insert key with value, delete key), and DurableBTree, a BTree that logs every
+// change and can be recovered after a crash from its last checkpoint plus the log.
+//
+// Records are fixed size and carry their own checksum. A crash in the middle of writing one leaves a torn record at the
+// end, replay stops at the first record that doesn't check out and the log is cut back to there.
+
+enum class WalRecordType : std::uint8_t { Insert = 1, Delete = 2 };
+
+// How records make it to disk. Records are collected in memory and written a group at a time (one write() call per
+// group), and only every so many groups does the log get fsync'ed. An operation is durable once its group has been
+// fsync'ed, or after sync(). With the defaults a crash can lose the last 64 records, group_size = 1 and
+// groups_per_sync = 1 loses nothing but syncs on every operation.
+struct WalOptions {
+  std::size_t group_size = 64;
+  // 0 never syncs on its own, only sync() and checkpoints do.
+  std::size_t groups_per_sync = 1;
+};
+
+template <typename KeyType> class WriteAheadLog {
+  static_assert(std::is_trivially_copyable_v<KeyType>, "keys are written to disk as raw bytes");
+
+public:
+  // type, key and value, each padded to whole words, then the checksum.
+  static constexpr std::size_t KEY_BYTES = (sizeof(KeyType) + 7) / 8 * 8;
+  static constexpr std::size_t RECORD_SIZE = 8 + KEY_BYTES + 8 + 8;
+
+  WriteAheadLog() = default;
+  WriteAheadLog(const WriteAheadLog&) = delete;
+  WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+  ~WriteAheadLog() { close(); }
+
+  // Opens the log at path, creating it if it's not there. Every intact record already in the log is handed to
+  // replay(type, key, value) in order, anything after the last intact one is cut off.
+  template <typename Replay>
+  [[nodiscard]] FileResult open(const std::string& path, const WalOptions& options, Replay&& replay);
+  // Writes whatever is still buffered, without syncing.
+  void close();
+
+  // Appending to a log that isn't open can't log anything, so it counts as an I/O error.
+  void append(WalRecordType type, const KeyType& key, std::uint64_t value);
+  // Writes the buffered records and fsyncs, everything appended so far is durable once this returns true.
+  [[nodiscard]] bool sync();
+  // Empties the log, for after a checkpoint that has everything in it.
+  [[nodiscard]] bool reset();
+
+  // Same as PageFile, an I/O error sticks.
+  bool failed() const { return io_failed; }
+
+private:
+  static constexpr char MAGIC[8] = {'B', 'P', 'T', 'R', 'E', 'W', 'A', 'L'};
+  static constexpr std::size_t HEADER_SIZE = 64;
+
+  struct Header {
+    char magic[8];
+    std::uint64_t layout;
+    std::uint64_t record_size;
+  };
+
+  int fd = -1;
+  bool io_failed = false;
+  WalOptions options;
+  // Where the next group goes.
+  std::uint64_t end = HEADER_SIZE;
+  std::vector<unsigned char> group;
+  std::size_t buffered = 0;
+  std::size_t groups_since_sync = 0;
+
+  // Writes out the current group, fsyncing if it's time to.
+  void commit_group();
+  bool write_all(const unsigned char* bytes, std::size_t size, std::uint64_t offset);
+};
+
+template <typename KeyType>
+template <typename Replay>
+FileResult WriteAheadLog<KeyType>::open(const std::string& path, const WalOptions& wal_options, Replay&& replay) {
+  close();
+  io_failed = false;
+  options = wal_options;
+  options.group_size = std::max<std::size_t>(options.group_size, 1);
+  group.assign(options.group_size * RECORD_SIZE, 0);
+  buffered = 0;
+  groups_since_sync = 0;
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    close();
+    return FileResult::IoError;
+  }
+
+  Header header{};
+  if (static_cast<std::uint64_t>(st.st_size) < HEADER_SIZE) {
+    // New, or a crash before the header made it, either way nothing was logged yet.
+    unsigned char bytes[HEADER_SIZE] = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.layout = key_layout_tag<KeyType>();
+    header.record_size = RECORD_SIZE;
+    std::memcpy(bytes, &header, sizeof(header));
+    if (ftruncate(fd, 0) != 0 || !write_all(bytes, HEADER_SIZE, 0) || fdatasync(fd) != 0) {
+      close();
+      return FileResult::IoError;
+    }
+    end = HEADER_SIZE;
+    return FileResult::Success;
+  }
+
+  if (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+    close();
+    return FileResult::IoError;
+  }
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.record_size != RECORD_SIZE) {
+    ::close(fd);
+    fd = -1;
+    return FileResult::BadFormat;
+  }
+  if (header.layout != key_layout_tag<KeyType>()) {
+    ::close(fd);
+    fd = -1;
+    return FileResult::LayoutMismatch;
+  }
+
+  // Replay a group's worth of records at a time.
+  end = HEADER_SIZE;
+  const std::uint64_t file_size = static_cast<std::uint64_t>(st.st_size);
+  bool intact = true;
+  while (intact && end + RECORD_SIZE <= file_size) {
+    std::uint64_t whole_records = (file_size - end) / RECORD_SIZE * RECORD_SIZE;
+    std::size_t size = static_cast<std::size_t>(std::min<std::uint64_t>(group.size(), whole_records));
+    if (pread(fd, group.data(), size, static_cast<off_t>(end)) != static_cast<ssize_t>(size)) {
+      close();
+      return FileResult::IoError;
+    }
+    for (std::size_t offset = 0; offset < size; offset += RECORD_SIZE) {
+      const unsigned char* record = group.data() + offset;
+      std::uint64_t checksum;
+      std::memcpy(&checksum, record + RECORD_SIZE - 8, sizeof(checksum));
+      auto type = static_cast<WalRecordType>(record[0]);
+      if (checksum != snapshot_checksum(0, record, RECORD_SIZE - 8) ||
+          (type != WalRecordType::Insert && type != WalRecordType::Delete)) {
+        intact = false;
+        break;
+      }
+      KeyType key;
+      std::uint64_t value;
+      std::memcpy(&key, record + 8, sizeof(KeyType));
+      std::memcpy(&value, record + 8 + KEY_BYTES, sizeof(value));
+      replay(type, key, value);
+      end += RECORD_SIZE;
+    }
+  }
+  if (end != file_size && (ftruncate(fd, static_cast<off_t>(end)) != 0 || fdatasync(fd) != 0)) {
+    close();
+    return FileResult::IoError;
+  }
+  return FileResult::Success;
+}
+
+template <typename KeyType> void WriteAheadLog<KeyType>::close() {
+  if (fd < 0) {
+    return;
+  }
+  write_all(group.data(), buffered, end);
+  buffered = 0;
+  ::close(fd);
+  fd = -1;
+}
+
+template <typename KeyType>
+void WriteAheadLog<KeyType>::append(WalRecordType type, const KeyType& key, std::uint64_t value) {
+  if (fd < 0) {
+    io_failed = true;
+    return;
+  }
+  unsigned char* record = group.data() + buffered;
+  std::memset(record, 0, RECORD_SIZE);
+  record[0] = static_cast<unsigned char>(type);
+  std::memcpy(record + 8, &key, sizeof(KeyType));
+  std::memcpy(record + 8 + KEY_BYTES, &value, sizeof(value));
+  std::uint64_t checksum = snapshot_checksum(0, record, RECORD_SIZE - 8);
+  std::memcpy(record + RECORD_SIZE - 8, &checksum, sizeof(checksum));
+  buffered += RECORD_SIZE;
+  if (buffered == group.size()) {
+    commit_group();
+  }
+}
+
+template <typename KeyType> void WriteAheadLog<KeyType>::commit_group() {
+  // On a failed write the group is dropped all the same, nothing is going to make it to the log anymore anyway.
+  if (write_all(group.data(), buffered, end)) {
+    end += buffered;
+  }
+  buffered = 0;
+  if (!io_failed && options.groups_per_sync != 0 && ++groups_since_sync >= options.groups_per_sync) {
+    groups_since_sync = 0;
+    if (fdatasync(fd) != 0) {
+      io_failed = true;
+    }
+  }
+}
+
+template <typename KeyType> bool WriteAheadLog<KeyType>::sync() {
+  if (write_all(group.data(), buffered, end)) {
+    end += buffered;
+  }
+  buffered = 0;
+  groups_since_sync = 0;
+  if (io_failed || fdatasync(fd) != 0) {
+    io_failed = true;
+  }
+  return !io_failed;
+}
+
+template <typename KeyType> bool WriteAheadLog<KeyType>::reset() {
+  buffered = 0;
+  groups_since_sync = 0;
+  if (io_failed || ftruncate(fd, HEADER_SIZE) != 0 || fdatasync(fd) != 0) {
+    io_failed = true;
+  }
+  end = HEADER_SIZE;
+  return !io_failed;
+}
+
+template <typename KeyType>
+bool WriteAheadLog<KeyType>::write_all(const unsigned char* bytes, std::size_t size, std::uint64_t offset) {
+  std::size_t done = 0;
+  while (!io_failed && done < size) {
+    ssize_t n = pwrite(fd, bytes + done, size - done, static_cast<off_t>(offset + done));
+    if (n <= 0) {
+      io_failed = true;
+    } else {
+      done += static_cast<std::size_t>(n);
+    }
+  }
+  return !io_failed;
+}
+
+// A BTree whose changes survive a crash. Every successful insert/delete_key is logged, checkpoint() writes the whole
+// tree out as a snapshot (see btree_snapshot.h) and empties the log. open() recovers: the last snapshot is bulk loaded
+// and the log replayed on top.
+//
+// The checkpoint replaces the snapshot before the log is emptied, so a crash in between replays the log onto a
+// snapshot that already has its changes. That only works out if the log holds every change the snapshot has, so the
+// checkpoint syncs the log before writing the snapshot. Replaying all of it then ends with each key where its last
+// record put it, same as in the snapshot. Replaying only a prefix wouldn't: a key inserted in the synced part and
+// deleted in a group that was still buffered would come back.
+//
+// The log and snapshot hold a 64 bit value per key. value_of turns a PageData* into that value and data_of turns it
+// back on recovery. The default just stores the address, which only means something to a process that hands out
+// PageData* as handles it can resolve again (e.g. page numbers), not to one pointing at heap memory.
+template <typename KeyType, std::size_t N> class DurableBTree {
+public:
+  using ValueOf = std::uint64_t (*)(PageData*);
+  using DataOf = PageData* (*)(std::uint64_t);
+
+  explicit DurableBTree(WalOptions options = {}, ValueOf value_of = address_of, DataOf data_of = from_address)
+      : options(options), value_of(value_of), data_of(data_of) {}
+
+  // Recovers the tree stored at path (path + ".snap" and path + ".wal"), or starts an empty one. Only once, on a tree
+  // that's still empty.
+  [[nodiscard]] FileResult open(const std::string& path);
+
+  [[nodiscard]] InsertResult insert(const KeyType& key, PageData* data);
+  [[nodiscard]] DeletionResult delete_key(const KeyType& key);
+
+  // Everything so far is durable once this returns true.
+  [[nodiscard]] bool sync() { return wal.sync(); }
+  // Snapshots the tree and empties the log, so the next recovery doesn't have as much to replay.
+  [[nodiscard]] bool checkpoint() { return write_snapshot() && wal.reset(); }
+  // The first half of checkpoint(): syncs the log and replaces the snapshot, but keeps the log.
+  [[nodiscard]] bool write_snapshot();
+  bool failed() const { return wal.failed(); }
+
+  // For lookups and scans, changes have to go through insert/delete_key above to be logged.
+  const BTree<KeyType, N>& tree() const { return btree; }
+  // Records replayed by the last open().
+  std::size_t replayed() const { return replayed_records; }
+
+private:
+  BTree<KeyType, N> btree;
+  WriteAheadLog<KeyType> wal;
+  WalOptions options;
+  ValueOf value_of;
+  DataOf data_of;
+  std::string snapshot_path;
+  std::size_t replayed_records = 0;
+
+  static std::uint64_t address_of(PageData* data) { return reinterpret_cast<std::uintptr_t>(data); }
+  static PageData* from_address(std::uint64_t value) { return reinterpret_cast<PageData*>(value); }
+};
+
+template <typename KeyType, std::size_t N> FileResult DurableBTree<KeyType, N>::open(const std::string& path) {
+  snapshot_path = path + ".snap";
+
+  if (::access(snapshot_path.c_str(), F_OK) == 0) {
+    BTreeSnapshot<KeyType> snapshot;
+    if (FileResult result = snapshot.open(snapshot_path); result != FileResult::Success) {
+      return result;
+    }
+    // The snapshot is only ever renamed into place once it's complete, so a bad checksum isn't a crash, it's damage.
+    if (!snapshot.verify()) {
+      return FileResult::BadFormat;
+    }
+    std::vector<std::pair<KeyType, PageData*>> entries;
+    entries.reserve(snapshot.size());
+    snapshot.for_each([&](const KeyType& key, std::uint64_t value) { entries.emplace_back(key, data_of(value)); });
+    if (btree.bulk_load(entries) != BulkLoadResult::Success) {
+      return FileResult::BadFormat;
+    }
+  }
+
+  return wal.open(path + ".wal", options, [&](WalRecordType type, const KeyType& key, std::uint64_t value) {
+    replayed_records++;
+    if (type == WalRecordType::Insert) {
+      // Replaying an insert the snapshot already has is fine as long as we end up with the logged value.
+      (void)btree.insert_or_assign(key, data_of(value));
+    } else {
+      (void)btree.delete_key(key);
+    }
+  });
+}
+
+template <typename KeyType, std::size_t N>
+InsertResult DurableBTree<KeyType, N>::insert(const KeyType& key, PageData* data) {
+  InsertResult result = btree.insert(key, data);
+  if (result == InsertResult::Success) {
+    wal.append(WalRecordType::Insert, key, value_of(data));
+  }
+  return result;
+}
+
+template <typename KeyType, std::size_t N> DeletionResult DurableBTree<KeyType, N>::delete_key(const KeyType& key) {
+  DeletionResult result = btree.delete_key(key);
+  if (result == DeletionResult::Success) {
+    wal.append(WalRecordType::Delete, key, 0);
+  }
+  return result;
+}
+
+template <typename KeyType, std::size_t N> bool DurableBTree<KeyType, N>::write_snapshot() {
+  return wal.sync() && BTreeSnapshot<KeyType>::write(snapshot_path, btree, value_of) == FileResult::Success;
+}
+
+#endif
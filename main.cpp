@@ -1,6 +1,9 @@
+#include <array>
+#include <cstddef>
 #include <iostream>
 #include <limits>
 #include <string>
+#include <utility>
 #include "btree.h"
 
 template <std::size_t N>
@@ -93,26 +96,17 @@ void run_demo() {
     }
 }
 
-// Template metaprogramming to support dynamic order selection at runtime
-// We instantiate run_demo for a range of N values.
-template <std::size_t N>
-struct DemoRunner {
-    static void run(int n) {
-        if (n == N) {
-            run_demo<N>();
-        } else {
-            DemoRunner<N + 1>::run(n);
-        }
-    }
-};
+// The tree's order is a template parameter, so each order the demo offers is its own instantiation. They go into a
+// table indexed by order, built in one go from an index sequence instead of recursing through every order.
+constexpr std::size_t MIN_ORDER = 3;
+constexpr std::size_t MAX_ORDER = 20;
 
-// Base case for recursion (stop at a reasonable max limit, e.g., 20)
-template <>
-struct DemoRunner<21> {
-    static void run(int n) {
-        std::cout << "Order " << n << " is too large for this demo (max 20)." << std::endl;
-    }
-};
+template <std::size_t... I>
+constexpr auto make_demo_table(std::index_sequence<I...>) {
+    return std::array<void (*)(), sizeof...(I)>{&run_demo<MIN_ORDER + I>...};
+}
+
+constexpr auto DEMOS = make_demo_table(std::make_index_sequence<MAX_ORDER - MIN_ORDER + 1>());
 
 int main() {
     std::cout << "Enter B+ Tree Order (N): ";
@@ -122,8 +116,11 @@ int main() {
         return 1;
     }
 
-    // Dispatch to the appropriate template instantiation
-    DemoRunner<3>::run(n);
+    if (static_cast<std::size_t>(n) > MAX_ORDER) {
+        std::cout << "Order " << n << " is too large for this demo (max " << MAX_ORDER << ")." << std::endl;
+    } else {
+        DEMOS[n - MIN_ORDER]();
+    }
 
     std::cout << "\nExiting..." << std::endl;
     return 0;
@@ -1,11 +1,77 @@
 #include "btree.h"
+#include "btree_concurrent.h"
+#include "btree_disk.h"
+#include "btree_multimap.h"
+#include "btree_snapshot.h"
+#include "btree_string.h"
+#include "btree_wal.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <new>
+#include <random>
+#include <ranges>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Every heap allocation the test binary makes goes through these, so a test can tell how many one operation costs.
+// They're all kept out of line: inlined, GCC sees malloc paired with operator delete (or operator new with free) and
+// warns about the mismatch.
+static std::atomic<std::size_t> heap_allocations{0};
+
+[[gnu::noinline]] void* operator new(std::size_t size) {
+  heap_allocations++;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+  throw std::bad_alloc();
+}
+[[gnu::noinline]] void* operator new(std::size_t size, std::align_val_t align) {
+  heap_allocations++;
+  auto alignment = static_cast<std::size_t>(align);
+  if (void* ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) return ptr;
+  throw std::bad_alloc();
+}
+// The standard library's temporary buffers (e.g. std::inplace_merge) come from here.
+[[gnu::noinline]] void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  heap_allocations++;
+  return std::malloc(size == 0 ? 1 : size);
+}
+[[gnu::noinline]] void operator delete(void* ptr) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+template <typename Fn> std::size_t allocations_during(Fn&& fn) {
+  std::size_t before = heap_allocations.load();
+  fn();
+  return heap_allocations.load() - before;
+}
 
 // Mock PageData for testing
 // We don't need actual data for these tests, just the pointer type
 // But since PageData is defined in btree_fwd.h and used, we can just use nullptr or create dummy objects.
 
+// Pages are never dereferenced by the tree, so any distinct pointer will do to check they come back with their key.
+// The log and snapshot store them by address.
+PageData* page_for(std::uint64_t key) { return reinterpret_cast<PageData*>(key * 8 + 8); }
+
 void test_insert_empty_tree() {
   std::cout << "Testing insert into empty tree..." << std::endl;
   BTree<int, 3> tree; // Small N for easy testing
@@ -204,6 +270,1708 @@ void test_delete_redistribute() {
   std::cout << "Passed!" << std::endl;
 }
 
+template <std::size_t N, std::size_t LeafN = N> void check_bulk_load(int count, double fill_factor) {
+  std::vector<std::pair<int, PageData*>> entries;
+  for (int i = 0; i < count; ++i) {
+    entries.emplace_back(i * 2, nullptr);
+  }
+
+  BTree<int, N, HeapNodeAllocator, SortedInternalLayout, LeafN> tree;
+  assert(tree.bulk_load(entries, fill_factor) == BulkLoadResult::Success);
+  assert(tree.validate());
+
+  for (int i = 0; i < count; ++i) {
+    assert(tree.find(i * 2).leaf_node != nullptr);
+    assert(tree.find(i * 2 + 1).leaf_node == nullptr);
+  }
+
+  // Every leaf but a lone root has to be at or above the underflow threshold.
+  if (count > 0) {
+    auto* leaf = tree.find(0).leaf_node;
+    bool single_leaf = leaf->right_sibling == nullptr;
+    for (; leaf != nullptr; leaf = leaf->right_sibling) {
+      assert(single_leaf || !leaf->isUnderflow());
+    }
+  }
+
+  assert(tree.find_keys_in_range(0, count * 2).size() == static_cast<std::size_t>(count));
+
+  // Regular inserts and deletes keep working on a bulk loaded tree.
+  for (int i = 0; i < count; i += 3) {
+    assert(tree.insert(i * 2 + 1, nullptr) == InsertResult::Success);
+  }
+  for (int i = 0; i < count; i += 2) {
+    assert(tree.delete_key(i * 2) == DeletionResult::Success);
+  }
+  assert(tree.validate());
+}
+
+void test_bulk_load() {
+  std::cout << "Testing bulk load..." << std::endl;
+  for (int count : {0, 1, 2, 3, 5, 17, 100, 1000}) {
+    for (double fill : {0.0, 0.5, 0.7, 1.0}) {
+      check_bulk_load<3>(count, fill);
+      check_bulk_load<4>(count, fill);
+      check_bulk_load<5>(count, fill);
+      check_bulk_load<16>(count, fill);
+      check_bulk_load<3, 9>(count, fill);
+      check_bulk_load<9, 3>(count, fill);
+    }
+  }
+  std::cout << "Passed!" << std::endl;
+}
+
+void test_bulk_load_rejects_bad_input() {
+  std::cout << "Testing bulk load input validation..." << std::endl;
+  BTree<int, 4> tree;
+
+  std::vector<std::pair<int, PageData*>> unsorted = {{1, nullptr}, {5, nullptr}, {3, nullptr}};
+  assert(tree.bulk_load(unsorted) == BulkLoadResult::Unsorted);
+  assert(tree.find(1).leaf_node == nullptr);
+
+  std::vector<std::pair<int, PageData*>> duplicate = {{1, nullptr}, {2, nullptr}, {3, nullptr}, {4, nullptr},
+                                                      {4, nullptr}};
+  assert(tree.bulk_load(duplicate) == BulkLoadResult::Duplicate);
+  assert(tree.find(1).leaf_node == nullptr);
+
+  std::vector<std::pair<int, PageData*>> sorted = {{1, nullptr}, {2, nullptr}};
+  assert(tree.bulk_load(sorted) == BulkLoadResult::Success);
+  assert(tree.bulk_load(sorted) == BulkLoadResult::NotEmpty);
+  std::cout << "Passed!" << std::endl;
+}
+
+void test_slab_allocator_reuses_nodes() {
+  std::cout << "Testing slab node allocator..." << std::endl;
+  SlabNodeAllocator<BTreeLeafNode<int, 8>> allocator;
+  auto* first = allocator.create();
+  auto* second = allocator.create();
+  assert(reinterpret_cast<std::uintptr_t>(first) % 64 == 0);
+  assert(reinterpret_cast<std::uintptr_t>(second) % 64 == 0);
+  assert(first->numKeys == 0 && first->right_sibling == nullptr);
+
+  // Freed nodes are handed out again before any new memory.
+  allocator.destroy(first);
+  assert(allocator.create() == first);
+  std::cout << "Passed!" << std::endl;
+}
+
+template <typename Tree> void check_churn() {
+  Tree tree;
+  std::set<int> expected;
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> dist(0, 2000);
+
+  for (int i = 0; i < 20000; ++i) {
+    int key = dist(rng);
+    if (rng() % 2 == 0) {
+      bool inserted = expected.insert(key).second;
+      assert(tree.insert(key, nullptr) == (inserted ? InsertResult::Success : InsertResult::Duplicate));
+    } else {
+      bool erased = expected.erase(key) == 1;
+      assert(tree.delete_key(key) == (erased ? DeletionResult::Success : DeletionResult::KeyNotFound));
+    }
+  }
+
+  assert(tree.validate());
+  std::vector<int> keys = tree.find_keys_in_range(0, 2001);
+  assert(std::ranges::equal(keys, expected));
+  for (int key : expected) {
+    assert(tree.find(key).leaf_node != nullptr);
+  }
+}
+
+void test_insert_delete_churn() {
+  std::cout << "Testing insert/delete churn with heap and slab allocated nodes..." << std::endl;
+  check_churn<BTree<int, 5, HeapNodeAllocator>>();
+  check_churn<BTree<int, 5, SlabNodeAllocator>>();
+  // Leaves and internal nodes of different sizes, both ways round.
+  check_churn<BTree<int, 4, HeapNodeAllocator, SortedInternalLayout, 9>>();
+  check_churn<BTree<int, 9, HeapNodeAllocator, EytzingerInternalLayout, 4>>();
+  check_churn<SizedBTree<int, 256>>();
+  std::cout << "Passed!" << std::endl;
+}
+
+// Random ranges of every width, from nothing to all of it, against std::set. Each round starts from a freshly filled
+// tree so both dense and sparse trees get cut.
+template <typename Tree> void check_delete_range() {
+  std::mt19937 rng(19);
+  for (int round = 0; round < 60; ++round) {
+    Tree tree;
+    std::set<int> expected;
+    int key_space = 50 + static_cast<int>(rng() % 3000);
+    for (int i = 0; i < key_space; ++i) {
+      int key = static_cast<int>(rng() % key_space);
+      expected.insert(key);
+      (void)tree.insert(key, nullptr);
+    }
+    for (int cut = 0; cut < 8 && !expected.empty(); ++cut) {
+      int lower = static_cast<int>(rng() % (key_space + 20)) - 10;
+      int width = static_cast<int>(rng() % 4 == 0 ? rng() % (key_space + 20) : rng() % 40);
+      int upper = lower + width;
+      std::size_t count = std::distance(expected.lower_bound(lower), expected.lower_bound(std::max(lower, upper)));
+      expected.erase(expected.lower_bound(lower), expected.lower_bound(std::max(lower, upper)));
+      assert(tree.delete_range(lower, upper) == count);
+      assert(tree.validate());
+      assert(std::ranges::equal(tree.find_keys_in_range(-20, key_space + 20), expected));
+      std::size_t iterated = 0;
+      for (auto entry : tree) {
+        assert(expected.contains(entry.key));
+        iterated++;
+      }
+      assert(iterated == expected.size());
+    }
+    // And the rest, after which the tree can still be used.
+    assert(tree.delete_range(-20, key_space + 20) == expected.size());
+    assert(tree.validate() && tree.begin() == tree.end());
+    assert(tree.insert(7, nullptr) == InsertResult::Success && tree.validate());
+  }
+}
+
+void test_delete_range() {
+  std::cout << "Testing range deletion..." << std::endl;
+  check_delete_range<BTree<int, 3>>();
+  check_delete_range<BTree<int, 4>>();
+  check_delete_range<BTree<int, 5, SlabNodeAllocator>>();
+  check_delete_range<BTree<int, 16>>();
+  check_delete_range<BTree<int, 4, HeapNodeAllocator, SortedInternalLayout, 9>>();
+  check_delete_range<BTree<int, 9, HeapNodeAllocator, EytzingerInternalLayout, 4>>();
+  std::cout << "Passed!" << std::endl;
+}
+
+// Writers insert and delete keys of their own residue class while readers check that keys which are never touched stay
+// visible the whole time. Afterwards the tree has to hold exactly what the writers think it holds.
+template <std::size_t N> void check_concurrent_stress(int writers, int readers, int ops_per_writer) {
+  constexpr int KEY_SPACE = 20000;
+  const int stride = writers + 1;
+  ConcurrentBTree<int, N> tree;
+
+  // Residue 0 is never written after this.
+  for (int key = 0; key < KEY_SPACE; key += stride) {
+    assert(tree.insert(key, nullptr) == InsertResult::Success);
+  }
+
+  std::vector<std::set<int>> owned(writers);
+  std::atomic<bool> stop{false};
+  std::atomic<int> failures{0};
+  std::vector<std::thread> threads;
+
+  for (int w = 0; w < writers; ++w) {
+    threads.emplace_back([&, w] {
+      std::mt19937 rng(w);
+      std::uniform_int_distribution<int> dist(0, KEY_SPACE / stride - 1);
+      for (int i = 0; i < ops_per_writer; ++i) {
+        int key = dist(rng) * stride + w + 1;
+        if (rng() % 3 != 0) {
+          bool inserted = owned[w].insert(key).second;
+          if (tree.insert(key, nullptr) != (inserted ? InsertResult::Success : InsertResult::Duplicate)) failures++;
+        } else {
+          bool erased = owned[w].erase(key) == 1;
+          if (tree.delete_key(key) != (erased ? DeletionResult::Success : DeletionResult::KeyNotFound)) failures++;
+        }
+      }
+    });
+  }
+
+  for (int r = 0; r < readers; ++r) {
+    threads.emplace_back([&, r] {
+      std::mt19937 rng(100 + r);
+      std::uniform_int_distribution<int> dist(0, KEY_SPACE / stride - 1);
+      while (!stop.load()) {
+        int key = dist(rng) * stride;
+        if (!tree.find(key).found) failures++;
+
+        std::vector<int> keys = tree.find_keys_in_range(key, key + 50 * stride);
+        if (!std::ranges::is_sorted(keys) || std::ranges::adjacent_find(keys) != keys.end()) failures++;
+        for (int stable = key; stable < std::min(key + 50 * stride, KEY_SPACE); stable += stride) {
+          if (!std::ranges::binary_search(keys, stable)) failures++;
+        }
+      }
+    });
+  }
+
+  for (int w = 0; w < writers; ++w) {
+    threads[w].join();
+  }
+  stop = true;
+  for (std::size_t t = writers; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+
+  assert(failures == 0);
+  assert(tree.validate());
+
+  std::set<int> expected;
+  for (int key = 0; key < KEY_SPACE; key += stride) {
+    expected.insert(key);
+  }
+  for (const auto& keys : owned) {
+    expected.insert(keys.begin(), keys.end());
+  }
+  assert(std::ranges::equal(tree.find_keys_in_range(0, KEY_SPACE), expected));
+}
+
+void test_concurrent_btree() {
+  std::cout << "Testing concurrent tree under mixed readers and writers..." << std::endl;
+  check_concurrent_stress<4>(3, 2, 20000);
+  check_concurrent_stress<8>(4, 4, 20000);
+  check_concurrent_stress<64>(4, 2, 20000);
+
+  // Emptying the tree completely goes through every merge path, down to a single empty leaf.
+  ConcurrentBTree<int, 4> tree;
+  for (int i = 0; i < 2000; ++i) {
+    assert(tree.insert(i, nullptr) == InsertResult::Success);
+  }
+  for (int i = 0; i < 2000; ++i) {
+    assert(tree.delete_key((i * 7) % 2000) == DeletionResult::Success);
+    if (i % 100 == 0) assert(tree.validate());
+  }
+  assert(tree.validate());
+  assert(tree.find_keys_in_range(0, 2000).empty());
+  std::cout << "Passed!" << std::endl;
+}
+
+struct CountedDelete {
+  static inline int deleted = 0;
+  ~CountedDelete() { deleted++; }
+};
+
+void test_epoch_reclamation() {
+  std::cout << "Testing epoch based reclamation..." << std::endl;
+  EpochManager epochs;
+  {
+    // Nothing retired while we're pinned may be freed, however often reclaim runs.
+    auto guard = epochs.pin();
+    for (int i = 0; i < 1000; ++i) {
+      epochs.retire(new CountedDelete());
+    }
+    for (int i = 0; i < 10; ++i) {
+      epochs.reclaim();
+    }
+    assert(CountedDelete::deleted == 0);
+    assert(epochs.pending() == 1000);
+  }
+  for (int i = 0; i < 3; ++i) {
+    epochs.reclaim();
+  }
+  assert(CountedDelete::deleted == 1000);
+  assert(epochs.pending() == 0);
+
+  // The tree hands its unlinked nodes back while it's running, not just when it's destroyed.
+  ConcurrentBTree<int, 4> tree;
+  for (int round = 0; round < 20; ++round) {
+    for (int i = 0; i < 1000; ++i) {
+      assert(tree.insert(i, nullptr) == InsertResult::Success);
+    }
+    for (int i = 0; i < 1000; ++i) {
+      assert(tree.delete_key(i) == DeletionResult::Success);
+    }
+  }
+  assert(tree.pending_reclamation() < 200);
+  std::cout << "Passed!" << std::endl;
+}
+
+// Header, keys and pointers should fill whole cache lines with no padding for the common orders.
+static_assert(sizeof(BTreeLeafNode<std::int32_t, 64>) == 12 * NODE_ALIGNMENT);
+static_assert(sizeof(BTreeInternalNode<std::int32_t, 64>) == 12 * NODE_ALIGNMENT);
+static_assert(sizeof(BTreeLeafNode<std::int64_t, 64>) == 16 * NODE_ALIGNMENT);
+static_assert(sizeof(BTreeInternalNode<std::int64_t, 64>) == 16 * NODE_ALIGNMENT);
+static_assert(sizeof(BTreeLeafNode<std::int64_t, 256>) == PageData::PAGE_SIZE);
+static_assert(sizeof(BTreeInternalNode<std::int64_t, 256>) == PageData::PAGE_SIZE);
+
+// Sizing by bytes fills the node: one more entry wouldn't fit anymore.
+template <typename KeyType, std::size_t NodeBytes, typename Layout> constexpr bool fanout_fills_node() {
+  using Fanout = NodeFanout<KeyType, NodeBytes, Layout>;
+  constexpr std::size_t INTERNAL = Fanout::INTERNAL;
+  constexpr std::size_t LEAF = Fanout::LEAF;
+  if (sizeof(BTreeInternalNode<KeyType, INTERNAL, Layout>) > NodeBytes ||
+      sizeof(BTreeInternalNode<KeyType, INTERNAL + 1, Layout>) <= NodeBytes ||
+      sizeof(BTreeLeafNode<KeyType, INTERNAL, LEAF>) > NodeBytes) {
+    return false;
+  }
+  // Unless the leaves are held back by the header's key count.
+  if constexpr (LEAF <= std::numeric_limits<NodeCountType<INTERNAL>>::max()) {
+    return sizeof(BTreeLeafNode<KeyType, INTERNAL, LEAF + 1>) > NodeBytes;
+  }
+  return true;
+}
+static_assert(fanout_fills_node<std::int32_t, 256, SortedInternalLayout>());
+static_assert(fanout_fills_node<std::uint64_t, PageData::PAGE_SIZE, SortedInternalLayout>());
+static_assert(fanout_fills_node<double, 1024, SortedInternalLayout>());
+static_assert(fanout_fills_node<std::uint64_t, PageData::PAGE_SIZE, EytzingerInternalLayout>());
+static_assert(NodeFanout<std::uint64_t, PageData::PAGE_SIZE>::LEAF == 256);
+// The Eytzinger index takes room from internal nodes only.
+static_assert(NodeFanout<std::uint64_t, PageData::PAGE_SIZE, EytzingerInternalLayout>::INTERNAL < 256);
+static_assert(NodeFanout<std::uint64_t, PageData::PAGE_SIZE, EytzingerInternalLayout>::LEAF == 256);
+
+void test_eytzinger_layout() {
+  std::cout << "Testing Eytzinger internal node layout..." << std::endl;
+  // The index has to pick the same child as a plain upper_bound for every fill level of the node.
+  EytzingerInternalLayout::Index<int, 16> index;
+  int keys[15];
+  for (int i = 0; i < 15; ++i) {
+    keys[i] = i * 10;
+  }
+  for (std::size_t count = 0; count <= 15; ++count) {
+    index.rebuild(keys, count);
+    for (int key = -5; key <= 155; ++key) {
+      assert(index.upper_bound(keys, count, key) == std::size_t(std::upper_bound(keys, keys + count, key) - keys));
+    }
+  }
+
+  check_churn<BTree<int, 5, HeapNodeAllocator, EytzingerInternalLayout>>();
+  check_churn<BTree<int, 16, SlabNodeAllocator, EytzingerInternalLayout>>();
+
+  std::vector<std::pair<int, PageData*>> entries;
+  for (int i = 0; i < 5000; ++i) {
+    entries.emplace_back(i, nullptr);
+  }
+  BTree<int, 8, HeapNodeAllocator, EytzingerInternalLayout> tree;
+  assert(tree.bulk_load(entries, 0.8) == BulkLoadResult::Success);
+  for (int i = 0; i < 5000; ++i) {
+    assert(tree.find(i).leaf_node != nullptr);
+  }
+  std::cout << "Passed!" << std::endl;
+}
+
+template <std::size_t N, typename InternalLayout = SortedInternalLayout> void check_find_batch() {
+  BTree<int, N, HeapNodeAllocator, InternalLayout> tree;
+  std::vector<int> batch;
+  std::mt19937 rng(17);
+  for (int i = 0; i < 4000; ++i) {
+    batch.push_back(static_cast<int>(rng() % 6000));
+  }
+  std::vector<FindResult<int, N>> results(batch.size());
+  tree.find_batch(batch, results);
+  assert(std::ranges::all_of(results, [](const auto& result) { return result.leaf_node == nullptr; }));
+
+  for (int i = 0; i < 6000; ++i) {
+    if (rng() % 3 != 0) {
+      assert(tree.insert(i, nullptr) == InsertResult::Success);
+    }
+  }
+  for (int i = 0; i < 6000; i += 7) {
+    (void)tree.delete_key(i);
+  }
+
+  auto matches_find = [&] {
+    tree.find_batch(batch, results);
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      auto expected = tree.find(batch[i]);
+      if (results[i].leaf_node != expected.leaf_node || results[i].idx != expected.idx) {
+        return false;
+      }
+    }
+    return true;
+  };
+  assert(matches_find());
+  // Sorted, with repeats and runs inside the same leaf, takes the shared path route.
+  std::ranges::sort(batch);
+  assert(matches_find());
+}
+
+void test_find_batch() {
+  std::cout << "Testing batched find..." << std::endl;
+  check_find_batch<4>();
+  check_find_batch<16>();
+  check_find_batch<16, EytzingerInternalLayout>();
+  std::cout << "Passed!" << std::endl;
+}
+
+void test_operations_dont_allocate() {
+  std::cout << "Testing allocations per operation..." << std::endl;
+  BTree<int, 16> tree;
+  std::mt19937 rng(23);
+  std::vector<int> keys(20000);
+  for (auto& key : keys) {
+    key = static_cast<int>(rng() % 100000);
+  }
+
+  // Only splits may allocate, and with 16 pointers per node that's far from one allocation per insert.
+  std::size_t allocations = allocations_during([&] {
+    for (int key : keys) {
+      (void)tree.insert(key, nullptr);
+    }
+  });
+  assert(allocations < keys.size() / 4);
+
+  std::vector<FindResult<int, 16>> results(keys.size());
+  allocations = allocations_during([&] {
+    for (int key : keys) {
+      assert(tree.find(key).leaf_node != nullptr);
+      assert(tree.find(key + 100000).leaf_node == nullptr);
+    }
+    tree.find_batch(keys, results);
+    std::size_t scanned = 0;
+    for (const auto& entry : tree.range(1000, 50000)) {
+      scanned += entry.data == nullptr;
+    }
+    assert(scanned > 0);
+  });
+  assert(allocations == 0);
+
+  // Merges and redistributions only ever free.
+  allocations = allocations_during([&] {
+    for (int key : keys) {
+      (void)tree.delete_key(key);
+    }
+  });
+  assert(allocations == 0);
+  assert(tree.validate());
+  std::cout << "Passed!" << std::endl;
+}
+
+void test_upsert() {
+  std::cout << "Testing upsert, insert_or_assign, try_emplace and update..." << std::endl;
+  BTree<int, 4> tree;
+  std::map<int, PageData*> expected;
+
+  assert(tree.update(1, [](PageData* current) { return current; }) == UpsertResult::KeyNotFound);
+  assert(tree.validate() && tree.begin() == tree.end());
+
+  std::mt19937 rng(18);
+  for (int op = 0; op < 20000; ++op) {
+    int key = static_cast<int>(rng() % 500);
+    PageData* data = page_for(op);
+    bool present = expected.contains(key);
+    switch (rng() % 4) {
+    case 0:
+      assert(tree.insert_or_assign(key, data) == (present ? UpsertResult::Assigned : UpsertResult::Inserted));
+      expected[key] = data;
+      break;
+    case 1: {
+      bool made = false;
+      UpsertResult result = tree.try_emplace(key, [&] {
+        made = true;
+        return data;
+      });
+      assert(result == (present ? UpsertResult::KeyExists : UpsertResult::Inserted) && made == !present);
+      expected.emplace(key, data);
+      break;
+    }
+    case 2:
+      // Counts how often the key was written, in the pointer.
+      assert(tree.upsert(key, [&](PageData* current) {
+        assert(current == (present ? expected[key] : nullptr));
+        return reinterpret_cast<PageData*>(reinterpret_cast<std::uintptr_t>(current) + 8);
+      }) == (present ? UpsertResult::Assigned : UpsertResult::Inserted));
+      expected[key] = reinterpret_cast<PageData*>(reinterpret_cast<std::uintptr_t>(expected[key]) + 8);
+      break;
+    default:
+      if (rng() % 2 == 0) {
+        assert(tree.update(key, [&](PageData*) { return data; }) ==
+               (present ? UpsertResult::Assigned : UpsertResult::KeyNotFound));
+        if (present) {
+          expected[key] = data;
+        }
+      } else {
+        assert(tree.delete_key(key) == (present ? DeletionResult::Success : DeletionResult::KeyNotFound));
+        expected.erase(key);
+      }
+    }
+  }
+  assert(tree.validate());
+  std::map<int, PageData*> entries;
+  for (auto entry : tree) {
+    entries.emplace(entry.key, entry.data);
+  }
+  assert(std::ranges::equal(entries, expected));
+
+  // Writing to existing keys leaves every key in the leaf it was in, and allocates nothing.
+  std::vector<const void*> leaves;
+  for (auto& [key, data] : expected) {
+    leaves.push_back(tree.find(key).leaf_node);
+  }
+  std::size_t allocations = allocations_during([&] {
+    for (auto& [key, data] : expected) {
+      (void)tree.insert_or_assign(key, nullptr);
+      (void)tree.update(key, [&](PageData*) { return page_for(key); });
+      (void)tree.upsert(key, [](PageData* current) { return current; });
+      (void)tree.try_emplace(key, [] { return static_cast<PageData*>(nullptr); });
+    }
+  });
+  assert(allocations == 0);
+  std::size_t i = 0;
+  for (auto& [key, data] : expected) {
+    auto result = tree.find(key);
+    assert(result.leaf_node == leaves[i++] && result.leaf_node->dataPointers[result.idx] == page_for(key));
+  }
+  assert(tree.validate());
+  std::cout << "Passed!" << std::endl;
+}
+
+void test_stats() {
+  std::cout << "Testing operation stats..." << std::endl;
+  // Without stats the tree is what it was, with them every hook shows up.
+  static_assert(sizeof(BTree<int, 16>) == sizeof(BTree<int, 16, HeapNodeAllocator, SortedInternalLayout, 16>));
+
+  BTree<int, 4, HeapNodeAllocator, SortedInternalLayout, 4, BTreeStats> tree;
+  for (int key = 0; key < 1000; ++key) {
+    (void)tree.insert(key, nullptr);
+  }
+  for (int key = 0; key < 1000; key += 10) {
+    assert(tree.find(key).leaf_node != nullptr);
+  }
+  assert(tree.find_keys_in_range(100, 200).size() == 100);
+  BTreeStatsSnapshot grown = tree.stats().snapshot();
+  assert(grown.leaf_splits > 0 && grown.internal_splits > 0 && grown.leaf_merges == 0);
+  // Every internal split that made a new root, plus the first leaf.
+  assert(grown.root_changes > 1);
+  assert(grown.nodes_allocated == grown.leaf_splits + grown.internal_splits + grown.root_changes);
+  assert(grown.latency_of(BTreeOp::Insert).count() == 1000 && grown.latency_of(BTreeOp::Find).count() == 100);
+  assert(grown.latency_of(BTreeOp::Range).count() == 1 && grown.latency_of(BTreeOp::Delete).count() == 0);
+  // Only the very first insert and the finds descend, the rest are appends, and the finds go through a tree that's at
+  // least 5 levels deep by the end.
+  assert(grown.appends == 999 && grown.descents == 101 && grown.nodes_visited > 3 * grown.descents);
+
+  for (int key = 0; key < 1000; ++key) {
+    assert(tree.delete_key(key) == DeletionResult::Success);
+  }
+  BTreeStatsSnapshot emptied = tree.stats().snapshot();
+  assert(emptied.leaf_merges > 0 && emptied.internal_merges > 0 && emptied.redistributions > 0);
+  assert(emptied.nodes_allocated == emptied.nodes_freed);
+  const LatencyHistogram& deletes = emptied.latency_of(BTreeOp::Delete);
+  assert(deletes.count() == 1000 && deletes.percentile(50) <= deletes.percentile(99.9));
+  assert(deletes.percentile(100) == deletes.max());
+
+  std::string json = emptied.to_json();
+  assert(json.find("\"leaf_splits\":" + std::to_string(emptied.leaf_splits)) != std::string::npos);
+  assert(json.find("\"delete\":{\"count\":1000") != std::string::npos);
+  std::string text = emptied.to_text();
+  assert(text.find("btree_nodes_freed " + std::to_string(emptied.nodes_freed) + "\n") != std::string::npos);
+  assert(text.find("btree_latency_ns_count{op=\"delete\"} 1000\n") != std::string::npos);
+
+  tree.stats().reset();
+  assert(tree.stats().snapshot().nodes_allocated == 0);
+
+  // Buckets are exact up to 32 and within 1/32 above that.
+  LatencyHistogram histogram;
+  for (std::uint64_t value = 1; value <= 100000; ++value) {
+    histogram.record(value);
+  }
+  assert(histogram.count() == 100000 && histogram.max() == 100000);
+  for (double percent : {0.01, 0.02, 10.0, 50.0, 99.0, 99.9}) {
+    auto exact = static_cast<std::uint64_t>(std::ceil(percent / 100 * 100000));
+    std::uint64_t reported = histogram.percentile(percent);
+    assert(reported >= exact && reported - exact <= exact / 32);
+  }
+  std::cout << "Passed!" << std::endl;
+}
+
+void test_append() {
+  std::cout << "Testing the append fast path..." << std::endl;
+  // 10 entries per leaf, appends leave 9 of them in every leaf but the last where a half split would leave 5.
+  using Tree = BTree<int, 11, HeapNodeAllocator, SortedInternalLayout, 11, BTreeStats>;
+  Tree tree;
+  for (int key = 0; key < 10000; ++key) {
+    assert(tree.insert(key * 2, nullptr) == InsertResult::Success);
+  }
+  assert(tree.validate());
+  BTreeStatsSnapshot appended = tree.stats().snapshot();
+  assert(appended.appends == 9999 && appended.descents == 1);
+  assert(appended.leaf_splits == (10000 - 2) / 9);
+  assert(tree.insert(19998, nullptr) == InsertResult::Duplicate);
+
+  // Anything else mixed in: keys below the end, deletes and range deletes that merge the last leaf away, upserts. The
+  // cached leaf has to follow along, validate checks it's the last one.
+  std::set<int> expected;
+  for (int key = 0; key < 10000; ++key) {
+    expected.insert(key * 2);
+  }
+  std::mt19937 rng(22);
+  int next = 20000;
+  for (int round = 0; round < 2000; ++round) {
+    switch (rng() % 6) {
+    case 0: {
+      int key = static_cast<int>(rng() % next);
+      assert((tree.insert(key, nullptr) == InsertResult::Success) == expected.insert(key).second);
+      break;
+    }
+    case 1:
+      while (!expected.empty() && rng() % 8 != 0) {
+        assert(tree.delete_key(*expected.rbegin()) == DeletionResult::Success);
+        expected.erase(std::prev(expected.end()));
+      }
+      break;
+    case 2: {
+      int lower = next - static_cast<int>(rng() % 200);
+      std::size_t count = std::distance(expected.lower_bound(lower), expected.end());
+      expected.erase(expected.lower_bound(lower), expected.end());
+      assert(tree.delete_range(lower, next) == count);
+      break;
+    }
+    case 3:
+      assert(tree.try_emplace(next, [] { return nullptr; }) == UpsertResult::Inserted);
+      expected.insert(next++);
+      break;
+    default:
+      for (int i = static_cast<int>(rng() % 30); i >= 0; --i) {
+        assert(tree.insert(next, nullptr) == InsertResult::Success);
+        expected.insert(next++);
+      }
+    }
+    assert(tree.validate());
+  }
+  assert(std::ranges::equal(tree.find_keys_in_range(0, next), expected));
+
+  // Emptied and refilled, and appends right after a bulk load.
+  assert(tree.delete_range(0, next) == expected.size() && tree.validate());
+  assert(tree.insert(1, nullptr) == InsertResult::Success && tree.insert(2, nullptr) == InsertResult::Success);
+  assert(tree.delete_range(0, 3) == 2);
+  std::vector<std::pair<int, PageData*>> entries;
+  for (int key = 0; key < 1000; ++key) {
+    entries.emplace_back(key, nullptr);
+  }
+  assert(tree.bulk_load(entries) == BulkLoadResult::Success);
+  tree.stats().reset();
+  for (int key = 1000; key < 2000; ++key) {
+    assert(tree.insert(key, nullptr) == InsertResult::Success);
+  }
+  assert(tree.validate() && tree.stats().snapshot().appends == 1000);
+  assert(std::ranges::distance(tree.begin(), tree.end()) == 2000);
+  std::cout << "Passed!" << std::endl;
+}
+
+// The same random churn at several leaf merge thresholds, checked against std::set. Returns how many merges and
+// redistributions it took.
+std::uint64_t check_relaxed_rebalance(double threshold) {
+  BTree<int, 8, HeapNodeAllocator, SortedInternalLayout, 8, BTreeStats> tree;
+  tree.set_leaf_merge_threshold(threshold);
+  std::set<int> expected;
+  std::mt19937 rng(23);
+  for (int i = 0; i < 3000; ++i) {
+    int key = static_cast<int>(rng() % 4000);
+    expected.insert(key);
+    (void)tree.insert(key, nullptr);
+  }
+  for (int round = 0; round < 20000; ++round) {
+    int key = static_cast<int>(rng() % 4000);
+    if (rng() % 2 == 0) {
+      assert((tree.insert(key, nullptr) == InsertResult::Success) == expected.insert(key).second);
+    } else {
+      assert((tree.delete_key(key) == DeletionResult::Success) == (expected.erase(key) == 1));
+    }
+    if (round % 1000 == 0) {
+      std::size_t count = std::distance(expected.lower_bound(key), expected.lower_bound(key + 50));
+      expected.erase(expected.lower_bound(key), expected.lower_bound(key + 50));
+      assert(tree.delete_range(key, key + 50) == count);
+    }
+    assert(round % 100 != 0 || tree.validate());
+  }
+  assert(tree.validate() && std::ranges::equal(tree.find_keys_in_range(0, 4000), expected));
+
+  // And everything out, which has to collapse the tree all the way like it always does.
+  for (int key : expected) {
+    assert(tree.delete_key(key) == DeletionResult::Success);
+  }
+  assert(tree.validate() && tree.begin() == tree.end());
+  BTreeStatsSnapshot stats = tree.stats().snapshot();
+  assert(stats.nodes_allocated == stats.nodes_freed);
+  return stats.leaf_merges + stats.redistributions;
+}
+
+void test_relaxed_rebalance() {
+  std::cout << "Testing relaxed leaf rebalancing..." << std::endl;
+  std::uint64_t eager = check_relaxed_rebalance(0.5);
+  std::uint64_t relaxed = check_relaxed_rebalance(0.25);
+  std::uint64_t at_empty = check_relaxed_rebalance(0.0);
+  assert(relaxed < eager && at_empty < relaxed);
+
+  // Leaves can get down to a single entry without anything moving.
+  BTree<int, 8> tree;
+  tree.set_leaf_merge_threshold(0.0);
+  std::vector<std::pair<int, PageData*>> entries;
+  for (int key = 0; key < 700; ++key) {
+    entries.emplace_back(key, nullptr);
+  }
+  assert(tree.bulk_load(entries) == BulkLoadResult::Success);
+  // 7 per leaf, keep only the first of each.
+  for (int key = 0; key < 700; ++key) {
+    if (key % 7 != 0) {
+      assert(tree.delete_key(key) == DeletionResult::Success);
+    }
+  }
+  assert(tree.validate());
+  int leaves = 0;
+  for (auto it = tree.begin(); it != tree.end(); ++it) {
+    leaves++;
+  }
+  assert(leaves == 100 && tree.find(693).leaf_node != nullptr);
+  std::cout << "Passed!" << std::endl;
+}
+
+// Fraction of the leaves' capacity that's in use, and how many leaves there are.
+template <typename Tree> std::pair<double, std::size_t> leaf_occupancy(const Tree& tree, std::size_t capacity) {
+  std::size_t leaves = 0;
+  std::size_t entries = 0;
+  for (auto it = tree.begin(); it != tree.end(); ++it) {
+    entries++;
+  }
+  for (auto* leaf = tree.find((*tree.begin()).key).leaf_node; leaf != nullptr; leaf = leaf->right_sibling) {
+    leaves++;
+  }
+  return {static_cast<double>(entries) / static_cast<double>(leaves * capacity), leaves};
+}
+
+// A tree thinned out by random deletes, compacted a few leaves at a time with inserts and deletes in between.
+template <typename Tree> void check_compact(const CompactionOptions& options) {
+  Tree tree;
+  // Deletes leave leaves down to a quarter full alone, like a tree that's had relaxed deletes for a while.
+  tree.set_leaf_merge_threshold(0.25);
+  std::set<int> expected;
+  std::mt19937 rng(24);
+  for (int i = 0; i < 6000; ++i) {
+    int key = static_cast<int>(rng() % 8000);
+    expected.insert(key);
+    (void)tree.insert(key, nullptr);
+  }
+  for (int i = 0; i < 3000; ++i) {
+    int key = static_cast<int>(rng() % 8000);
+    assert((tree.delete_key(key) == DeletionResult::Success) == (expected.erase(key) == 1));
+  }
+  auto [sparse, sparse_leaves] = leaf_occupancy(tree, 9);
+
+  CompactionCursor<int> cursor;
+  while (!tree.compact(cursor, 5, options)) {
+    for (int i = 0; i < 3; ++i) {
+      int key = static_cast<int>(rng() % 8000);
+      if (rng() % 2 == 0) {
+        assert((tree.insert(key, nullptr) == InsertResult::Success) == expected.insert(key).second);
+      } else {
+        assert((tree.delete_key(key) == DeletionResult::Success) == (expected.erase(key) == 1));
+      }
+    }
+    assert(tree.validate());
+  }
+  assert(tree.validate() && std::ranges::equal(tree.find_keys_in_range(0, 8000), expected));
+  assert(cursor.leaves_visited >= sparse_leaves / 2 && cursor.leaves_freed > 0);
+
+  // A quiet pass gets most of the way to the fill factor, runs end at every parent and their last leaf is short.
+  CompactionCursor<int> quiet;
+  while (!tree.compact(quiet, 5, options)) {
+  }
+  auto [packed, packed_leaves] = leaf_occupancy(tree, 9);
+  assert(tree.validate() && std::ranges::equal(tree.find_keys_in_range(0, 8000), expected));
+  assert(packed > 0.7 && packed > sparse + 0.2 && packed_leaves < sparse_leaves);
+  for (int key : expected) {
+    assert(tree.find(key).leaf_node != nullptr);
+  }
+}
+
+void test_compact() {
+  std::cout << "Testing incremental compaction..." << std::endl;
+  using HeapTree = BTree<int, 8, HeapNodeAllocator, SortedInternalLayout, 10>;
+  using SlabTree = BTree<int, 8, SlabNodeAllocator, SortedInternalLayout, 10>;
+  check_compact<HeapTree>({});
+  check_compact<HeapTree>({0.9, true});
+  check_compact<SlabTree>({1.0, false});
+  check_compact<SlabTree>({0.9, true});
+
+  // Relocated leaves come one after the other in memory, apart from where a slab ends.
+  SlabTree tree;
+  for (int key = 0; key < 20000; ++key) {
+    (void)tree.insert((key * 7919) % 20000, nullptr);
+  }
+  CompactionCursor<int> cursor;
+  while (!tree.compact(cursor, 64, {0.9, true})) {
+  }
+  assert(tree.validate());
+  std::size_t leaves = 0;
+  std::size_t adjacent = 0;
+  for (auto* leaf = tree.find(0).leaf_node; leaf->right_sibling != nullptr; leaf = leaf->right_sibling) {
+    leaves++;
+    auto gap = reinterpret_cast<std::uintptr_t>(leaf->right_sibling) - reinterpret_cast<std::uintptr_t>(leaf);
+    adjacent += gap == SlabNodeAllocator<BTreeLeafNode<int, 8, 10>>::SLOT_SIZE;
+  }
+  assert(adjacent * 10 > leaves * 9);
+
+  // Packed full and thinned to just over half, so no delete merged anything. How finely the pass is sliced doesn't
+  // change what it packs, slices of a leaf or two free as many leaves as one that takes the whole tree.
+  std::vector<std::pair<int, PageData*>> entries;
+  for (int key = 0; key < 20000; ++key) {
+    entries.emplace_back(key, nullptr);
+  }
+  std::size_t freed_in_one = 0;
+  for (std::size_t max_leaves : {std::size_t{1}, std::size_t{2}, std::size_t{100000}}) {
+    HeapTree thinned;
+    assert(thinned.bulk_load(entries) == BulkLoadResult::Success);
+    for (int key = 0; key < 20000; ++key) {
+      if (key % 9 >= 5) {
+        assert(thinned.delete_key(key) == DeletionResult::Success);
+      }
+    }
+    auto [sparse, sparse_leaves] = leaf_occupancy(thinned, 9);
+    CompactionCursor<int> thinned_cursor;
+    while (!thinned.compact(thinned_cursor, max_leaves)) {
+    }
+    auto [packed, packed_leaves] = leaf_occupancy(thinned, 9);
+    assert(thinned.validate() && packed > sparse + 0.2 && packed_leaves + thinned_cursor.leaves_freed == sparse_leaves);
+    if (max_leaves == 1) {
+      freed_in_one = thinned_cursor.leaves_freed;
+    }
+    assert(thinned_cursor.leaves_freed == freed_in_one);
+  }
+
+  // Down to a single leaf, and an empty tree.
+  HeapTree small;
+  for (int key = 0; key < 30; ++key) {
+    (void)small.insert(key, nullptr);
+  }
+  for (int key = 3; key < 30; ++key) {
+    (void)small.delete_key(key);
+  }
+  CompactionCursor<int> small_cursor;
+  while (!small.compact(small_cursor, 1)) {
+  }
+  assert(small.validate() && std::ranges::distance(small.begin(), small.end()) == 3);
+  HeapTree empty;
+  CompactionCursor<int> empty_cursor;
+  assert(empty.compact(empty_cursor, 1) && empty_cursor.leaves_visited == 0);
+  std::cout << "Passed!" << std::endl;
+}
+
+// Entries per leaf in key order, the shape of the tree's bottom level.
+template <typename Tree> std::vector<std::size_t> leaf_sizes(const Tree& tree) {
+  std::vector<std::size_t> sizes;
+  if (tree.begin() == tree.end()) {
+    return sizes;
+  }
+  for (auto* leaf = tree.find((*tree.begin()).key).leaf_node; leaf != nullptr; leaf = leaf->right_sibling) {
+    sizes.push_back(leaf->numKeys);
+  }
+  return sizes;
+}
+
+void test_parallel_bulk_load() {
+  std::cout << "Testing parallel bulk load and aggregation..." << std::endl;
+  using Tree = BTree<int, 6, HeapNodeAllocator, SortedInternalLayout, 8>;
+  std::mt19937 rng(25);
+  for (std::size_t count : {0, 1, 5, 7, 8, 30, 1000, 54321}) {
+    std::vector<std::pair<int, PageData*>> sorted;
+    for (std::size_t i = 0; i < count; ++i) {
+      sorted.emplace_back(static_cast<int>(i * 3), nullptr);
+    }
+    for (double fill : {1.0, 0.7}) {
+      Tree serial;
+      assert(serial.bulk_load(sorted, fill) == BulkLoadResult::Success);
+      for (unsigned threads : {1u, 2u, 3u, 8u}) {
+        std::vector<std::pair<int, PageData*>> entries = sorted;
+        std::ranges::shuffle(entries, rng);
+        Tree tree;
+        assert(tree.parallel_bulk_load(entries, threads, fill) == BulkLoadResult::Success);
+        assert(tree.validate() && std::ranges::equal(entries, sorted));
+        // Same leaves as the serial build, and the same internal levels, that find and range see through.
+        assert(leaf_sizes(tree) == leaf_sizes(serial));
+        assert(std::ranges::equal(tree.find_keys_in_range(0, static_cast<int>(count * 3)),
+                                  serial.find_keys_in_range(0, static_cast<int>(count * 3))));
+        assert(count == 0 || tree.insert(static_cast<int>(count * 3), nullptr) == InsertResult::Success);
+        assert(tree.validate());
+      }
+    }
+  }
+
+  std::vector<std::pair<int, PageData*>> duplicates = {{5, nullptr}, {1, nullptr}, {5, nullptr}};
+  Tree rejected;
+  assert(rejected.parallel_bulk_load(duplicates, 2) == BulkLoadResult::Duplicate);
+  assert(rejected.begin() == rejected.end());
+  assert(rejected.insert(1, nullptr) == InsertResult::Success);
+  assert(rejected.parallel_bulk_load(std::span(duplicates).first(2), 2) == BulkLoadResult::NotEmpty);
+
+  // Sums and counts over random ranges, against adding them up directly.
+  Tree tree;
+  std::vector<std::pair<int, PageData*>> entries;
+  for (int key = 0; key < 20000; ++key) {
+    entries.emplace_back(key * 2, nullptr);
+  }
+  assert(tree.parallel_bulk_load(entries, 4) == BulkLoadResult::Success);
+  auto add_key = [](long long sum, const int& key, PageData*) { return sum + key; };
+  auto add = [](long long a, long long b) { return a + b; };
+  for (int round = 0; round < 50; ++round) {
+    int lower = static_cast<int>(rng() % 42000) - 1000;
+    int upper = lower + static_cast<int>(rng() % (round % 5 == 0 ? 42000 : 300));
+    long long expected = 0;
+    for (int key = std::max(lower, 0); key < std::min(upper, 40000); ++key) {
+      expected += key % 2 == 0 ? key : 0;
+    }
+    for (unsigned threads : {1u, 3u, 16u}) {
+      assert(tree.parallel_aggregate(lower, upper, threads, 0LL, add_key, add) == expected);
+    }
+  }
+  // Non-commutative combine, the pieces have to come back in key order.
+  auto keys = tree.parallel_aggregate(
+      100, 9000, 8, std::vector<int>(),
+      [](std::vector<int> acc, const int& key, PageData*) {
+        acc.push_back(key);
+        return acc;
+      },
+      [](std::vector<int> a, const std::vector<int>& b) {
+        a.insert(a.end(), b.begin(), b.end());
+        return a;
+      });
+  assert(std::ranges::equal(keys, tree.find_keys_in_range(100, 9000)));
+  assert(Tree().parallel_aggregate(0, 10, 4, 7LL, add_key, add) == 7);
+  std::cout << "Passed!" << std::endl;
+}
+
+void test_disk_btree() {
+  std::cout << "Testing disk backed tree..." << std::endl;
+  const std::string path = (std::filesystem::temp_directory_path() / "btree_test_disk.idx").string();
+  std::filesystem::remove(path);
+
+  std::set<int> expected;
+  std::uintmax_t file_size_after_refill = 0;
+  {
+    // Small nodes, so a few thousand keys already give a deep tree with every split and merge path. The smallest pool
+    // there is, so pages get evicted and read back all the time.
+    DiskBTree<int, 5> tree(DiskBTree<int, 5>::MIN_POOL_FRAMES);
+    assert(tree.open(path) == FileResult::Success);
+    std::mt19937 rng(29);
+    for (int i = 0; i < 20000; ++i) {
+      int key = static_cast<int>(rng() % 3000);
+      if (rng() % 3 == 0) {
+        bool erased = expected.erase(key) == 1;
+        assert(tree.delete_key(key) == (erased ? DeletionResult::Success : DeletionResult::KeyNotFound));
+      } else {
+        bool inserted = expected.insert(key).second;
+        assert(tree.insert(key, PageId(key) + 100) == (inserted ? InsertResult::Success : InsertResult::Duplicate));
+      }
+      if (i % 1000 == 0) assert(tree.validate());
+    }
+    assert(tree.validate());
+    assert(tree.buffer_pool_stats().evictions > 0 && tree.buffer_pool_stats().write_backs > 0);
+    assert(tree.sync());
+  }
+
+  {
+    // Reopened, nothing rebuilt.
+    DiskBTree<int, 5> tree;
+    assert(tree.open(path) == FileResult::Success);
+    assert(tree.validate());
+    assert(std::ranges::equal(tree.find_keys_in_range(0, 3000), expected));
+    for (int key = 0; key < 3000; ++key) {
+      auto result = tree.find(key);
+      assert(result.found == expected.contains(key));
+      assert(!result.found || result.value == PageId(key) + 100);
+    }
+
+    PageData data;
+    data[0] = 42;
+    PageId data_page = tree.store_data(data);
+    assert(tree.insert(-1, data_page) == InsertResult::Success);
+    PageData loaded;
+    assert(tree.load_data(tree.find(-1).value, loaded) && loaded[0] == 42);
+    assert(tree.delete_key(-1) == DeletionResult::Success);
+    tree.free_data(data_page);
+  }
+
+  {
+    // Emptying the tree hands every page back, filling it the same way again reuses them instead of growing the file.
+    DiskBTree<int, 5> tree;
+    assert(tree.open(path) == FileResult::Success);
+    for (int round = 0; round < 2; ++round) {
+      for (int key : expected) {
+        assert(tree.delete_key(key) == DeletionResult::Success);
+      }
+      assert(tree.validate());
+      assert(tree.find_keys_in_range(0, 3000).empty());
+      for (int key : expected) {
+        assert(tree.insert(key, NO_PAGE) == InsertResult::Success);
+      }
+      assert(tree.validate());
+      if (round == 0) {
+        file_size_after_refill = std::filesystem::file_size(path);
+      }
+    }
+  }
+  assert(std::filesystem::file_size(path) == file_size_after_refill);
+
+  // A file written for another key type or fanout isn't taken.
+  DiskBTree<std::int64_t, 5> wrong_key;
+  assert(wrong_key.open(path) == FileResult::LayoutMismatch);
+  DiskBTree<int, 8> wrong_fanout;
+  assert(wrong_fanout.open(path) == FileResult::LayoutMismatch);
+  std::filesystem::remove(path);
+
+  {
+    // An insert that can't get at its pages says so instead of reporting a key it didn't store. Never opened, so the
+    // first leaf can't be allocated.
+    DiskBTree<int, 5> unopened;
+    assert(unopened.insert(1, NO_PAGE) == InsertResult::IoError && unopened.failed());
+  }
+  {
+    DiskBTree<int, 5> tree(DiskBTree<int, 5>::MIN_POOL_FRAMES);
+    assert(tree.open(path) == FileResult::Success);
+    for (int key = 0; key < 4; ++key) {
+      assert(tree.insert(key, NO_PAGE) == InsertResult::Success);
+    }
+    // Reading a page past the end of the file fails it. The root leaf is full and still in the pool, so the next
+    // insert gets as far as the split and then can't allocate the new leaf.
+    PageData data;
+    assert(!tree.load_data(1000, data) && tree.failed());
+    assert(tree.insert(4, NO_PAGE) == InsertResult::IoError);
+    assert(!tree.find(4).found);
+  }
+  std::filesystem::remove(path);
+  {
+    DiskBTree<int, 5> tree(DiskBTree<int, 5>::MIN_POOL_FRAMES);
+    assert(tree.open(path) == FileResult::Success);
+    for (int key = 0; key < 3000; ++key) {
+      assert(tree.insert(key, NO_PAGE) == InsertResult::Success);
+    }
+    // The leftmost leaf was pushed out of the pool long ago and can't be read back once the file has failed.
+    PageData data;
+    assert(!tree.load_data(100000, data) && tree.failed());
+    assert(tree.insert(-1, NO_PAGE) == InsertResult::IoError);
+    // Same for deletes and lookups, neither may pass the leaf it couldn't read off as a missing key.
+    assert(tree.delete_key(0) == DeletionResult::IoError);
+    DiskLookupResult result = tree.find(0);
+    assert(!result.found && result.io_error);
+  }
+  std::filesystem::remove(path);
+  {
+    // Leaves [0 1] [2 3] [4 5] [6 7] under one root, one page more than the pool holds.
+    DiskBTree<int, 5> tree(DiskBTree<int, 5>::MIN_POOL_FRAMES);
+    assert(tree.open(path) == FileResult::Success);
+    for (int key = 0; key < 9; ++key) {
+      assert(tree.insert(key, NO_PAGE) == InsertResult::Success);
+    }
+    assert(tree.delete_key(8) == DeletionResult::Success);
+    // Reading the first two leaves pushes [4 5] out, and [6 7] is read again last so the failing read below takes the
+    // frame of [0 1] instead. Deleting 7 then leaves [6] under its minimum, and its only sibling can't be read back.
+    assert(tree.find(0).found && tree.find(2).found && tree.find(6).found);
+    PageData data;
+    assert(!tree.load_data(1000, data) && tree.failed());
+    assert(tree.delete_key(7) == DeletionResult::IoError);
+  }
+  std::filesystem::remove(path);
+  std::cout << "Passed!" << std::endl;
+}
+
+template <typename Policy> void check_disk_btree_with_policy(const std::string& path) {
+  std::filesystem::remove(path);
+  std::set<int> expected;
+  {
+    DiskBTree<int, 5, Policy> tree(8);
+    assert(tree.open(path) == FileResult::Success);
+    std::mt19937 rng(37);
+    for (int i = 0; i < 5000; ++i) {
+      int key = static_cast<int>(rng() % 1000);
+      if (rng() % 3 == 0) {
+        expected.erase(key);
+        (void)tree.delete_key(key);
+      } else {
+        expected.insert(key);
+        (void)tree.insert(key, PageId(key));
+      }
+    }
+    assert(tree.validate());
+    const BufferPoolStats& stats = tree.buffer_pool_stats();
+    assert(stats.hits > 0 && stats.misses > 0 && stats.evictions > 0);
+  }
+  // Whatever was only in the pool got written back on the way out.
+  DiskBTree<int, 5, Policy> tree(8);
+  assert(tree.open(path) == FileResult::Success);
+  assert(tree.validate());
+  assert(std::ranges::equal(tree.find_keys_in_range(0, 1000), expected));
+  tree.close();
+  std::filesystem::remove(path);
+}
+
+void test_buffer_pool() {
+  std::cout << "Testing buffer pool..." << std::endl;
+  auto any = [](std::size_t) { return true; };
+
+  LruEviction lru(4);
+  for (std::size_t frame : {0, 1, 2, 3, 0}) {
+    lru.accessed(frame);
+  }
+  assert(lru.victim(any) == 1);
+  assert(lru.victim([](std::size_t frame) { return frame != 1; }) == 2);
+  lru.removed(1);
+  assert(lru.victim(any) == 2);
+
+  // Every frame referenced, so the first sweep clears the bits and the second takes the frame under the hand.
+  ClockEviction clock(3);
+  for (std::size_t frame : {0, 1, 2}) {
+    clock.accessed(frame);
+  }
+  assert(clock.victim(any) == 0);
+  clock.accessed(2);
+  assert(clock.victim(any) == 1);
+  assert(clock.victim([](std::size_t) { return false; }) == 3);
+
+  // Frame 0 is used over and over, 1 and 2 only once each: those go first, even though 0 isn't the most recent.
+  LruKEviction<2> lru_k(3);
+  for (std::size_t frame : {0, 0, 1, 2}) {
+    lru_k.accessed(frame);
+  }
+  assert(lru_k.victim(any) == 1);
+  lru_k.accessed(1);
+  lru_k.accessed(2);
+  assert(lru_k.victim(any) == 0);
+
+  const std::string path = (std::filesystem::temp_directory_path() / "btree_test_pool.idx").string();
+  std::filesystem::remove(path);
+  {
+    PageFile file;
+    assert(file.open(path, 1) == FileResult::Success);
+    BufferPool<LruEviction> pool(file, 2);
+    auto a = pool.create();
+    auto b = pool.create();
+    assert(a && b && a.id() != b.id());
+    // Both frames pinned, nothing to evict. Failing is sticky on the file, so the rest starts over on a fresh one.
+    assert(!pool.create() && file.failed());
+    assert(pool.stats().evictions == 0);
+    file.close();
+  }
+  std::filesystem::remove(path);
+  {
+    PageFile file;
+    assert(file.open(path, 1) == FileResult::Success);
+    BufferPool<LruEviction> pool(file, 2);
+    PageId ids[3];
+    for (int i = 0; i < 3; ++i) {
+      auto page = pool.create();
+      ids[i] = page.id();
+      page.bytes()[0] = static_cast<unsigned char>(i + 1);
+    }
+    // The third page pushed out the first, which had to be written back.
+    assert(pool.stats().evictions == 1 && pool.stats().write_backs == 1);
+    {
+      auto page = pool.fetch(ids[0]);
+      assert(page && page.bytes()[0] == 1);
+      assert(pool.stats().misses == 1);
+      auto again = pool.fetch(ids[0]);
+      assert(again && pool.stats().hits == 1);
+    }
+    pool.free_page(ids[1]);
+    assert(pool.flush_all() && !file.failed());
+    file.close();
+  }
+  std::filesystem::remove(path);
+
+  check_disk_btree_with_policy<LruEviction>(path);
+  check_disk_btree_with_policy<ClockEviction>(path);
+  check_disk_btree_with_policy<LruKEviction<2>>(path);
+  std::cout << "Passed!" << std::endl;
+}
+
+void test_snapshot() {
+  std::cout << "Testing mmap snapshot..." << std::endl;
+  const std::string path = (std::filesystem::temp_directory_path() / "btree_test.snap").string();
+
+  // Sizes around the block size too, so every level count from none to three comes up.
+  for (int count : {0, 1, 7, 8, 9, 64, 65, 5000}) {
+    BTree<int, 6> tree;
+    std::set<int> expected;
+    std::mt19937 rng(count + 41);
+    while (expected.size() < static_cast<std::size_t>(count)) {
+      int key = static_cast<int>(rng() % 100000) * 2;
+      if (expected.insert(key).second) {
+        assert(tree.insert(key, page_for(key)) ==
+               InsertResult::Success);
+      }
+    }
+    auto value_of = [](PageData* data) { return static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(data)); };
+    assert((BTreeSnapshot<int, 8>::write(path, tree, value_of) == FileResult::Success));
+
+    BTreeSnapshot<int, 8> snapshot;
+    assert(snapshot.open(path) == FileResult::Success);
+    assert(snapshot.verify());
+    assert(snapshot.size() == expected.size() && snapshot.has_values());
+    for (int key : expected) {
+      auto result = snapshot.find(key);
+      assert(result.found && result.value == reinterpret_cast<std::uintptr_t>(page_for(key)));
+      // Odd keys are never in there, and fall between the even ones.
+      assert(!snapshot.find(key + 1).found && !snapshot.find(key - 1).found);
+    }
+    assert(!snapshot.find(-1).found && !snapshot.find(1 << 30).found);
+    for (int lower : {-5, 0, 1001, 99998, 200001}) {
+      int upper = lower + 3000;
+      auto it = expected.lower_bound(lower);
+      std::vector<int> in_range(it, expected.lower_bound(upper));
+      assert(snapshot.find_keys_in_range(lower, upper) == in_range);
+    }
+  }
+
+  {
+    // Keys only, and writing over a snapshot that's still mapped leaves the old mapping intact.
+    BTree<int, 6> tree;
+    for (int key = 0; key < 1000; ++key) {
+      assert(tree.insert(key, nullptr) == InsertResult::Success);
+    }
+    assert((BTreeSnapshot<int, 8>::write(path, tree) == FileResult::Success));
+    BTreeSnapshot<int, 8> old_snapshot;
+    assert(old_snapshot.open(path) == FileResult::Success);
+    assert(!old_snapshot.has_values() && old_snapshot.find(500).found && old_snapshot.find(500).value == 0);
+
+    assert(tree.delete_key(500) == DeletionResult::Success);
+    assert((BTreeSnapshot<int, 8>::write(path, tree) == FileResult::Success));
+    BTreeSnapshot<int, 8> new_snapshot;
+    assert(new_snapshot.open(path) == FileResult::Success);
+    assert(old_snapshot.find(500).found && !new_snapshot.find(500).found);
+    assert(old_snapshot.size() == 1000 && new_snapshot.size() == 999);
+  }
+
+  // Wrong key type or block size.
+  BTreeSnapshot<std::int64_t, 8> wrong_key;
+  assert(wrong_key.open(path) == FileResult::LayoutMismatch);
+  BTreeSnapshot<int, 16> wrong_block;
+  assert(wrong_block.open(path) == FileResult::LayoutMismatch);
+
+  // A flipped bit in the body only shows up in verify(), one in the header already when opening.
+  auto flip_byte = [&](std::uintmax_t offset) {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(offset));
+    char byte = static_cast<char>(file.get());
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.put(static_cast<char>(byte ^ 1));
+  };
+  flip_byte(std::filesystem::file_size(path) / 2);
+  BTreeSnapshot<int, 8> corrupted;
+  assert(corrupted.open(path) == FileResult::Success && !corrupted.verify());
+  corrupted.close();
+  flip_byte(20);
+  assert(corrupted.open(path) == FileResult::BadFormat && !corrupted.is_open());
+  std::filesystem::resize_file(path, 100);
+  assert(corrupted.open(path) == FileResult::BadFormat);
+  std::filesystem::remove(path);
+  assert(corrupted.open(path) == FileResult::IoError);
+  std::cout << "Passed!" << std::endl;
+}
+
+template <std::size_t N> std::map<int, PageData*> durable_contents(const DurableBTree<int, N>& tree) {
+  std::map<int, PageData*> contents;
+  for (auto entry : tree.tree()) {
+    contents.emplace(entry.key, entry.data);
+  }
+  return contents;
+}
+
+void test_write_ahead_log() {
+  std::cout << "Testing write-ahead log recovery..." << std::endl;
+  const std::string path = (std::filesystem::temp_directory_path() / "btree_test_wal").string();
+  auto remove_files = [&] {
+    std::filesystem::remove(path + ".wal");
+    std::filesystem::remove(path + ".snap");
+  };
+  remove_files();
+
+  std::map<int, PageData*> expected;
+  std::mt19937 rng(59);
+  auto random_ops = [&](DurableBTree<int, 6>& tree, int ops) {
+    for (int i = 0; i < ops; ++i) {
+      int key = static_cast<int>(rng() % 500);
+      if (rng() % 3 == 0) {
+        bool erased = expected.erase(key) == 1;
+        assert(tree.delete_key(key) == (erased ? DeletionResult::Success : DeletionResult::KeyNotFound));
+      } else {
+        PageData* data = page_for(rng() % 1000);
+        bool inserted = expected.emplace(key, data).second;
+        assert(tree.insert(key, data) == (inserted ? InsertResult::Success : InsertResult::Duplicate));
+      }
+    }
+  };
+
+  {
+    DurableBTree<int, 6> tree(WalOptions{.group_size = 4, .groups_per_sync = 0});
+    assert(tree.open(path) == FileResult::Success && tree.replayed() == 0);
+    random_ops(tree, 3000);
+    assert(tree.sync());
+  }
+  {
+    // Log only.
+    DurableBTree<int, 6> tree;
+    assert(tree.open(path) == FileResult::Success && tree.replayed() > 0);
+    assert(tree.tree().validate() && durable_contents(tree) == expected);
+    assert(tree.checkpoint());
+    random_ops(tree, 1000);
+    assert(tree.sync());
+  }
+  std::uintmax_t log_size = std::filesystem::file_size(path + ".wal");
+  {
+    // Snapshot plus the log written after it. A torn record at the end is dropped.
+    std::ofstream(path + ".wal", std::ios::binary | std::ios::app).write("torn", 4);
+    DurableBTree<int, 6> tree;
+    assert(tree.open(path) == FileResult::Success && tree.replayed() < 1000);
+    assert(tree.tree().validate() && durable_contents(tree) == expected);
+    assert(std::filesystem::file_size(path + ".wal") == log_size);
+
+    // A crash between replacing the snapshot and emptying the log replays records the snapshot already has.
+    std::filesystem::copy_file(path + ".wal", path + ".wal.old");
+    assert(tree.checkpoint());
+  }
+  std::filesystem::rename(path + ".wal.old", path + ".wal");
+  {
+    DurableBTree<int, 6> tree;
+    assert(tree.open(path) == FileResult::Success && tree.replayed() > 0);
+    assert(tree.tree().validate() && durable_contents(tree) == expected);
+  }
+  DurableBTree<long long, 6> wrong_key;
+  assert(wrong_key.open(path) == FileResult::LayoutMismatch);
+
+  // Crash right after the snapshot is replaced, while the deletes and inserts since the last sync were only buffered.
+  // The log has to have them by then, or replaying its synced part brings the deleted keys back.
+  remove_files();
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0) {
+    DurableBTree<int, 6> tree(WalOptions{.group_size = 1000, .groups_per_sync = 0});
+    bool ok = tree.open(path) == FileResult::Success;
+    for (int key = 0; ok && key < 100; ++key) {
+      ok = tree.insert(key, page_for(key)) == InsertResult::Success;
+    }
+    ok = ok && tree.sync();
+    for (int key = 0; ok && key < 50; ++key) {
+      ok = tree.delete_key(key) == DeletionResult::Success &&
+           tree.insert(key + 100, page_for(key)) == InsertResult::Success;
+    }
+    _exit(ok && tree.write_snapshot() ? 0 : 1);
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  {
+    expected.clear();
+    for (int key = 50; key < 150; ++key) {
+      expected.emplace(key, page_for(key < 100 ? key : key - 100));
+    }
+    DurableBTree<int, 6> tree;
+    assert(tree.open(path) == FileResult::Success);
+    assert(tree.tree().validate() && durable_contents(tree) == expected && tree.replayed() == 200);
+  }
+
+  WriteAheadLog<int> closed;
+  closed.append(WalRecordType::Insert, 1, 1);
+  assert(closed.failed());
+  remove_files();
+  std::cout << "Passed!" << std::endl;
+}
+
+// The child process runs a fixed sequence of operations, syncing and checkpointing along the way, and gets SIGKILLed
+// at a random point. Whatever it last reported as synced has to come back, and nothing that doesn't match some prefix
+// of the sequence.
+void test_wal_crash_recovery() {
+  std::cout << "Testing recovery after killing a writer at random points..." << std::endl;
+  const std::string path = (std::filesystem::temp_directory_path() / "btree_test_crash").string();
+  constexpr int MAX_OPS = 200000;
+  auto op_at = [](std::mt19937& rng, std::map<int, PageData*>& state) {
+    int key = static_cast<int>(rng() % 2000);
+    std::uint64_t value = rng() % 100000;
+    if (value % 3 == 0) {
+      state.erase(key);
+    } else {
+      state.emplace(key, page_for(value));
+    }
+    return std::pair(key, value);
+  };
+
+  auto* synced = static_cast<std::atomic<int>*>(
+      mmap(nullptr, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  assert(synced != MAP_FAILED);
+  std::mt19937 crash_rng(61);
+  for (int round = 0; round < 6; ++round) {
+    std::filesystem::remove(path + ".wal");
+    std::filesystem::remove(path + ".snap");
+    synced->store(0);
+
+    pid_t child = fork();
+    assert(child >= 0);
+    if (child == 0) {
+      DurableBTree<int, 8> tree(WalOptions{.group_size = 8, .groups_per_sync = 0});
+      if (tree.open(path) != FileResult::Success) {
+        _exit(1);
+      }
+      std::mt19937 rng(round);
+      std::map<int, PageData*> state;
+      for (int i = 1; i <= MAX_OPS; ++i) {
+        auto [key, value] = op_at(rng, state);
+        if (value % 3 == 0) {
+          (void)tree.delete_key(key);
+        } else {
+          (void)tree.insert(key, page_for(value));
+        }
+        if (i % 2000 == 0 ? !tree.checkpoint() : i % 50 == 0 && !tree.sync()) {
+          _exit(1);
+        }
+        if (i % 50 == 0) {
+          synced->store(i);
+        }
+      }
+      _exit(0);
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(2000 + crash_rng() % 60000));
+    kill(child, SIGKILL);
+    int status = 0;
+    waitpid(child, &status, 0);
+    assert(WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) == 0));
+
+    DurableBTree<int, 8> recovered;
+    assert(recovered.open(path) == FileResult::Success);
+    assert(recovered.tree().validate());
+    std::map<int, PageData*> contents = durable_contents(recovered);
+
+    std::mt19937 rng(round);
+    std::map<int, PageData*> state;
+    int op = 0;
+    for (; op < synced->load(); ++op) {
+      op_at(rng, state);
+    }
+    bool matched = state == contents;
+    for (; !matched && op < MAX_OPS; ++op) {
+      op_at(rng, state);
+      matched = state.size() == contents.size() && state == contents;
+    }
+    assert(matched);
+  }
+  munmap(synced, sizeof(std::atomic<int>));
+  std::filesystem::remove(path + ".wal");
+  std::filesystem::remove(path + ".snap");
+  std::cout << "Passed!" << std::endl;
+}
+
+template <std::size_t N> void check_range_iterator() {
+  using Tree = BTree<int, N>;
+  static_assert(std::bidirectional_iterator<typename Tree::iterator>);
+  static_assert(std::ranges::bidirectional_range<decltype(std::declval<const Tree&>().range(0, 0))>);
+
+  Tree tree;
+  assert(tree.begin() == tree.end());
+  assert(tree.range(0, 100).empty());
+
+  // Deletes leave stale separators behind, which the backwards step has to cope with.
+  std::set<int> expected;
+  std::mt19937 rng(N);
+  for (int i = 0; i < 3000; ++i) {
+    int key = static_cast<int>(rng() % 2000) * 2;
+    if (rng() % 4 == 0) {
+      if (tree.delete_key(key) == DeletionResult::Success) expected.erase(key);
+    } else if (tree.insert(key, page_for(key)) == InsertResult::Success) {
+      expected.insert(key);
+    }
+  }
+
+  std::vector<int> forward;
+  for (const auto& [key, page] : tree) {
+    assert(page == page_for(key));
+    forward.push_back(key);
+  }
+  assert(std::ranges::equal(forward, expected));
+
+  std::vector<int> backward;
+  for (const auto& [key, page] : tree | std::views::reverse) {
+    backward.push_back(key);
+  }
+  assert(std::ranges::equal(backward, expected | std::views::reverse));
+
+  for (int lower = -3; lower < 4010; lower += 37) {
+    for (int width : {0, 1, 2, 5, 100}) {
+      int upper = lower + width;
+      for (auto lower_kind : {RangeBound::Inclusive, RangeBound::Exclusive}) {
+        for (auto upper_kind : {RangeBound::Inclusive, RangeBound::Exclusive}) {
+          std::vector<int> want;
+          for (int key : expected) {
+            bool above = lower_kind == RangeBound::Inclusive ? key >= lower : key > lower;
+            bool below = upper_kind == RangeBound::Inclusive ? key <= upper : key < upper;
+            if (above && below) want.push_back(key);
+          }
+          auto range = tree.range(lower, upper, lower_kind, upper_kind);
+          auto key_of = [](const BTreeEntry<int>& entry) { return entry.key; };
+          assert(std::ranges::equal(range, want, {}, key_of));
+          assert(std::ranges::equal(range | std::views::reverse, want | std::views::reverse, {}, key_of));
+        }
+      }
+    }
+  }
+  assert(tree.range(100, 50).empty());
+
+  // Stopping early is just not advancing any further.
+  auto it = tree.lower_bound(1001);
+  assert(it != tree.end() && (*it).key == *expected.lower_bound(1001));
+  assert(tree.upper_bound(*expected.rbegin()) == tree.end());
+  assert(tree.find_keys_in_range(500, 1500) == std::vector<int>(expected.lower_bound(500), expected.lower_bound(1500)));
+}
+
+void test_string_btree() {
+  std::cout << "Testing prefix compressed string keys..." << std::endl;
+
+  // URL like keys that share long prefixes, small nodes so there are plenty of splits and merges, and a few keys that
+  // sort before or after whole nodes to force prefixes to shrink.
+  std::vector<std::string> keys;
+  for (int host = 0; host < 12; ++host) {
+    for (int page = 0; page < 400; ++page) {
+      keys.push_back("https://www.example-host-" + std::to_string(host) + ".com/articles/2024/" +
+                     std::to_string(page * 7919 % 1000) + "/index.html");
+    }
+  }
+  keys.push_back("");
+  keys.push_back("a");
+  keys.push_back("https://");
+  keys.push_back(std::string(3, '\xff'));
+  keys.push_back(std::string(StringBTree<512>::MAX_KEY_LENGTH, 'h'));
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  StringBTree<512> tree;
+  std::map<std::string, PageData*> expected;
+  std::mt19937 rng(15);
+  for (int round = 0; round < 3; ++round) {
+    for (int op = 0; op < 20000; ++op) {
+      std::size_t i = rng() % keys.size();
+      const std::string& key = keys[i];
+      // The first round mostly inserts, the later ones churn.
+      if (rng() % 4 != 0 || round == 0) {
+        bool fresh = expected.emplace(key, page_for(i)).second;
+        assert(tree.insert(key, page_for(i)) == (fresh ? InsertResult::Success : InsertResult::Duplicate));
+      } else {
+        bool present = expected.erase(key) == 1;
+        assert(tree.delete_key(key) == (present ? DeletionResult::Success : DeletionResult::KeyNotFound));
+      }
+    }
+    assert(tree.validate());
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      auto result = tree.find(keys[i]);
+      assert(result.found == expected.contains(keys[i]));
+      assert(!result.found || result.data == page_for(i));
+    }
+    std::vector<std::string> all;
+    for (auto& [key, data] : expected) {
+      all.push_back(key);
+    }
+    assert(tree.find_keys_in_range("", std::string(4, '\xff')) == all);
+    std::vector<std::string> in_range;
+    for (auto it = expected.lower_bound("https://www.example-host-3");
+         it != expected.lower_bound("https://www.example-host-5"); ++it) {
+      in_range.push_back(it->first);
+    }
+    assert(tree.find_keys_in_range("https://www.example-host-3", "https://www.example-host-5") == in_range);
+  }
+
+  assert(tree.insert(std::string(StringBTree<512>::MAX_KEY_LENGTH + 1, 'h'), nullptr) == InsertResult::Full);
+  for (auto& [key, data] : expected) {
+    assert(tree.delete_key(key) == DeletionResult::Success);
+  }
+  assert(tree.validate() && tree.memory_usage() == 0 && !tree.find("a").found);
+
+  // Composite keys sort like the tuples they encode.
+  std::vector<std::tuple<std::int64_t, std::string, std::uint64_t>> tuples;
+  for (std::int64_t a : {-3, -1, 0, 2}) {
+    for (std::string b : {std::string(""), std::string("a"), std::string("a\0", 2), std::string("a\0b", 3),
+                          std::string("ab")}) {
+      for (std::uint64_t c : {std::uint64_t{0}, std::uint64_t{255}, std::uint64_t{256}, ~std::uint64_t{0}}) {
+        tuples.emplace_back(a, b, c);
+      }
+    }
+  }
+  std::shuffle(tuples.begin(), tuples.end(), rng);
+  StringBTree<512> composite;
+  for (auto& [a, b, c] : tuples) {
+    std::string key;
+    append_key_part(key, a);
+    append_key_part(key, std::string_view(b));
+    append_key_part(key, c);
+    assert(composite.insert(key, nullptr) == InsertResult::Success);
+  }
+  std::sort(tuples.begin(), tuples.end());
+  std::vector<std::string> encoded;
+  for (auto& [a, b, c] : tuples) {
+    std::string key;
+    append_key_part(key, a);
+    append_key_part(key, std::string_view(b));
+    append_key_part(key, c);
+    encoded.push_back(key);
+  }
+  assert(composite.validate());
+  assert(composite.find_keys_in_range(std::string(), std::string(9, '\xff')) == encoded);
+  std::cout << "Passed!" << std::endl;
+}
+
+// Checks every key of a multimap against the reference set of (key, value) pairs.
+template <typename Multimap>
+void check_multimap(const Multimap& multimap, const std::set<std::pair<int, std::uintptr_t>>& expected, int keys) {
+  assert(multimap.validate());
+  assert(multimap.size() == expected.size());
+  for (int key = 0; key < keys; ++key) {
+    std::vector<PageData*> values;
+    for (auto it = expected.lower_bound({key, 0}); it != expected.end() && it->first == key; ++it) {
+      values.push_back(reinterpret_cast<PageData*>(it->second));
+    }
+    assert(multimap.find_all(key) == values);
+    assert(multimap.count(key) == values.size());
+  }
+  std::vector<int> in_range;
+  for (auto it = expected.lower_bound({3, 0}); it != expected.end() && it->first < 9; ++it) {
+    in_range.push_back(it->first);
+  }
+  assert(multimap.find_keys_in_range(3, 9) == in_range);
+}
+
+void test_multimap() {
+  std::cout << "Testing multimap with posting lists..." << std::endl;
+
+  // Skewed so key 0 goes far past the inline limit and back while the others stay inline or hover around it.
+  constexpr int KEYS = 16;
+  BTreeMultimap<int, 4, 4> multimap;
+  std::set<std::pair<int, std::uintptr_t>> expected;
+  std::mt19937 rng(17);
+  for (int round = 0; round < 4; ++round) {
+    for (int op = 0; op < 6000; ++op) {
+      int key = static_cast<int>(rng() % 3 == 0 ? 0 : rng() % KEYS);
+      PageData* value = page_for(rng() % (key == 0 ? 2000 : 12));
+      std::pair<int, std::uintptr_t> pair{key, reinterpret_cast<std::uintptr_t>(value)};
+      // Even rounds grow, odd rounds shrink.
+      if (rng() % 3 != 0 ? round % 2 == 0 : round % 2 == 1) {
+        bool fresh = expected.insert(pair).second;
+        assert(multimap.insert(key, value) == (fresh ? InsertResult::Success : InsertResult::Duplicate));
+      } else {
+        bool present = expected.erase(pair) == 1;
+        assert(multimap.delete_key(key, value) == (present ? DeletionResult::Success : DeletionResult::KeyNotFound));
+      }
+    }
+    check_multimap(multimap, expected, KEYS);
+  }
+  assert(multimap.spilled_keys() >= 1);
+
+  // find stops when asked to.
+  std::size_t seen = 0;
+  multimap.find(0, [&](PageData*) { return ++seen < 3; });
+  assert(seen == std::min<std::size_t>(3, multimap.count(0)));
+
+  // Crossing the spill threshold one value at a time, both ways.
+  for (std::size_t i = 0; i < 6; ++i) {
+    assert(multimap.insert(100, page_for(i)) == InsertResult::Success);
+    expected.insert({100, reinterpret_cast<std::uintptr_t>(page_for(i))});
+    assert(multimap.validate() && multimap.count(100) == i + 1);
+  }
+  assert(multimap.insert(100, page_for(5)) == InsertResult::Duplicate);
+  for (std::size_t i = 6; i-- > 0;) {
+    assert(multimap.delete_key(100, page_for(i)) == DeletionResult::Success);
+    expected.erase({100, reinterpret_cast<std::uintptr_t>(page_for(i))});
+    assert(multimap.validate() && multimap.count(100) == i);
+  }
+  assert(multimap.delete_key(100, page_for(0)) == DeletionResult::KeyNotFound);
+
+  for (int key = 0; key < KEYS; ++key) {
+    std::size_t removed = 0;
+    for (auto it = expected.lower_bound({key, 0}); it != expected.end() && it->first == key;) {
+      it = expected.erase(it);
+      removed++;
+    }
+    assert(multimap.delete_all(key) == removed);
+  }
+  assert(multimap.validate() && multimap.size() == 0 && multimap.spilled_keys() == 0);
+  assert(multimap.find_all(0).empty());
+  std::cout << "Passed!" << std::endl;
+}
+
+void test_range_iterator() {
+  std::cout << "Testing range iterator..." << std::endl;
+  check_range_iterator<4>();
+  check_range_iterator<5>();
+  check_range_iterator<16>();
+  std::cout << "Passed!" << std::endl;
+}
+
 int main() {
   test_insert_empty_tree();
   test_insert_multiple();
@@ -212,6 +1980,30 @@ int main() {
   test_delete_merge_to_single_leaf();
   test_delete_merge_n4();
   test_delete_redistribute();
+  test_bulk_load();
+  test_bulk_load_rejects_bad_input();
+  test_slab_allocator_reuses_nodes();
+  test_insert_delete_churn();
+  test_delete_range();
+  test_eytzinger_layout();
+  test_range_iterator();
+  test_find_batch();
+  test_operations_dont_allocate();
+  test_upsert();
+  test_stats();
+  test_append();
+  test_relaxed_rebalance();
+  test_compact();
+  test_parallel_bulk_load();
+  test_disk_btree();
+  test_buffer_pool();
+  test_snapshot();
+  test_write_ahead_log();
+  test_wal_crash_recovery();
+  test_string_btree();
+  test_multimap();
+  test_concurrent_btree();
+  test_epoch_reclamation();
   std::cout << "All tests passed!" << std::endl;
   return 0;
 }